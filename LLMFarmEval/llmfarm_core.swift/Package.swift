@@ -10,6 +10,24 @@ let package = Package(
         .library(
             name: "llmfarm_core",
             targets: ["llmfarm_core"]),
+        .executable(
+            name: "bench-matmul",
+            targets: ["bench-matmul"]),
+        .executable(
+            name: "bench-vec-dot",
+            targets: ["bench-vec-dot"]),
+        .executable(
+            name: "bench-conversations",
+            targets: ["bench-conversations"]),
+        .executable(
+            name: "bench-quants",
+            targets: ["bench-quants"]),
+        .executable(
+            name: "bench",
+            targets: ["bench"]),
+        .executable(
+            name: "check-logits",
+            targets: ["check-logits"]),
     ],
     dependencies: [
         // Dependencies declare other packages that this package depends on.
@@ -22,10 +40,12 @@ let package = Package(
               path: "Sources/llmfarm_core"),
         .target(
             name: "llmfarm_core_cpp",
-            sources: ["ggml/ggml.c","exception_helper.cpp","ggml/k_quants.c","ggml/ggml-alloc.c","ggml/ggml-metal.m","ggml/common.cpp",
+            sources: ["ggml/ggml.c","exception_helper.cpp","ggml/ggml-quants.c","ggml/k_quants.c","ggml/ggml-vec.c","ggml/ggml-alloc.c",
+                      "ggml/ggml-quants-avx2.c","ggml/ggml-quants-avxvnni.c","ggml/ggml-quants-avx512vnni.c",
+                      "ggml/k_quants-avx2.c","ggml/k_quants-avxvnni.c","ggml/k_quants-avx512vnni.c","ggml/ggml-vec-avx2.c","ggml/ggml-metal.m","ggml/common.cpp",
                       "gpt_helpers.cpp","gpt_spm.cpp","package_helper.m","grammar-parser.cpp",
-                      "ggml/ggml_dadbed9.c","ggml/k_quants_dadbed9.c","ggml/ggml-alloc_dadbed9.c","ggml/ggml-metal_dadbed9.m",
-                      "ggml/ggml_d925ed.c","ggml/ggml_d925ed-alloc.c","ggml/ggml_d925ed-metal.m",
+                      "ggml/ggml_dadbed9.c","ggml/k_quants_dadbed9.c","ggml/ggml_dadbed9-avx2.c","ggml/k_quants_dadbed9-avx2.c","ggml/ggml-alloc_dadbed9.c","ggml/ggml-metal_dadbed9.m",
+                      "ggml/ggml_d925ed.c","ggml/ggml_d925ed-avx2.c","ggml/ggml_d925ed-alloc.c","ggml/ggml_d925ed-metal.m",
                       "gptneox/gptneox.cpp","gpt2/gpt2.cpp","replit/replit.cpp","starcoder/starcoder.cpp","rwkv/rwkv.cpp","llama/llama.cpp","llama/llama_dadbed9.cpp"
                       ],
             resources: [
@@ -37,7 +57,7 @@ let package = Package(
             cSettings: [
                 .unsafeFlags(["-Ofast"]), //comment this if you need to Debug llama_cpp                
                 .unsafeFlags(["-DNDEBUG"]),
-                .unsafeFlags(["-mfma","-mfma","-mavx","-mavx2","-mf16c","-msse3","-mssse3"]), //for Intel CPU
+                .unsafeFlags(["-mavx","-mf16c","-msse3","-mssse3"]), //for Intel CPU, AVX2 and VNNI kernels are selected at run time (ggml/ggml-cpu-variant.h)
 //                .unsafeFlags(["-DGGML_METAL_NDEBUG"]),
                 .unsafeFlags(["-DGGML_USE_ACCELERATE"]),
                 .unsafeFlags(["-DGGML_USE_METAL"]),
@@ -56,6 +76,60 @@ let package = Package(
                 .linkedFramework("MetalPerformanceShaders"),
             ]
         ),
+        .executableTarget(
+            name: "bench-matmul",
+            dependencies: ["llmfarm_core_cpp"],
+            path: "Sources/bench-matmul",
+            cxxSettings: [
+                .unsafeFlags(["-Ofast"]),
+                .unsafeFlags(["-DNDEBUG"]),
+            ]
+        ),
+        .executableTarget(
+            name: "bench-vec-dot",
+            dependencies: ["llmfarm_core_cpp"],
+            path: "Sources/bench-vec-dot",
+            cxxSettings: [
+                .unsafeFlags(["-Ofast"]),
+                .unsafeFlags(["-DNDEBUG"]),
+            ]
+        ),
+        .executableTarget(
+            name: "bench-conversations",
+            dependencies: ["llmfarm_core_cpp"],
+            path: "Sources/bench-conversations",
+            cxxSettings: [
+                .unsafeFlags(["-Ofast"]),
+                .unsafeFlags(["-DNDEBUG"]),
+            ]
+        ),
+        .executableTarget(
+            name: "bench-quants",
+            dependencies: ["llmfarm_core_cpp"],
+            path: "Sources/bench-quants",
+            cxxSettings: [
+                .unsafeFlags(["-Ofast"]),
+                .unsafeFlags(["-DNDEBUG"]),
+            ]
+        ),
+        .executableTarget(
+            name: "bench",
+            dependencies: ["llmfarm_core_cpp"],
+            path: "Sources/bench",
+            cxxSettings: [
+                .unsafeFlags(["-Ofast"]),
+                .unsafeFlags(["-DNDEBUG"]),
+            ]
+        ),
+        .executableTarget(
+            name: "check-logits",
+            dependencies: ["llmfarm_core_cpp"],
+            path: "Sources/check-logits",
+            cxxSettings: [
+                .unsafeFlags(["-Ofast"]),
+                .unsafeFlags(["-DNDEBUG"]),
+            ]
+        ),
         
     ],
     cxxLanguageStandard: .cxx20
@@ -0,0 +1,791 @@
+// Conversation replay on the llama C API, without the app.
+//
+// Does what ViewController.runAutomation does in LLMFarmEval: for every conversation of the
+// input file the model is loaded again, every question is answered in turn in the same
+// context, and the measurements are written as the JSON of ConversationsRecordManager. The
+// prompt format, the sampling and the stopping rule are those of LLaMa/LLMBase.predict, so
+// the numbers of a Linux box can be put next to the ones of the device. Every question
+// record also gets the time at which each output token was produced, token_timestamps.
+//
+//   input.json         [["question", ...], ...], one array per conversation
+//   model_config.json  the same file as for the app: the generation, prompt and sampling blocks
+//
+//   bench-conversations -m model.gguf [-i input.json] [-c model_config.json] [-o measurements]
+//                       [-w pause] [-W pause]
+//
+// -w is the pause in seconds after loading the model and after every question (5 in the
+// app), -W the pause after every conversation (60 in the app). The measurements go to
+// <measurements>.json.
+//
+// SwiftPM only builds the package on Apple platforms. On Linux, build the tool directly
+// against the CPU sources of llmfarm_core_cpp, from Sources/:
+//
+//   FLAGS="-Ofast -DNDEBUG -D_GNU_SOURCE -DGGML_USE_K_QUANTS -mavx -mf16c -pthread"
+//   CORE=llmfarm_core_cpp
+//   INC="-I$CORE/spm-headers -I$CORE/ggml"
+//   cc -std=gnu11 $FLAGS $INC -c $CORE/ggml/{ggml,ggml-alloc,ggml-quants,k_quants,ggml-vec}.c
+//   cc -std=gnu11 $FLAGS $INC -c $CORE/ggml/{ggml-quants,k_quants}-{avx2,avxvnni,avx512vnni}.c $CORE/ggml/ggml-vec-avx2.c
+//   TOOL=bench-conversations/bench-conversations
+//   c++ -std=c++20 $FLAGS $INC $TOOL.cpp $CORE/{llama/llama,exception_helper}.cpp *.o -o $TOOL
+
+#include "llama.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// json
+//
+
+// just enough JSON for the two input files
+struct json_value {
+    enum json_type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    json_type   type   = NUL;
+    bool        b      = false;
+    double      number = 0.0;
+    std::string str;
+
+    std::vector<json_value>           items;
+    std::map<std::string, json_value> fields;
+
+    const json_value * get(const std::string & key) const {
+        const auto it = fields.find(key);
+        return type == OBJECT && it != fields.end() ? &it->second : nullptr;
+    }
+};
+
+struct json_parser {
+    const char * p;
+    const char * end;
+
+    void skip_ws() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool expect(const char * lit) {
+        const size_t n = strlen(lit);
+        if ((size_t) (end - p) < n || strncmp(p, lit, n) != 0) {
+            return false;
+        }
+        p += n;
+        return true;
+    }
+
+    static void append_utf8(std::string & s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += (char) cp;
+        } else if (cp < 0x800) {
+            s += (char) (0xc0 | (cp >> 6));
+            s += (char) (0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            s += (char) (0xe0 | (cp >> 12));
+            s += (char) (0x80 | ((cp >> 6) & 0x3f));
+            s += (char) (0x80 | (cp & 0x3f));
+        } else {
+            s += (char) (0xf0 | (cp >> 18));
+            s += (char) (0x80 | ((cp >> 12) & 0x3f));
+            s += (char) (0x80 | ((cp >> 6) & 0x3f));
+            s += (char) (0x80 | (cp & 0x3f));
+        }
+    }
+
+    bool parse_hex4(uint32_t & cp) {
+        if (end - p < 4) {
+            return false;
+        }
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            const char c = *p++;
+            cp <<= 4;
+            if      (c >= '0' && c <= '9') cp |= c - '0';
+            else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool parse_string(std::string & s) {
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        p++;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                s += *p++;
+                continue;
+            }
+            if (++p >= end) {
+                return false;
+            }
+            switch (*p++) {
+                case '"':  s += '"';  break;
+                case '\\': s += '\\'; break;
+                case '/':  s += '/';  break;
+                case 'b':  s += '\b'; break;
+                case 'f':  s += '\f'; break;
+                case 'n':  s += '\n'; break;
+                case 'r':  s += '\r'; break;
+                case 't':  s += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!parse_hex4(cp)) {
+                        return false;
+                    }
+                    if (cp >= 0xd800 && cp < 0xdc00 && expect("\\u")) {
+                        uint32_t lo;
+                        if (!parse_hex4(lo)) {
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    }
+                    append_utf8(s, cp);
+                } break;
+                default: return false;
+            }
+        }
+        if (p >= end) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    bool parse(json_value & v) {
+        skip_ws();
+        if (p >= end) {
+            return false;
+        }
+        switch (*p) {
+            case '{': {
+                p++;
+                v.type = json_value::OBJECT;
+                skip_ws();
+                if (p < end && *p == '}') {
+                    p++;
+                    return true;
+                }
+                while (true) {
+                    std::string key;
+                    skip_ws();
+                    if (!parse_string(key)) {
+                        return false;
+                    }
+                    skip_ws();
+                    if (!expect(":") || !parse(v.fields[key])) {
+                        return false;
+                    }
+                    skip_ws();
+                    if (expect("}")) {
+                        return true;
+                    }
+                    if (!expect(",")) {
+                        return false;
+                    }
+                }
+            }
+            case '[': {
+                p++;
+                v.type = json_value::ARRAY;
+                skip_ws();
+                if (p < end && *p == ']') {
+                    p++;
+                    return true;
+                }
+                while (true) {
+                    v.items.emplace_back();
+                    if (!parse(v.items.back())) {
+                        return false;
+                    }
+                    skip_ws();
+                    if (expect("]")) {
+                        return true;
+                    }
+                    if (!expect(",")) {
+                        return false;
+                    }
+                }
+            }
+            case '"':
+                v.type = json_value::STRING;
+                return parse_string(v.str);
+            case 't':
+                v.type = json_value::BOOL;
+                v.b    = true;
+                return expect("true");
+            case 'f':
+                v.type = json_value::BOOL;
+                return expect("false");
+            case 'n':
+                return expect("null");
+            default: {
+                char * num_end = nullptr;
+                v.type   = json_value::NUMBER;
+                v.number = strtod(p, &num_end);
+                if (num_end == p) {
+                    return false;
+                }
+                p = num_end;
+                return true;
+            }
+        }
+    }
+};
+
+static bool json_read_file(const std::string & fname, json_value & v) {
+    std::ifstream fin(fname, std::ios::binary);
+    if (!fin) {
+        fprintf(stderr, "%s: failed to open '%s'\n", __func__, fname.c_str());
+        return false;
+    }
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    const std::string text = ss.str();
+
+    json_parser parser = { text.data(), text.data() + text.size() };
+    if (!parser.parse(v)) {
+        fprintf(stderr, "%s: invalid JSON in '%s' at offset %zu\n", __func__, fname.c_str(), (size_t) (parser.p - text.data()));
+        return false;
+    }
+    return true;
+}
+
+static std::string json_escape(const std::string & s) {
+    std::string res;
+    for (const unsigned char c : s) {
+        switch (c) {
+            case '"':  res += "\\\""; break;
+            case '\\': res += "\\\\"; break;
+            case '\n': res += "\\n";  break;
+            case '\r': res += "\\r";  break;
+            case '\t': res += "\\t";  break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    res += buf;
+                } else {
+                    res += (char) c;
+                }
+        }
+    }
+    return res;
+}
+
+// the value at key of an object, or def if the key is missing or has another type
+static double json_number(const json_value * obj, const char * key, double def) {
+    const json_value * v = obj ? obj->get(key) : nullptr;
+    return v && v->type == json_value::NUMBER ? v->number : def;
+}
+
+static bool json_bool(const json_value * obj, const char * key, bool def) {
+    const json_value * v = obj ? obj->get(key) : nullptr;
+    return v && v->type == json_value::BOOL ? v->b : def;
+}
+
+static std::string json_string(const json_value * obj, const char * key, const std::string & def) {
+    const json_value * v = obj ? obj->get(key) : nullptr;
+    return v && v->type == json_value::STRING ? v->str : def;
+}
+
+//
+// records, as in PerformanceMetrics.swift
+//
+
+struct time_record {
+    double start    = 0.0; // seconds since 1970
+    double duration = 0.0; // seconds
+};
+
+struct question_record {
+    time_record time;
+    std::string input;
+    std::string output;
+    int original_session_tokens = 0;
+    int input_tokens            = 0;
+    int output_tokens           = 0;
+    std::string runtime_stats;
+
+    std::vector<double> token_timestamps; // seconds since 1970, one per output token
+};
+
+struct conversation_record {
+    std::string model_name;
+    bool        has_model_load_time = false;
+    time_record model_load_time;
+    std::vector<question_record> question_records;
+};
+
+static double time_now() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void write_time_record(FILE * f, const time_record & t, const char * indent) {
+    fprintf(f, "{\n");
+    fprintf(f, "%s  \"start\" : %.6f,\n", indent, t.start);
+    fprintf(f, "%s  \"duration\" : %.6f\n", indent, t.duration);
+    fprintf(f, "%s}", indent);
+}
+
+static bool write_records(const std::string & fname, const std::vector<conversation_record> & conversations) {
+    FILE * f = fopen(fname.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "%s: failed to open '%s' for writing\n", __func__, fname.c_str());
+        return false;
+    }
+
+    fprintf(f, "[\n");
+    for (size_t c = 0; c < conversations.size(); c++) {
+        const conversation_record & cr = conversations[c];
+        fprintf(f, "  {\n");
+        fprintf(f, "    \"modelName\" : \"%s\",\n", json_escape(cr.model_name).c_str());
+        if (cr.has_model_load_time) {
+            fprintf(f, "    \"modelLoadTime\" : ");
+            write_time_record(f, cr.model_load_time, "    ");
+            fprintf(f, ",\n");
+        }
+        fprintf(f, "    \"questionRecords\" : [\n");
+        for (size_t q = 0; q < cr.question_records.size(); q++) {
+            const question_record & qr = cr.question_records[q];
+            fprintf(f, "      {\n");
+            fprintf(f, "        \"time\" : ");
+            write_time_record(f, qr.time, "        ");
+            fprintf(f, ",\n");
+            fprintf(f, "        \"input\" : \"%s\",\n", json_escape(qr.input).c_str());
+            fprintf(f, "        \"output\" : \"%s\",\n", json_escape(qr.output).c_str());
+            fprintf(f, "        \"original_session_tokens\" : %d,\n", qr.original_session_tokens);
+            fprintf(f, "        \"input_tokens\" : %d,\n", qr.input_tokens);
+            fprintf(f, "        \"output_tokens\" : %d,\n", qr.output_tokens);
+            fprintf(f, "        \"runtimeStats\" : \"%s\",\n", json_escape(qr.runtime_stats).c_str());
+            fprintf(f, "        \"token_timestamps\" : [");
+            for (size_t i = 0; i < qr.token_timestamps.size(); i++) {
+                fprintf(f, "%s%.6f", i == 0 ? "" : ", ", qr.token_timestamps[i]);
+            }
+            fprintf(f, "]\n");
+            fprintf(f, "      }%s\n", q + 1 < cr.question_records.size() ? "," : "");
+        }
+        fprintf(f, "    ]\n");
+        fprintf(f, "  }%s\n", c + 1 < conversations.size() ? "," : "");
+    }
+    fprintf(f, "]\n");
+
+    fclose(f);
+    return true;
+}
+
+//
+// model, as set up by ViewController.loadModel and LLaMa/LLMBase
+//
+
+struct sample_params {
+    int   n_batch           = 512;
+    float temp              = 0.9f;
+    int   top_k             = 40;
+    float top_p             = 0.95f;
+    float tfs_z             = 1.0f;
+    float typical_p         = 1.0f;
+    float repeat_penalty    = 1.1f;
+    int   repeat_last_n     = 64;
+    float frequency_penalty = 0.0f;
+    float presence_penalty  = 0.0f;
+    int   mirostat          = 0;
+    float mirostat_tau      = 5.0f;
+    float mirostat_eta      = 0.1f;
+};
+
+struct bench_config {
+    int         n_threads   = 0;
+    int         n_ctx       = 0;
+    bool        use_mlock   = false;
+    uint32_t    seed        = LLAMA_DEFAULT_SEED;
+    int         max_gen_len = 0;
+    std::string prompt_format; // {{prompt}} is replaced by the question
+    sample_params sampling;
+};
+
+static bool read_config(const std::string & fname, bench_config & config) {
+    json_value root;
+    if (!json_read_file(fname, root)) {
+        return false;
+    }
+
+    const json_value * generation = root.get("generation");
+    const json_value * prompt     = root.get("prompt");
+    const json_value * sampling   = root.get("sampling");
+    if (!generation || !prompt || !sampling || !generation->get("max_window_size") || !generation->get("max_gen_len") ||
+            !prompt->get("text")) {
+        fprintf(stderr, "%s: '%s' needs generation.max_window_size, generation.max_gen_len and prompt.text\n",
+                __func__, fname.c_str());
+        return false;
+    }
+
+    config.n_threads   = (int) json_number(generation, "n_threads", std::thread::hardware_concurrency());
+    config.n_ctx       = (int) json_number(generation, "max_window_size", 0);
+    config.use_mlock   = json_bool(generation, "useMlock", false);
+    config.seed        = (uint32_t) json_number(generation, "seed", LLAMA_DEFAULT_SEED);
+    config.max_gen_len = (int) json_number(generation, "max_gen_len", 0);
+
+    config.prompt_format = json_string(prompt, "in_prefix", "") + json_string(prompt, "text", "") + "{{prompt}}" +
+                           json_string(prompt, "in_suffix", "");
+
+    sample_params & sp = config.sampling;
+    sp.n_batch        = (int)   json_number(sampling, "n_batch",            sp.n_batch);
+    sp.repeat_last_n  = (int)   json_number(sampling, "repeat_last_n",      sp.repeat_last_n);
+    sp.repeat_penalty = (float) json_number(sampling, "repetition_penalty", sp.repeat_penalty);
+    sp.temp           = (float) json_number(sampling, "temperature",        sp.temp);
+    sp.top_k          = (int)   json_number(sampling, "top_k",              sp.top_k);
+    sp.top_p          = (float) json_number(sampling, "top_p",              sp.top_p);
+
+    return true;
+}
+
+struct bench_model {
+    llama_model   * model = nullptr;
+    llama_context * ctx   = nullptr;
+
+    int n_past = 0;
+    std::vector<llama_token> session_tokens;
+
+    ~bench_model() {
+        if (ctx) {
+            llama_free(ctx);
+        }
+        if (model) {
+            llama_free_model(model);
+        }
+    }
+};
+
+static std::unique_ptr<bench_model> load_model(const std::string & path, const bench_config & config) {
+    llama_context_params params = llama_context_default_params();
+    params.n_ctx        = config.n_ctx;
+    params.seed         = config.seed;
+    params.use_mlock    = config.use_mlock;
+    params.use_mmap     = false;
+    params.n_gpu_layers = 0;
+#if defined(__x86_64__)
+    params.repack       = true;
+#endif
+
+    std::unique_ptr<bench_model> bm(new bench_model);
+    bm->model = llama_load_model_from_file(path.c_str(), params);
+    if (!bm->model) {
+        return nullptr;
+    }
+    bm->ctx = llama_new_context_with_model(bm->model, params);
+    if (!bm->ctx) {
+        return nullptr;
+    }
+
+    // LLMBase evaluates bos + eos once after loading, without moving n_past
+    const llama_token warmup[2] = { llama_token_bos(bm->ctx), llama_token_eos(bm->ctx) };
+    if (llama_eval(bm->ctx, warmup, 2, 0, config.n_threads) != 0) {
+        return nullptr;
+    }
+
+    return bm;
+}
+
+static std::string token_to_piece(llama_context * ctx, llama_token token) {
+    std::vector<char> buf(8);
+    int n = llama_token_to_piece(ctx, token, buf.data(), buf.size());
+    if (n < 0) {
+        buf.resize(-n);
+        n = llama_token_to_piece(ctx, token, buf.data(), buf.size());
+    }
+    return std::string(buf.data(), std::max(n, 0));
+}
+
+// the piece with every invalid UTF-8 sequence replaced by U+FFFD, as String(cString:) does in Swift
+static std::string utf8_repair(const std::string & s) {
+    std::string res;
+    for (size_t i = 0; i < s.size(); ) {
+        const unsigned char c = s[i];
+        const size_t n = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 0;
+        bool valid = n > 0 && i + n <= s.size();
+        for (size_t j = 1; valid && j < n; j++) {
+            valid = (s[i + j] & 0xc0) == 0x80;
+        }
+        if (valid) {
+            res.append(s, i, n);
+            i += n;
+        } else {
+            res += "\xef\xbf\xbd";
+            i += 1;
+        }
+    }
+    return res;
+}
+
+// characters of a UTF-8 string, for the output length limit
+static int utf8_len(const std::string & s) {
+    int n = 0;
+    for (const unsigned char c : s) {
+        n += (c & 0xc0) != 0x80;
+    }
+    return n;
+}
+
+static llama_token sample(llama_context * ctx, const sample_params & sp, const std::vector<llama_token> & last_tokens) {
+    const int n_vocab = llama_n_vocab(ctx);
+    const float * logits = llama_get_logits(ctx);
+
+    std::vector<llama_token_data> candidates(n_vocab);
+    for (llama_token id = 0; id < n_vocab; id++) {
+        candidates[id] = { id, logits[id], 0.0f };
+    }
+    llama_token_data_array candidates_p = { candidates.data(), candidates.size(), false };
+
+    const int repeat_last_n = sp.repeat_last_n < 0 ? llama_n_ctx(ctx) : sp.repeat_last_n;
+    const size_t n_repeat = std::min(last_tokens.size(), (size_t) repeat_last_n);
+    const llama_token * repeat_tokens = last_tokens.data() + last_tokens.size() - n_repeat;
+
+    llama_sample_repetition_penalty(ctx, &candidates_p, repeat_tokens, n_repeat, sp.repeat_penalty);
+    llama_sample_frequency_and_presence_penalties(ctx, &candidates_p, repeat_tokens, n_repeat,
+            sp.frequency_penalty, sp.presence_penalty);
+
+    if (sp.temp <= 0) {
+        return llama_sample_token_greedy(ctx, &candidates_p);
+    }
+    if (sp.mirostat == 1) {
+        float mirostat_mu = 2.0f*sp.mirostat_tau;
+        llama_sample_temperature(ctx, &candidates_p, sp.temp);
+        return llama_sample_token_mirostat(ctx, &candidates_p, sp.mirostat_tau, sp.mirostat_eta, 100, &mirostat_mu);
+    }
+    if (sp.mirostat == 2) {
+        float mirostat_mu = 2.0f*sp.mirostat_tau;
+        llama_sample_temperature(ctx, &candidates_p, sp.temp);
+        return llama_sample_token_mirostat_v2(ctx, &candidates_p, sp.mirostat_tau, sp.mirostat_eta, &mirostat_mu);
+    }
+
+    const int top_k = sp.top_k <= 0 ? n_vocab : sp.top_k;
+    llama_sample_top_k      (ctx, &candidates_p, top_k, 1);
+    llama_sample_tail_free  (ctx, &candidates_p, sp.tfs_z, 1);
+    llama_sample_typical    (ctx, &candidates_p, sp.typical_p, 1);
+    llama_sample_top_p      (ctx, &candidates_p, sp.top_p, 1);
+    llama_sample_temperature(ctx, &candidates_p, sp.temp);
+    return llama_sample_token(ctx, &candidates_p);
+}
+
+static std::vector<llama_token> tokenize_prompt(llama_context * ctx, const bench_config & config, const std::string & input) {
+    std::string text = config.prompt_format;
+    for (size_t pos = 0; (pos = text.find("{{prompt}}", pos)) != std::string::npos; pos += input.size()) {
+        text.replace(pos, strlen("{{prompt}}"), input);
+    }
+    for (size_t pos = 0; (pos = text.find("\\n", pos)) != std::string::npos; pos += 1) {
+        text.replace(pos, 2, "\n");
+    }
+
+    std::vector<llama_token> tokens(text.size() + 1);
+    const int n = llama_tokenize(ctx, text.c_str(), text.size(), tokens.data(), tokens.size(), true);
+    tokens.resize(std::max(n, 0));
+    return tokens;
+}
+
+// LLMBase.predict: the question and the answer stay in the context for the next question
+static bool predict(bench_model & bm, const bench_config & config, question_record & qr) {
+    llama_context * ctx = bm.ctx;
+    const sample_params & sp = config.sampling;
+
+    qr.original_session_tokens = bm.session_tokens.size();
+
+    std::vector<llama_token> input_tokens = tokenize_prompt(ctx, config, qr.input);
+    bm.session_tokens.insert(bm.session_tokens.end(), input_tokens.begin(), input_tokens.end());
+
+    if ((int) input_tokens.size() > config.n_ctx) {
+        fprintf(stderr, "%s: input too long (%zu tokens)\n", __func__, input_tokens.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < input_tokens.size(); i += sp.n_batch) {
+        const int n_eval = std::min(input_tokens.size() - i, (size_t) sp.n_batch);
+        if (bm.n_past + n_eval > config.n_ctx || llama_eval(ctx, input_tokens.data() + i, n_eval, bm.n_past, config.n_threads) != 0) {
+            fprintf(stderr, "%s: failed to eval\n", __func__);
+            return false;
+        }
+        bm.n_past += n_eval;
+    }
+
+    const llama_token bos = llama_token_bos(ctx);
+    const llama_token eos = llama_token_eos(ctx);
+
+    std::vector<llama_token> repeat_tokens;
+    int total_output = 0;
+
+    while (true) {
+        const llama_token token = sample(ctx, sp, repeat_tokens);
+
+        repeat_tokens.push_back(token);
+        if ((int) repeat_tokens.size() > sp.repeat_last_n) {
+            repeat_tokens.erase(repeat_tokens.begin());
+        }
+
+        if (token == eos) {
+            break;
+        }
+
+        bm.session_tokens.push_back(token);
+
+        if (token != bos) {
+            const std::string piece = utf8_repair(token_to_piece(ctx, token));
+            qr.output += piece;
+            qr.output_tokens++;
+            qr.token_timestamps.push_back(time_now());
+
+            total_output += utf8_len(piece);
+            if (total_output > config.max_gen_len) {
+                break;
+            }
+        }
+
+        if (bm.n_past + 1 > config.n_ctx || llama_eval(ctx, &token, 1, bm.n_past, config.n_threads) != 0) {
+            fprintf(stderr, "%s: failed to eval\n", __func__);
+            return false;
+        }
+        bm.n_past++;
+    }
+
+    const int total_session_tokens = bm.session_tokens.size() - qr.original_session_tokens;
+    qr.input_tokens = total_session_tokens - qr.output_tokens;
+
+    return true;
+}
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s -m model.gguf [-i input.json] [-c model_config.json] [-o measurements] [-w pause] [-W pause]\n", argv0);
+}
+
+int main(int argc, char ** argv) {
+    std::string model_path;
+    std::string input_path  = "input.json";
+    std::string config_path = "model_config.json";
+    std::string measurement = "measurements";
+    int pause_question     = 5;
+    int pause_conversation = 60;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-m") {
+            model_path = argv[++i];
+        } else if (arg == "-i") {
+            input_path = argv[++i];
+        } else if (arg == "-c") {
+            config_path = argv[++i];
+        } else if (arg == "-o") {
+            measurement = argv[++i];
+        } else if (arg == "-w") {
+            pause_question = std::max(0, atoi(argv[++i]));
+        } else if (arg == "-W") {
+            pause_conversation = std::max(0, atoi(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (model_path.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    json_value input;
+    if (!json_read_file(input_path, input)) {
+        return 1;
+    }
+    std::vector<std::vector<std::string>> conversations;
+    for (const json_value & conv : input.items) {
+        conversations.emplace_back();
+        for (const json_value & question : conv.items) {
+            conversations.back().push_back(question.str);
+        }
+    }
+
+    bench_config config;
+    if (!read_config(config_path, config)) {
+        return 1;
+    }
+
+    llama_backend_init(false);
+
+    const std::string model_name = model_path.substr(model_path.find_last_of('/') + 1);
+
+    std::vector<conversation_record> records;
+
+    for (size_t c = 0; c < conversations.size(); c++) {
+        conversation_record cr;
+        cr.model_name = model_name;
+
+        const auto t_load = std::chrono::steady_clock::now();
+        cr.model_load_time.start = time_now();
+
+        std::unique_ptr<bench_model> bm = load_model(model_path, config);
+        if (!bm) {
+            fprintf(stderr, "%s: failed to load model '%s'\n", __func__, model_path.c_str());
+            return 2;
+        }
+
+        cr.model_load_time.duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_load).count();
+        cr.has_model_load_time = true;
+        std::this_thread::sleep_for(std::chrono::seconds(pause_question));
+
+        for (size_t q = 0; q < conversations[c].size(); q++) {
+            question_record qr;
+            qr.input = conversations[c][q];
+
+            printf("%zu_%zu Prompt: %s\n", c, q, qr.input.c_str());
+            fflush(stdout);
+
+            const auto t_start = std::chrono::steady_clock::now();
+            qr.time.start = time_now();
+
+            if (!predict(*bm, config, qr)) {
+                fprintf(stderr, "%s: conversation %zu, question %zu failed\n", __func__, c, q);
+            }
+
+            qr.time.duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+            printf("original_session_tokens: %d\n", qr.original_session_tokens);
+            printf("input_tokens: %d\n", qr.input_tokens);
+            printf("output_tokens: %d\n", qr.output_tokens);
+            printf("%zu_%zu Answer: %s\n", c, q, qr.output.c_str());
+            fflush(stdout);
+
+            cr.question_records.push_back(std::move(qr));
+            std::this_thread::sleep_for(std::chrono::seconds(pause_question));
+        }
+
+        bm.reset();
+        records.push_back(std::move(cr));
+
+        if (c + 1 < conversations.size()) {
+            printf("--sleep--\n");
+            fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::seconds(pause_conversation));
+        }
+    }
+
+    if (!write_records(measurement + ".json", records)) {
+        return 1;
+    }
+    printf("measurements saved to %s.json\n", measurement.c_str());
+
+    llama_backend_free();
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+// Quantized matmul throughput on the CPU backend.
+//
+// Times ggml_mul_mat of a quantized weight matrix with an F32 activation batch for the
+// weight shapes of the 7B and 13B LLaMA models and prints GFLOPS per type and batch size.
+//
+// The spread between the median and the slowest run shows how much the node suffers from
+// threads that finish late; -s splits the rows statically instead of claiming chunks.
+//
+//   bench-matmul [-t n_threads] [-i n_iter] [-b max_batch] [-s]
+
+#include "llama.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+struct bench_shape {
+    const char * name;
+    int64_t      k; // row length of the weights (ne00)
+    int64_t      m; // number of weight rows   (ne01)
+};
+
+static const bench_shape k_shapes[] = {
+    { "7B  attn_q/k/v/o",  4096,  4096 },
+    { "7B  ffn_gate/up",   4096, 11008 },
+    { "7B  ffn_down",     11008,  4096 },
+    { "13B attn_q/k/v/o",  5120,  5120 },
+    { "13B ffn_gate/up",   5120, 13824 },
+    { "13B ffn_down",     13824,  5120 },
+};
+
+static const ggml_type k_types[] = {
+    GGML_TYPE_Q4_0,
+    GGML_TYPE_Q8_0,
+    GGML_TYPE_Q4_K,
+    GGML_TYPE_Q6_K,
+};
+
+static const int k_batches[] = { 1, 8, 32, 128, 512 };
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s [-t n_threads] [-i n_iter] [-b max_batch] [-s]\n", argv0);
+}
+
+int main(int argc, char ** argv) {
+    int n_threads = 1;
+    int n_iter    = 4;
+    int max_batch = 512;
+
+    bool static_split = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-s") {
+            static_split = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-t") {
+            n_threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-i") {
+            n_iter = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-b") {
+            max_batch = std::max(1, atoi(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ggml_time_init();
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    printf("%-18s %-5s %5s %10s %10s %10s %10s\n", "shape", "type", "N", "ms", "GFLOPS", "median ms", "max ms");
+
+    for (const bench_shape & shape : k_shapes) {
+        std::vector<float> weights(shape.k*shape.m);
+        for (float & v : weights) {
+            v = dist(rng);
+        }
+
+        for (const ggml_type type : k_types) {
+            if (shape.k % ggml_blck_size(type) != 0) {
+                continue;
+            }
+
+            // every batch size gets its own activations and result in the same context
+            int64_t n_total = 0;
+            for (const int n : k_batches) {
+                n_total += n <= max_batch ? n : 0;
+            }
+
+            const size_t w_size = ggml_type_size(type)*shape.k/ggml_blck_size(type)*shape.m;
+            const size_t x_size = shape.k*n_total*sizeof(float);
+            const size_t y_size = shape.m*n_total*sizeof(float);
+
+            struct ggml_init_params params = {
+                /*.mem_size   =*/ w_size + x_size + y_size + 16*ggml_tensor_overhead() + ggml_graph_overhead(),
+                /*.mem_buffer =*/ NULL,
+                /*.no_alloc   =*/ false,
+            };
+
+            struct ggml_context * ctx = ggml_init(params);
+            if (ctx == NULL) {
+                fprintf(stderr, "%s: failed to allocate %zu bytes\n", __func__, params.mem_size);
+                return 1;
+            }
+
+            struct ggml_tensor * w = ggml_new_tensor_2d(ctx, type, shape.k, shape.m);
+
+            std::vector<int64_t> hist(1 << 4, 0);
+            ggml_quantize_chunk(type, weights.data(), w->data, 0, shape.k*shape.m, hist.data());
+
+            std::vector<uint8_t> work_buffer;
+
+            for (const int n : k_batches) {
+                if (n > max_batch) {
+                    break;
+                }
+
+                struct ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, shape.k, n);
+                for (int64_t i = 0; i < shape.k*n; i++) {
+                    ((float *) x->data)[i] = dist(rng);
+                }
+
+                struct ggml_tensor * y = ggml_mul_mat(ctx, w, x);
+
+                struct ggml_cgraph gf = ggml_build_forward(y);
+
+                struct ggml_cplan plan = ggml_graph_plan(&gf, n_threads);
+                if (plan.work_size > work_buffer.size()) {
+                    work_buffer.resize(plan.work_size);
+                }
+                plan.work_data    = work_buffer.data();
+                plan.static_split = static_split;
+
+                // warm up
+                ggml_graph_compute(&gf, &plan);
+
+                std::vector<int64_t> t_runs(n_iter);
+                for (int it = 0; it < n_iter; it++) {
+                    const int64_t t_start = ggml_time_us();
+                    ggml_graph_compute(&gf, &plan);
+                    t_runs[it] = ggml_time_us() - t_start;
+                }
+                std::sort(t_runs.begin(), t_runs.end());
+
+                const int64_t t_best = t_runs.front();
+                const double  flops  = 2.0*shape.k*shape.m*n;
+
+                printf("%-18s %-5s %5d %10.3f %10.2f %10.3f %10.3f\n",
+                        shape.name, ggml_type_name(type), n, t_best/1e3, flops/(t_best*1e3),
+                        t_runs[n_iter/2]/1e3, t_runs.back()/1e3);
+                fflush(stdout);
+            }
+
+            ggml_free(ctx);
+        }
+    }
+
+    return 0;
+}
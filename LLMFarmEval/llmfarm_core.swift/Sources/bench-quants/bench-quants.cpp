@@ -0,0 +1,267 @@
+// Throughput of the row kernels of the type traits on the CPU backend.
+//
+// For every type with kernels, times quantize (from_float), dequantize (to_float) and vec_dot
+// over a matrix of rows with the row lengths of the LLaMA weights, on one thread and on n threads
+// that each take an equal share of the rows, as ggml_graph_compute does. The F32 matrix is sized
+// past the caches (-m), so the numbers include the memory traffic of a real model; vec_dot takes
+// one activation row against all weight rows, as in a decode step.
+//
+// GB/s counts the bytes read and written by the kernel, Gop/s the elements converted by quantize
+// and dequantize and the multiply-adds (2 per element) of vec_dot. -j writes the results as JSON
+// so that runs before and after a kernel change can be compared.
+//
+//   bench-quants [-t n_threads] [-i n_iter] [-m matrix_mb] [-n row_len] [-j out.json]
+
+#include "llama.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const ggml_type k_types[] = {
+    GGML_TYPE_F16,
+    GGML_TYPE_Q4_0,
+    GGML_TYPE_Q4_1,
+    GGML_TYPE_Q5_0,
+    GGML_TYPE_Q5_1,
+    GGML_TYPE_Q8_0,
+    GGML_TYPE_Q2_K,
+    GGML_TYPE_Q3_K,
+    GGML_TYPE_Q4_K,
+    GGML_TYPE_Q5_K,
+    GGML_TYPE_Q6_K,
+};
+
+// the row lengths of the 7B attention / ffn_gate and ffn_down weights
+static const int k_row_lens[] = { 4096, 11008 };
+
+enum bench_op {
+    BENCH_QUANTIZE,
+    BENCH_DEQUANTIZE,
+    BENCH_VEC_DOT,
+};
+
+static const char * k_op_names[] = { "quantize", "dequantize", "vec_dot" };
+
+struct bench_result {
+    ggml_type type;
+    int       n;
+    int       n_rows;
+    bench_op  op;
+    int       n_threads;
+    double    ms;
+    double    gb_s;
+    double    gop_s;
+};
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s [-t n_threads] [-i n_iter] [-m matrix_mb] [-n row_len] [-j out.json]\n", argv0);
+}
+
+// runs fn(ir0, ir1) for n_rows rows split in n_threads equal shares, the calling thread takes the first
+template <typename F>
+static void run_rows(int n_rows, int n_threads, F fn) {
+    const int dr = (n_rows + n_threads - 1)/n_threads;
+
+    std::vector<std::thread> workers;
+    for (int ith = 1; ith < n_threads; ith++) {
+        const int ir0 = std::min(n_rows, ith*dr);
+        const int ir1 = std::min(n_rows, ir0 + dr);
+        workers.emplace_back([&fn, ir0, ir1]() { fn(ir0, ir1); });
+    }
+    fn(0, std::min(n_rows, dr));
+    for (auto & w : workers) {
+        w.join();
+    }
+}
+
+// best time of n_iter runs in milliseconds, after one run to warm up
+template <typename F>
+static double time_best_ms(int n_iter, F fn) {
+    fn();
+
+    int64_t t_best = INT64_MAX;
+    for (int it = 0; it < n_iter; it++) {
+        const int64_t t_start = ggml_time_us();
+        fn();
+        t_best = std::min(t_best, ggml_time_us() - t_start);
+    }
+    return t_best/1e3;
+}
+
+static bool write_json(const char * fname, const std::vector<bench_result> & results, int n_threads, int n_iter) {
+    FILE * fp = fopen(fname, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: failed to open %s\n", __func__, fname);
+        return false;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"system_info\": \"%s\",\n", llama_print_system_info());
+    fprintf(fp, "  \"cpu_features\": %d,\n", ggml_cpu_features());
+    fprintf(fp, "  \"n_threads\": %d,\n", n_threads);
+    fprintf(fp, "  \"n_iter\": %d,\n", n_iter);
+    fprintf(fp, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result & r = results[i];
+        fprintf(fp, "    {\"type\": \"%s\", \"n\": %d, \"rows\": %d, \"op\": \"%s\", \"threads\": %d, "
+                "\"ms\": %.4f, \"gb_s\": %.3f, \"gop_s\": %.3f}%s\n",
+                ggml_type_name(r.type), r.n, r.n_rows, k_op_names[r.op], r.n_threads,
+                r.ms, r.gb_s, r.gop_s, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    const bool ok = ferror(fp) == 0;
+    return fclose(fp) == 0 && ok;
+}
+
+int main(int argc, char ** argv) {
+    int n_threads = std::max(1, (int) std::thread::hardware_concurrency());
+    int n_iter    = 5;
+    int matrix_mb = 128;
+    int row_len   = 0;
+
+    std::string fname_json;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-t") {
+            n_threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-i") {
+            n_iter = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-m") {
+            matrix_mb = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-n") {
+            row_len = std::max(256, atoi(argv[++i])/256*256);
+        } else if (arg == "-j") {
+            fname_json = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ggml_time_init();
+
+    // the kernels are installed by ggml_init()
+    struct ggml_init_params params = { 0, NULL, true };
+    ggml_free(ggml_init(params));
+
+    std::vector<int> row_lens(std::begin(k_row_lens), std::end(k_row_lens));
+    if (row_len > 0) {
+        row_lens = { row_len };
+    }
+
+    std::vector<int> thread_counts = { 1 };
+    if (n_threads > 1) {
+        thread_counts.push_back(n_threads);
+    }
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<bench_result> results;
+
+    printf("%s\n\n", llama_print_system_info());
+    printf("%-5s %6s %6s %-10s %3s %10s %10s %10s\n", "type", "n", "rows", "op", "t", "ms", "GB/s", "Gop/s");
+
+    for (const int n : row_lens) {
+        const int n_rows = std::max(1, (int) ((size_t) matrix_mb*1024*1024/(sizeof(float)*n)));
+
+        std::vector<float> xf(size_t(n)*n_rows);
+        std::vector<float> yf(n);
+        for (float & v : xf) {
+            v = dist(rng);
+        }
+        for (float & v : yf) {
+            v = dist(rng);
+        }
+
+        std::vector<float> out(size_t(n)*n_rows);
+
+        for (const ggml_type type : k_types) {
+            ggml_type_traits_t traits   = ggml_internal_get_type_traits(type);
+            ggml_type_traits_t traits_y = ggml_internal_get_type_traits(traits.vec_dot_type);
+
+            if (!traits.from_float || !traits.to_float || !traits.vec_dot || !traits_y.from_float || n % traits.blck_size != 0) {
+                continue;
+            }
+
+            const size_t x_row = ggml_type_size(type)*n/ggml_blck_size(type);
+            const size_t y_row = ggml_type_size(traits.vec_dot_type)*n/ggml_blck_size(traits.vec_dot_type);
+
+            std::vector<uint8_t> x(x_row*n_rows);
+            std::vector<uint8_t> y(y_row);
+            traits_y.from_float(yf.data(), y.data(), n);
+
+            std::vector<float> s(n_rows);
+
+            for (const int nth : thread_counts) {
+                // quantize first, dequantize and vec_dot read the rows it wrote
+                for (const bench_op op : { BENCH_QUANTIZE, BENCH_DEQUANTIZE, BENCH_VEC_DOT }) {
+                    double ms    = 0.0;
+                    double bytes = 0.0;
+                    double ops   = 0.0;
+
+                    switch (op) {
+                        case BENCH_QUANTIZE:
+                            ms = time_best_ms(n_iter, [&]() {
+                                run_rows(n_rows, nth, [&](int ir0, int ir1) {
+                                    for (int i = ir0; i < ir1; i++) {
+                                        traits.from_float(xf.data() + size_t(i)*n, x.data() + i*x_row, n);
+                                    }
+                                });
+                            });
+                            bytes = (double) n_rows*(sizeof(float)*n + x_row);
+                            ops   = (double) n_rows*n;
+                            break;
+                        case BENCH_DEQUANTIZE:
+                            ms = time_best_ms(n_iter, [&]() {
+                                run_rows(n_rows, nth, [&](int ir0, int ir1) {
+                                    for (int i = ir0; i < ir1; i++) {
+                                        traits.to_float(x.data() + i*x_row, out.data() + size_t(i)*n, n);
+                                    }
+                                });
+                            });
+                            bytes = (double) n_rows*(x_row + sizeof(float)*n);
+                            ops   = (double) n_rows*n;
+                            break;
+                        case BENCH_VEC_DOT:
+                            ms = time_best_ms(n_iter, [&]() {
+                                run_rows(n_rows, nth, [&](int ir0, int ir1) {
+                                    for (int i = ir0; i < ir1; i++) {
+                                        traits.vec_dot(n, &s[i], x.data() + i*x_row, y.data());
+                                    }
+                                });
+                            });
+                            bytes = (double) n_rows*x_row;
+                            ops   = 2.0*n_rows*n;
+                            break;
+                    }
+
+                    const bench_result r = { type, n, n_rows, op, nth, ms, bytes/(ms*1e6), ops/(ms*1e6) };
+                    results.push_back(r);
+
+                    printf("%-5s %6d %6d %-10s %3d %10.3f %10.2f %10.2f\n",
+                            ggml_type_name(type), n, n_rows, k_op_names[op], nth, r.ms, r.gb_s, r.gop_s);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    if (!fname_json.empty() && !write_json(fname_json.c_str(), results, n_threads, n_iter)) {
+        return 1;
+    }
+
+    return 0;
+}
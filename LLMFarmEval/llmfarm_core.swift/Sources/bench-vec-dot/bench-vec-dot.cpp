@@ -0,0 +1,203 @@
+// Quantized dot product kernels on the CPU backend.
+//
+// Times the vec_dot and vec_dot_tile kernels of the type traits for every kernel set that
+// ggml_cpu_set_features() can select on this CPU and prints the throughput relative to the
+// kernels of the build target. The weights are sized to stay in the L2 cache, so the numbers
+// show the arithmetic of the kernels rather than the memory bandwidth.
+//
+//   bench-vec-dot [-n row_len] [-r n_rows] [-i n_iter]
+
+#include "llama.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static const ggml_type k_types[] = {
+    GGML_TYPE_Q4_0,
+    GGML_TYPE_Q4_1,
+    GGML_TYPE_Q5_0,
+    GGML_TYPE_Q5_1,
+    GGML_TYPE_Q8_0,
+    GGML_TYPE_Q4_K,
+    GGML_TYPE_Q5_K,
+    GGML_TYPE_Q6_K,
+};
+
+struct bench_features {
+    const char * name;
+    int          features;
+};
+
+static const bench_features k_features[] = {
+    { "base",        0                                                                       },
+    { "avx2",        GGML_CPU_FEATURE_AVX2                                                   },
+    { "avx_vnni",    GGML_CPU_FEATURE_AVX2 | GGML_CPU_FEATURE_AVX_VNNI                       },
+    { "avx512_vnni", GGML_CPU_FEATURE_AVX2 | GGML_CPU_FEATURE_AVX512 | GGML_CPU_FEATURE_AVX512_VNNI },
+};
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s [-n row_len] [-r n_rows] [-i n_iter]\n", argv0);
+}
+
+// best time of n_iter runs of fn in nanoseconds, each run repeats fn for at least a millisecond
+template <typename F>
+static double time_best(int n_iter, F fn) {
+    int n_rep = 1;
+    for (int64_t t = 0; n_rep < (1 << 20); n_rep *= 2) {
+        const int64_t t_start = ggml_time_us();
+        for (int r = 0; r < n_rep; r++) {
+            fn();
+        }
+        t = ggml_time_us() - t_start;
+        if (t >= 1000) {
+            break;
+        }
+    }
+
+    int64_t t_best = INT64_MAX;
+    for (int it = 0; it < n_iter; it++) {
+        const int64_t t_start = ggml_time_us();
+        for (int r = 0; r < n_rep; r++) {
+            fn();
+        }
+        t_best = std::min(t_best, ggml_time_us() - t_start);
+    }
+    return 1e3*t_best/n_rep;
+}
+
+static float max_rel_diff(const std::vector<float> & a, const std::vector<float> & b) {
+    float d = 0.0f;
+    for (size_t i = 0; i < a.size(); i++) {
+        d = std::max(d, std::fabs(a[i] - b[i])/std::max(std::fabs(a[i]), 1e-6f));
+    }
+    return d;
+}
+
+int main(int argc, char ** argv) {
+    int n      = 4096;
+    int n_rows = 64;
+    int n_iter = 5;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-n") {
+            n = std::max(256, atoi(argv[++i])/256*256);
+        } else if (arg == "-r") {
+            n_rows = std::max(GGML_VEC_DOT_TILE_X, atoi(argv[++i])/GGML_VEC_DOT_TILE_X*GGML_VEC_DOT_TILE_X);
+        } else if (arg == "-i") {
+            n_iter = std::max(1, atoi(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ggml_time_init();
+
+    // the kernels are installed by ggml_init()
+    struct ggml_init_params params = { 0, NULL, true };
+    ggml_free(ggml_init(params));
+
+    const int features_all = ggml_cpu_features();
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<float> xf(size_t(n)*n_rows);
+    std::vector<float> yf(size_t(n)*GGML_VEC_DOT_TILE_Y);
+    for (float & v : xf) {
+        v = dist(rng);
+    }
+    for (float & v : yf) {
+        v = dist(rng);
+    }
+
+    printf("row length %d, %d rows, cpu features 0x%x\n\n", n, n_rows, features_all);
+    printf("%-5s %-12s %-5s %10s %10s %8s %10s\n", "type", "kernels", "op", "ns/row", "GOPS", "speedup", "max rdiff");
+
+    for (const ggml_type type : k_types) {
+        ggml_type_traits_t traits = ggml_internal_get_type_traits(type);
+        ggml_type_traits_t traits_y = ggml_internal_get_type_traits(traits.vec_dot_type);
+
+        const size_t x_row = ggml_type_size(type)*n/ggml_blck_size(type);
+        const size_t y_row = ggml_type_size(traits.vec_dot_type)*n/ggml_blck_size(traits.vec_dot_type);
+
+        std::vector<uint8_t> x(x_row*n_rows);
+        std::vector<uint8_t> y(y_row*GGML_VEC_DOT_TILE_Y);
+
+        for (int i = 0; i < n_rows; i++) {
+            traits.from_float(xf.data() + size_t(i)*n, x.data() + i*x_row, n);
+        }
+        for (int i = 0; i < GGML_VEC_DOT_TILE_Y; i++) {
+            traits_y.from_float(yf.data() + size_t(i)*n, y.data() + i*y_row, n);
+        }
+
+        double t_base[2] = { 0.0, 0.0 };
+
+        std::vector<float> s_base[2];
+
+        for (const bench_features & bf : k_features) {
+            if ((bf.features & features_all) != bf.features) {
+                continue;
+            }
+
+            ggml_cpu_set_features(bf.features);
+            traits = ggml_internal_get_type_traits(type);
+
+            // one row of y against all rows of x
+            {
+                std::vector<float> s(n_rows);
+
+                const double t = time_best(n_iter, [&]() {
+                    for (int i = 0; i < n_rows; i++) {
+                        traits.vec_dot(n, &s[i], x.data() + i*x_row, y.data());
+                    }
+                });
+
+                const double ns = t/n_rows;
+                if (bf.features == 0) {
+                    t_base[0] = ns;
+                    s_base[0] = s;
+                }
+
+                printf("%-5s %-12s %-5s %10.1f %10.2f %7.2fx %10.2e\n", ggml_type_name(type), bf.name, "row",
+                        ns, 2.0*n/ns, t_base[0]/ns, max_rel_diff(s_base[0], s));
+            }
+
+            // all rows of y against all rows of x, GGML_VEC_DOT_TILE_X rows at a time
+            if (traits.vec_dot_tile) {
+                std::vector<float> s(size_t(n_rows)*GGML_VEC_DOT_TILE_Y);
+
+                const double t = time_best(n_iter, [&]() {
+                    for (int i = 0; i < n_rows; i += GGML_VEC_DOT_TILE_X) {
+                        traits.vec_dot_tile(n, &s[i], n_rows, x.data() + i*x_row, x_row, y.data(), y_row);
+                    }
+                });
+
+                const double ns = t/(n_rows*GGML_VEC_DOT_TILE_Y);
+                if (bf.features == 0) {
+                    t_base[1] = ns;
+                    s_base[1] = s;
+                }
+
+                printf("%-5s %-12s %-5s %10.1f %10.2f %7.2fx %10.2e\n", ggml_type_name(type), bf.name, "tile",
+                        ns, 2.0*n/ns, t_base[1]/ns, max_rel_diff(s_base[1], s));
+            }
+        }
+
+        fflush(stdout);
+    }
+
+    ggml_cpu_set_features(features_all);
+
+    return 0;
+}
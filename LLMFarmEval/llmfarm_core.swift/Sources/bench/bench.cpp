@@ -0,0 +1,463 @@
+// Prefill and decode throughput of a model file on any of the backends of AI.loadModel.
+//
+// The model is loaded once and evaluated through the C entry point of its backend, the one the
+// Swift class calls (llama_eval, llama_dadbed9_eval, gpt_neox_eval, gpt2_eval, replit_eval,
+// starcoder_eval, rwkv_eval_sequence), so the numbers of the backends can be put side by side.
+// For every thread count, prompt length and batch size a prompt of random tokens is evaluated
+// from an empty context in batches of that size, as LLMBase.predict does, then -n tokens are
+// decoded one at a time. The best of -r runs is reported.
+//
+// The load time is the wall time of loading the model and creating the context. The peak RSS is
+// that of the process after the row, so it only grows down the table. RWKV has no context to
+// trim and takes its thread count at load, every other thread count runs on a clone of the
+// context (rwkv_clone_context), which shares the weights.
+//
+// GGUF files are run on LLaMa, the other formats need the backend. n_ctx defaults to the longest
+// prompt plus -n; with GPTNeoX, GPT2, Replit and Starcoder it must not exceed that of the model.
+//
+//   bench -m model [-b backend] [-p 32,128,512] [-B 32,128,512] [-t 1,4] [-n n_gen] [-c n_ctx] [-r n_rep]
+//
+//   backend: llama, llama_dadbed9, gptneox, gpt2, replit, starcoder, rwkv
+
+#include "llama.h"
+#include "llama_dadbed9.h"
+#include "gpt_spm.h"
+#include "gptneox.h"
+#include "gpt2.h"
+#include "replit.h"
+#include "starcoder.h"
+#include "rwkv.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum bench_backend {
+    BACKEND_LLAMA,
+    BACKEND_LLAMA_DADBED9,
+    BACKEND_GPTNEOX,
+    BACKEND_GPT2,
+    BACKEND_REPLIT,
+    BACKEND_STARCODER,
+    BACKEND_RWKV,
+    BACKEND_COUNT,
+};
+
+static const char * k_backend_names[BACKEND_COUNT] = {
+    "llama", "llama_dadbed9", "gptneox", "gpt2", "replit", "starcoder", "rwkv",
+};
+
+struct bench_model {
+    bench_backend backend;
+
+    llama_model   * model_llama = NULL;
+    llama_context * llama       = NULL;
+
+    llama_dadbed9_model   * model_dadbed9 = NULL;
+    llama_dadbed9_context * dadbed9       = NULL;
+
+    // the gpt_neox_context, gpt2_context, ... that derive from it
+    gpt_base_context * gpt = NULL;
+
+    // rwkv is the context of the thread count in use, rwkv_loaded or a clone of it
+    rwkv_context * rwkv_loaded    = NULL;
+    rwkv_context * rwkv           = NULL;
+    int            rwkv_n_loaded  = 0;
+    int            rwkv_n_threads = 0;
+
+    std::vector<float> rwkv_state;
+    std::vector<float> rwkv_logits;
+
+    int n_ctx   = 0;
+    int n_vocab = 0;
+};
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s -m model [-b backend] [-p 32,128,512] [-B 32,128,512] [-t 1,4] [-n n_gen] [-c n_ctx] [-r n_rep]\n", argv0);
+    fprintf(stderr, "  backend: ");
+    for (int i = 0; i < BACKEND_COUNT; i++) {
+        fprintf(stderr, "%s%s", k_backend_names[i], i + 1 < BACKEND_COUNT ? ", " : "\n");
+    }
+}
+
+// "32,128,512" -> { 32, 128, 512 }, empty on a value below 1
+static std::vector<int> parse_list(const char * s) {
+    std::vector<int> values;
+    for (const char * p = s; *p; ) {
+        char * end = NULL;
+        const long v = strtol(p, &end, 10);
+        if (end == p || v < 1 || (*end != ',' && *end != '\0')) {
+            return {};
+        }
+        values.push_back((int) v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+static bool is_gguf(const char * fname) {
+    FILE * fp = fopen(fname, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    char magic[4] = { 0 };
+    const bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, "GGUF", 4) == 0;
+    fclose(fp);
+    return ok;
+}
+
+// in MB, ru_maxrss is in bytes on Darwin and in KB elsewhere
+static double peak_rss_mb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss/(1024.0*1024.0);
+#else
+    return usage.ru_maxrss/1024.0;
+#endif
+}
+
+static bool model_load(bench_model & bm, const char * fname, int n_ctx, int n_batch, int n_threads) {
+    switch (bm.backend) {
+        case BACKEND_LLAMA: {
+            llama_context_params params = llama_context_default_params();
+            params.n_ctx        = n_ctx;
+            params.n_batch      = n_batch;
+            params.n_gpu_layers = 0;
+            bm.model_llama = llama_load_model_from_file(fname, params);
+            if (bm.model_llama == NULL) {
+                return false;
+            }
+            bm.llama = llama_new_context_with_model(bm.model_llama, params);
+            if (bm.llama == NULL) {
+                return false;
+            }
+            bm.n_ctx   = llama_n_ctx(bm.llama);
+            bm.n_vocab = llama_n_vocab(bm.llama);
+        } break;
+        case BACKEND_LLAMA_DADBED9: {
+            llama_dadbed9_context_params params = llama_dadbed9_context_default_params();
+            params.n_ctx        = n_ctx;
+            params.n_batch      = n_batch;
+            params.n_gpu_layers = 0;
+            bm.model_dadbed9 = llama_dadbed9_load_model_from_file(fname, params);
+            if (bm.model_dadbed9 == NULL) {
+                return false;
+            }
+            bm.dadbed9 = llama_dadbed9_new_context_with_model(bm.model_dadbed9, params);
+            if (bm.dadbed9 == NULL) {
+                return false;
+            }
+            bm.n_ctx   = llama_dadbed9_n_ctx(bm.dadbed9);
+            bm.n_vocab = llama_dadbed9_n_vocab(bm.dadbed9);
+        } break;
+        case BACKEND_GPTNEOX:
+        case BACKEND_GPT2:
+        case BACKEND_REPLIT:
+        case BACKEND_STARCODER: {
+            gpt_context_params params = gpt_context_default_params();
+            params.n_ctx   = n_ctx;
+            params.n_batch = n_batch;
+            switch (bm.backend) {
+                case BACKEND_GPTNEOX:   bm.gpt = (gpt_base_context *) gpt_neox_init_from_file(fname, params);  break;
+                case BACKEND_GPT2:      bm.gpt = (gpt_base_context *) gpt2_init_from_file(fname, params);      break;
+                case BACKEND_REPLIT:    bm.gpt = (gpt_base_context *) replit_init_from_file(fname, params);    break;
+                case BACKEND_STARCODER: bm.gpt = (gpt_base_context *) starcoder_init_from_file(fname, params); break;
+                default: break;
+            }
+            if (bm.gpt == NULL) {
+                return false;
+            }
+            // the backends keep the hparams in a model of their own, the one of the base that
+            // gpt_base_n_ctx() reads may be empty, the requested n_ctx caps the one of the model
+            bm.n_ctx   = gpt_base_n_ctx(bm.gpt) > 0 ? gpt_base_n_ctx(bm.gpt) : n_ctx;
+            // replit has a tokenizer of its own, see Replit.llm_n_vocab
+            bm.n_vocab = bm.backend == BACKEND_REPLIT ? replit_n_logits((replit_context *) bm.gpt) : gpt_base_n_vocab(bm.gpt);
+        } break;
+        case BACKEND_RWKV: {
+            bm.rwkv_loaded = rwkv_init_from_file(fname, n_threads);
+            if (bm.rwkv_loaded == NULL) {
+                return false;
+            }
+            bm.rwkv           = bm.rwkv_loaded;
+            bm.rwkv_n_loaded  = n_threads;
+            bm.rwkv_n_threads = n_threads;
+            bm.rwkv_state.resize(rwkv_get_state_len(bm.rwkv));
+            bm.rwkv_logits.resize(rwkv_get_logits_len(bm.rwkv));
+            bm.n_ctx   = INT32_MAX;
+            bm.n_vocab = (int) rwkv_get_n_vocab(bm.rwkv);
+        } break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static void model_free(bench_model & bm) {
+    if (bm.rwkv != NULL && bm.rwkv != bm.rwkv_loaded) {
+        rwkv_free(bm.rwkv);
+    }
+    if (bm.rwkv_loaded != NULL) {
+        rwkv_free(bm.rwkv_loaded);
+    }
+    if (bm.gpt != NULL) {
+        switch (bm.backend) {
+            case BACKEND_GPTNEOX:   gpt_neox_free((gpt_neox_context *) bm.gpt);    break;
+            case BACKEND_GPT2:      gpt2_free((gpt2_context *) bm.gpt);            break;
+            case BACKEND_REPLIT:    replit_free((replit_context *) bm.gpt);        break;
+            case BACKEND_STARCODER: starcoder_free((starcoder_context *) bm.gpt);  break;
+            default: break;
+        }
+    }
+    if (bm.dadbed9 != NULL) {
+        llama_dadbed9_free(bm.dadbed9);
+    }
+    if (bm.model_dadbed9 != NULL) {
+        llama_dadbed9_free_model(bm.model_dadbed9);
+    }
+    if (bm.llama != NULL) {
+        llama_free(bm.llama);
+    }
+    if (bm.model_llama != NULL) {
+        llama_free_model(bm.model_llama);
+    }
+}
+
+// the other backends take the thread count with every eval
+static bool model_set_threads(bench_model & bm, int n_threads) {
+    if (bm.backend != BACKEND_RWKV || n_threads == bm.rwkv_n_threads) {
+        return true;
+    }
+    if (bm.rwkv != bm.rwkv_loaded) {
+        rwkv_free(bm.rwkv);
+    }
+    bm.rwkv = n_threads == bm.rwkv_n_loaded ? bm.rwkv_loaded : rwkv_clone_context(bm.rwkv_loaded, n_threads);
+    if (bm.rwkv == NULL) {
+        bm.rwkv = bm.rwkv_loaded;
+        bm.rwkv_n_threads = bm.rwkv_n_loaded;
+        return false;
+    }
+    bm.rwkv_n_threads = n_threads;
+    return true;
+}
+
+// evaluates n tokens at position n_past, n_past 0 starts over with an empty context
+static bool model_eval(bench_model & bm, const int * tokens, int n, int n_past, int n_threads) {
+    switch (bm.backend) {
+        case BACKEND_LLAMA:
+            return llama_eval(bm.llama, tokens, n, n_past, n_threads) == 0;
+        case BACKEND_LLAMA_DADBED9:
+            return llama_dadbed9_eval(bm.dadbed9, tokens, n, n_past, n_threads) == 0;
+        case BACKEND_GPTNEOX:
+            return gpt_neox_eval((gpt_neox_context *) bm.gpt, tokens, n, n_past, n_threads) == 0;
+        case BACKEND_GPT2:
+            return gpt2_eval((gpt2_context *) bm.gpt, tokens, n, n_past, n_threads) == 0;
+        case BACKEND_REPLIT:
+            return replit_eval((replit_context *) bm.gpt, tokens, n, n_past, n_threads) == 0;
+        case BACKEND_STARCODER:
+            return starcoder_eval((starcoder_context *) bm.gpt, tokens, n, n_past, n_threads) == 0;
+        case BACKEND_RWKV: {
+            if (n_past == 0) {
+                rwkv_init_state(bm.rwkv, bm.rwkv_state.data());
+            }
+            std::vector<uint32_t> seq(tokens, tokens + n);
+            return rwkv_eval_sequence(bm.rwkv, seq.data(), seq.size(), bm.rwkv_state.data(), bm.rwkv_state.data(), bm.rwkv_logits.data());
+        }
+        default:
+            return false;
+    }
+}
+
+int main(int argc, char ** argv) {
+    std::string fname_model;
+    std::string backend_name;
+
+    std::vector<int> prompt_lens   = { 32, 128, 512 };
+    std::vector<int> batch_sizes   = { 32, 128, 512 };
+    std::vector<int> thread_counts = { 1 };
+
+    const int n_hw = std::max(1, (int) std::thread::hardware_concurrency());
+    if (n_hw > 1) {
+        thread_counts.push_back(std::min(n_hw, 8));
+    }
+
+    int n_gen = 32;
+    int n_ctx = 0;
+    int n_rep = 3;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::vector<int> * list = NULL;
+        if (arg == "-m") {
+            fname_model = argv[++i];
+        } else if (arg == "-b") {
+            backend_name = argv[++i];
+        } else if (arg == "-p") {
+            list = &prompt_lens;
+        } else if (arg == "-B") {
+            list = &batch_sizes;
+        } else if (arg == "-t") {
+            list = &thread_counts;
+        } else if (arg == "-n") {
+            n_gen = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-c") {
+            n_ctx = std::max(0, atoi(argv[++i]));
+        } else if (arg == "-r") {
+            n_rep = std::max(1, atoi(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (list != NULL) {
+            *list = parse_list(argv[++i]);
+            if (list->empty()) {
+                fprintf(stderr, "%s: invalid list for %s: %s\n", argv[0], arg.c_str(), argv[i]);
+                return 1;
+            }
+        }
+    }
+
+    if (fname_model.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    bench_model bm;
+    bm.backend = BACKEND_COUNT;
+    if (backend_name.empty()) {
+        if (is_gguf(fname_model.c_str())) {
+            bm.backend = BACKEND_LLAMA;
+        } else {
+            fprintf(stderr, "%s: %s is not a GGUF file, give its backend with -b\n", argv[0], fname_model.c_str());
+            return 1;
+        }
+    }
+    for (int i = 0; i < BACKEND_COUNT && !backend_name.empty(); i++) {
+        if (strcasecmp(backend_name.c_str(), k_backend_names[i]) == 0) {
+            bm.backend = (bench_backend) i;
+        }
+    }
+    if (bm.backend == BACKEND_COUNT) {
+        fprintf(stderr, "%s: unknown backend: %s\n", argv[0], backend_name.c_str());
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const int max_prompt = *std::max_element(prompt_lens.begin(), prompt_lens.end());
+    const int max_batch  = *std::max_element(batch_sizes.begin(), batch_sizes.end());
+    if (n_ctx == 0) {
+        n_ctx = max_prompt + n_gen;
+    }
+
+    llama_backend_init(false);
+
+    const int64_t t_load_start_us = llama_time_us();
+    if (!model_load(bm, fname_model.c_str(), n_ctx, std::min(max_batch, n_ctx), thread_counts[0])) {
+        fprintf(stderr, "%s: failed to load %s with %s\n", argv[0], fname_model.c_str(), k_backend_names[bm.backend]);
+        model_free(bm);
+        return 1;
+    }
+    const double t_load_ms = (llama_time_us() - t_load_start_us)/1e3;
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> dist(0, std::max(0, bm.n_vocab - 1));
+
+    std::vector<int> tokens(max_prompt + n_gen);
+    for (int & t : tokens) {
+        t = dist(rng);
+    }
+
+    printf("model: %s\n", fname_model.c_str());
+    printf("backend: %s, n_ctx: %d, n_vocab: %d, decode: %d tokens, best of %d\n\n",
+            k_backend_names[bm.backend], bm.backend == BACKEND_RWKV ? 0 : bm.n_ctx, bm.n_vocab, n_gen, n_rep);
+    printf("%-13s %6s %6s %3s %10s %14s %14s %12s\n",
+            "backend", "prompt", "batch", "t", "load ms", "prefill tok/s", "decode tok/s", "peak RSS MB");
+
+    int ret = 0;
+
+    for (const int nt : thread_counts) {
+        if (!model_set_threads(bm, nt)) {
+            fprintf(stderr, "%s: failed to create a context with %d threads\n", argv[0], nt);
+            ret = 1;
+            break;
+        }
+
+        // the first eval of a thread count sets up the buffers and the thread pool
+        if (!model_eval(bm, tokens.data(), 1, 0, nt)) {
+            fprintf(stderr, "%s: failed to eval\n", argv[0]);
+            ret = 1;
+            break;
+        }
+
+        for (const int n_prompt : prompt_lens) {
+            if (bm.backend != BACKEND_RWKV && n_prompt + n_gen > bm.n_ctx) {
+                fprintf(stderr, "%s: skipping prompt %d, %d + %d tokens do not fit in n_ctx %d\n",
+                        argv[0], n_prompt, n_prompt, n_gen, bm.n_ctx);
+                continue;
+            }
+            bool whole = false;
+            for (const int n_batch : batch_sizes) {
+                // every batch from the prompt length on evaluates the prompt in one piece, run it once
+                if (n_batch >= n_prompt) {
+                    if (whole) {
+                        continue;
+                    }
+                    whole = true;
+                }
+
+                int64_t t_prefill_us = INT64_MAX;
+                int64_t t_decode_us  = INT64_MAX;
+
+                for (int rep = 0; rep < n_rep && ret == 0; rep++) {
+                    const int64_t t_start_us = llama_time_us();
+                    for (int i = 0; i < n_prompt && ret == 0; i += n_batch) {
+                        if (!model_eval(bm, tokens.data() + i, std::min(n_batch, n_prompt - i), i, nt)) {
+                            ret = 1;
+                        }
+                    }
+                    const int64_t t_mid_us = llama_time_us();
+                    for (int i = n_prompt; i < n_prompt + n_gen && ret == 0; i++) {
+                        if (!model_eval(bm, tokens.data() + i, 1, i, nt)) {
+                            ret = 1;
+                        }
+                    }
+                    t_prefill_us = std::min(t_prefill_us, t_mid_us - t_start_us);
+                    t_decode_us  = std::min(t_decode_us, llama_time_us() - t_mid_us);
+                }
+                if (ret != 0) {
+                    fprintf(stderr, "%s: failed to eval\n", argv[0]);
+                    break;
+                }
+
+                printf("%-13s %6d %6d %3d %10.2f %14.2f %14.2f %12.1f\n",
+                        k_backend_names[bm.backend], n_prompt, std::min(n_batch, n_prompt), nt, t_load_ms,
+                        1e6*n_prompt/t_prefill_us, 1e6*n_gen/t_decode_us, peak_rss_mb());
+                fflush(stdout);
+            }
+            if (ret != 0) {
+                break;
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    model_free(bm);
+    llama_backend_free();
+
+    return ret;
+}
@@ -0,0 +1,635 @@
+// Logits and perplexity of a text corpus, checked against a reference run.
+//
+// The corpus is tokenized and cut in chunks of n_ctx tokens, every chunk is evaluated from an
+// empty context in batches of -B tokens with all logits kept (logits_all), on llama_eval or on
+// the eval of a gpt_base backend. The perplexity is that of the second half of every chunk, where
+// each token has at least n_ctx/2 tokens of context, as in the perplexity example of llama.cpp.
+//
+// -w stores the tokens and the logits of every position as the reference, -r evaluates the same
+// tokens again and compares: for every position the largest absolute difference of a logit to the
+// reference, and the perplexity. The run fails (exit code 1) when a position differs by more than
+// -d or the perplexity by more than -P relative to the reference, so a kernel, graph or cache
+// change can be checked by writing the reference before it and comparing after. The reference
+// takes n_chunks*n_ctx*n_vocab floats, -k keeps it small.
+//
+// -s checks the context window of the gpt_base backends instead: the chunks are evaluated as one
+// stream in a window of n_ctx tokens that drops n_shift tokens with gpt_base_shift_kv_cache()
+// whenever the next batch would not fit, so the window slides over the spare rows of the cache
+// and gpt_kv_window_prepare() moves it back. After every batch past the first shift, the tokens
+// of the window are evaluated again from an empty context in a second instance of the model, and
+// the logits of the batch must not differ by more than -d. The rows kept in the window attended
+// to the dropped tokens when they were computed, so they equal those of the re-evaluation only
+// in a model of one layer with relative positions (gptneox, replit); with more layers the
+// difference is what the dropped tokens left in the cache.
+//
+//   check-logits -m model [-b backend] -f corpus.txt (-w ref.bin | -r ref.bin | -s n_shift) [-c n_ctx]
+//                [-B n_batch] [-k n_chunks] [-t n_threads] [-d max_abs_delta] [-P max_ppl_rel]
+//
+//   backend: llama, gptneox, gpt2, replit, starcoder, GGUF files default to llama
+
+#include "llama.h"
+#include "gpt_spm.h"
+#include "gptneox.h"
+#include "gpt2.h"
+#include "replit.h"
+#include "starcoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum check_backend {
+    BACKEND_LLAMA,
+    BACKEND_GPTNEOX,
+    BACKEND_GPT2,
+    BACKEND_REPLIT,
+    BACKEND_STARCODER,
+    BACKEND_COUNT,
+};
+
+static const char * k_backend_names[BACKEND_COUNT] = {
+    "llama", "gptneox", "gpt2", "replit", "starcoder",
+};
+
+static const uint32_t REF_MAGIC   = 0x6c676974; // 'lgit'
+static const uint32_t REF_VERSION = 1;
+
+// the reference file: this header, the tokens of the chunks [n_chunks*n_ctx] and the logits of
+// every position of the chunks [n_chunks*n_ctx][n_vocab]
+struct ref_header {
+    uint32_t magic;
+    uint32_t version;
+    int32_t  backend;
+    int32_t  n_vocab;
+    int32_t  n_ctx;
+    int32_t  n_chunks;
+    double   ppl;
+};
+
+struct check_model {
+    check_backend backend;
+
+    llama_model   * model_llama = NULL;
+    llama_context * llama       = NULL;
+
+    // the gpt_neox_context, gpt2_context, ... that derive from it
+    gpt_base_context * gpt = NULL;
+
+    int n_vocab = 0;
+};
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s -m model [-b backend] -f corpus.txt (-w ref.bin | -r ref.bin | -s n_shift) [-c n_ctx]\n", argv0);
+    fprintf(stderr, "       [-B n_batch] [-k n_chunks] [-t n_threads] [-d max_abs_delta] [-P max_ppl_rel]\n");
+    fprintf(stderr, "  backend: ");
+    for (int i = 0; i < BACKEND_COUNT; i++) {
+        fprintf(stderr, "%s%s", k_backend_names[i], i + 1 < BACKEND_COUNT ? ", " : "\n");
+    }
+}
+
+static bool is_gguf(const char * fname) {
+    FILE * fp = fopen(fname, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    char magic[4] = { 0 };
+    const bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, "GGUF", 4) == 0;
+    fclose(fp);
+    return ok;
+}
+
+static bool model_load(check_model & cm, const char * fname, int n_ctx, int n_batch) {
+    switch (cm.backend) {
+        case BACKEND_LLAMA: {
+            llama_context_params params = llama_context_default_params();
+            params.n_ctx        = n_ctx;
+            params.n_batch      = n_batch;
+            params.n_gpu_layers = 0;
+            params.logits_all   = true;
+            cm.model_llama = llama_load_model_from_file(fname, params);
+            if (cm.model_llama == NULL) {
+                return false;
+            }
+            cm.llama = llama_new_context_with_model(cm.model_llama, params);
+            if (cm.llama == NULL) {
+                return false;
+            }
+            cm.n_vocab = llama_n_vocab(cm.llama);
+        } break;
+        case BACKEND_GPTNEOX:
+        case BACKEND_GPT2:
+        case BACKEND_REPLIT:
+        case BACKEND_STARCODER: {
+            gpt_context_params params = gpt_context_default_params();
+            params.n_ctx      = n_ctx;
+            params.n_batch    = n_batch;
+            params.logits_all = true;
+            switch (cm.backend) {
+                case BACKEND_GPTNEOX:   cm.gpt = (gpt_base_context *) gpt_neox_init_from_file(fname, params);  break;
+                case BACKEND_GPT2:      cm.gpt = (gpt_base_context *) gpt2_init_from_file(fname, params);      break;
+                case BACKEND_REPLIT:    cm.gpt = (gpt_base_context *) replit_init_from_file(fname, params);    break;
+                case BACKEND_STARCODER: cm.gpt = (gpt_base_context *) starcoder_init_from_file(fname, params); break;
+                default: break;
+            }
+            if (cm.gpt == NULL) {
+                return false;
+            }
+            // replit has a tokenizer of its own, see Replit.llm_n_vocab
+            cm.n_vocab = cm.backend == BACKEND_REPLIT ? replit_n_logits((replit_context *) cm.gpt) : gpt_base_n_vocab(cm.gpt);
+        } break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static void model_free(check_model & cm) {
+    if (cm.gpt != NULL) {
+        switch (cm.backend) {
+            case BACKEND_GPTNEOX:   gpt_neox_free((gpt_neox_context *) cm.gpt);    break;
+            case BACKEND_GPT2:      gpt2_free((gpt2_context *) cm.gpt);            break;
+            case BACKEND_REPLIT:    replit_free((replit_context *) cm.gpt);        break;
+            case BACKEND_STARCODER: starcoder_free((starcoder_context *) cm.gpt);  break;
+            default: break;
+        }
+    }
+    if (cm.llama != NULL) {
+        llama_free(cm.llama);
+    }
+    if (cm.model_llama != NULL) {
+        llama_free_model(cm.model_llama);
+    }
+}
+
+static std::vector<int> model_tokenize(check_model & cm, const std::string & text) {
+    std::vector<int> tokens(text.size() + 1);
+    int n = 0;
+    switch (cm.backend) {
+        case BACKEND_LLAMA:
+            n = llama_tokenize(cm.llama, text.c_str(), (int) text.size(), tokens.data(), (int) tokens.size(), true);
+            break;
+        case BACKEND_REPLIT:
+            n = replit_tokenize((replit_context *) cm.gpt, text.c_str(), tokens.data(), (int) tokens.size(), false);
+            break;
+        default:
+            n = gpt_base_tokenize(cm.gpt, text.c_str(), tokens.data(), (int) tokens.size(), false);
+            break;
+    }
+    tokens.resize(std::max(0, n));
+    return tokens;
+}
+
+// evaluates n tokens at position n_past and copies the logits of all of them to logits
+static bool model_eval(check_model & cm, const int * tokens, int n, int n_past, int n_threads, float * logits) {
+    int ret = 1;
+    switch (cm.backend) {
+        case BACKEND_LLAMA:     ret = llama_eval(cm.llama, tokens, n, n_past, n_threads);                                break;
+        case BACKEND_GPTNEOX:   ret = gpt_neox_eval((gpt_neox_context *) cm.gpt, tokens, n, n_past, n_threads);        break;
+        case BACKEND_GPT2:      ret = gpt2_eval((gpt2_context *) cm.gpt, tokens, n, n_past, n_threads);                break;
+        case BACKEND_REPLIT:    ret = replit_eval((replit_context *) cm.gpt, tokens, n, n_past, n_threads);            break;
+        case BACKEND_STARCODER: ret = starcoder_eval((starcoder_context *) cm.gpt, tokens, n, n_past, n_threads);      break;
+        default: break;
+    }
+    if (ret != 0) {
+        return false;
+    }
+    const float * out = cm.backend == BACKEND_LLAMA ? llama_get_logits(cm.llama) : gpt_base_get_logits_all(cm.gpt);
+    memcpy(logits, out, sizeof(float)*n*cm.n_vocab);
+    return true;
+}
+
+// -log p(token) under the softmax of the logits
+static double nll(const float * logits, int n_vocab, int token) {
+    float max = logits[0];
+    for (int i = 1; i < n_vocab; i++) {
+        max = std::max(max, logits[i]);
+    }
+    double sum = 0.0;
+    for (int i = 0; i < n_vocab; i++) {
+        sum += exp((double) logits[i] - max);
+    }
+    return log(sum) - ((double) logits[token] - max);
+}
+
+static int argmax(const float * logits, int n_vocab) {
+    return (int) (std::max_element(logits, logits + n_vocab) - logits);
+}
+
+// the largest absolute difference of two rows of logits, NaN counts as any difference
+static double max_abs_diff(const float * l0, const float * l1, int n_vocab) {
+    double d = 0.0;
+    for (int k = 0; k < n_vocab; k++) {
+        const double dk = fabs((double) l1[k] - l0[k]);
+        d = dk <= d ? d : dk;
+    }
+    return d;
+}
+
+// -s: the tokens in a sliding window of cm, compared to evaluating the window again in cm_ref
+static bool check_shift(check_model & cm, check_model & cm_ref, const std::vector<int> & tokens,
+                        int n_ctx, int n_batch, int n_shift, int n_threads, double max_abs_delta) {
+    const int n_vocab  = cm.n_vocab;
+    const int n_tokens = (int) tokens.size();
+
+    std::vector<float> logits((size_t) n_batch*n_vocab);
+    std::vector<float> logits_ref((size_t) n_ctx*n_vocab);
+
+    printf("%8s %8s %8s %12s %8s\n", "token", "start", "n_past", "max |d|", "top1 %");
+
+    int n_past   = 0;
+    int start    = 0; // first token of the window
+    int n_shifts = 0;
+
+    double max_delta     = 0.0;
+    size_t max_delta_pos = 0;
+    size_t n_compared    = 0;
+    size_t n_top1        = 0;
+
+    for (int i = 0; i < n_tokens; i += n_batch) {
+        const int n = std::min(n_batch, n_tokens - i);
+        if (n_past + n > n_ctx) {
+            const int n_drop = std::min(n_past, std::max(n_shift, n_past + n - n_ctx));
+            gpt_base_shift_kv_cache(cm.gpt, n_drop);
+            n_past -= n_drop;
+            start  += n_drop;
+            n_shifts++;
+        }
+        if (!model_eval(cm, tokens.data() + i, n, n_past, n_threads, logits.data())) {
+            fprintf(stderr, "%s: failed to eval\n", __func__);
+            return false;
+        }
+        n_past += n;
+
+        if (n_shifts == 0) {
+            continue;
+        }
+
+        for (int j = 0; j < n_past; j += n_batch) {
+            const int n_ref = std::min(n_batch, n_past - j);
+            if (!model_eval(cm_ref, tokens.data() + start + j, n_ref, j, n_threads, logits_ref.data() + (size_t) j*n_vocab)) {
+                fprintf(stderr, "%s: failed to eval the reference\n", __func__);
+                return false;
+            }
+        }
+
+        double batch_max_delta = 0.0;
+        size_t batch_top1      = 0;
+        for (int j = 0; j < n; j++) {
+            const float * l0 = logits_ref.data() + (size_t) (n_past - n + j)*n_vocab;
+            const float * l1 = logits.data()     + (size_t) j*n_vocab;
+
+            const double d = max_abs_diff(l0, l1, n_vocab);
+            if (!std::isnan(max_delta) && !(d <= max_delta)) {
+                max_delta     = d;
+                max_delta_pos = (size_t) i + j;
+            }
+            batch_max_delta = std::max(batch_max_delta, d);
+            batch_top1     += argmax(l0, n_vocab) == argmax(l1, n_vocab);
+        }
+        n_compared += n;
+        n_top1     += batch_top1;
+
+        printf("%8d %8d %8d %12.6f %8.2f\n", i, start, n_past, batch_max_delta, 100.0*batch_top1/n);
+        fflush(stdout);
+    }
+
+    if (n_compared == 0) {
+        fprintf(stderr, "%s: %d tokens never fill the window of %d\n", __func__, n_tokens, n_ctx);
+        return false;
+    }
+
+    const bool pass = max_delta <= max_abs_delta;
+
+    printf("\n");
+    printf("shifts:         %d of at least %d tokens\n", n_shifts, n_shift);
+    printf("max |delta|:    %.6f at token %zu (max %.6f) %s\n", max_delta, max_delta_pos, max_abs_delta, pass ? "ok" : "FAIL");
+    printf("same top token: %.2f%% of %zu positions\n", 100.0*n_top1/n_compared, n_compared);
+
+    return pass;
+}
+
+int main(int argc, char ** argv) {
+    std::string fname_model;
+    std::string fname_corpus;
+    std::string fname_write;
+    std::string fname_read;
+    std::string backend_name;
+
+    int n_ctx     = 0;
+    int n_batch   = 0;
+    int n_chunks  = 0;
+    int n_shift   = 0;
+    int n_threads = std::max(1, (int) std::thread::hardware_concurrency());
+
+    double max_abs_delta = 0.1;
+    double max_ppl_rel   = 0.01;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-m") {
+            fname_model = argv[++i];
+        } else if (arg == "-b") {
+            backend_name = argv[++i];
+        } else if (arg == "-f") {
+            fname_corpus = argv[++i];
+        } else if (arg == "-w") {
+            fname_write = argv[++i];
+        } else if (arg == "-r") {
+            fname_read = argv[++i];
+        } else if (arg == "-s") {
+            n_shift = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-c") {
+            n_ctx = std::max(2, atoi(argv[++i]));
+        } else if (arg == "-B") {
+            n_batch = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-k") {
+            n_chunks = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-t") {
+            n_threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-d") {
+            max_abs_delta = atof(argv[++i]);
+        } else if (arg == "-P") {
+            max_ppl_rel = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const int n_modes = !fname_write.empty() + !fname_read.empty() + (n_shift > 0);
+    if (fname_model.empty() || fname_corpus.empty() || n_modes != 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    check_model cm;
+    cm.backend = BACKEND_COUNT;
+    if (backend_name.empty() && is_gguf(fname_model.c_str())) {
+        cm.backend = BACKEND_LLAMA;
+    }
+    for (int i = 0; i < BACKEND_COUNT && !backend_name.empty(); i++) {
+        if (strcasecmp(backend_name.c_str(), k_backend_names[i]) == 0) {
+            cm.backend = (check_backend) i;
+        }
+    }
+    if (cm.backend == BACKEND_COUNT) {
+        fprintf(stderr, "%s: %s: give the backend of %s with -b\n", argv[0],
+                backend_name.empty() ? "not a GGUF file" : "unknown backend", fname_model.c_str());
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (n_shift > 0 && cm.backend == BACKEND_LLAMA) {
+        fprintf(stderr, "%s: -s checks the context window of the gpt_base backends\n", argv[0]);
+        return 1;
+    }
+
+    // the shape of the reference run, unless given
+    ref_header ref = {};
+    FILE * fp_ref = NULL;
+    if (!fname_read.empty()) {
+        fp_ref = fopen(fname_read.c_str(), "rb");
+        if (fp_ref == NULL || fread(&ref, sizeof(ref), 1, fp_ref) != 1 || ref.magic != REF_MAGIC || ref.version != REF_VERSION) {
+            fprintf(stderr, "%s: %s is not a reference of this version\n", argv[0], fname_read.c_str());
+            return 1;
+        }
+        if (ref.backend != cm.backend) {
+            fprintf(stderr, "%s: %s was written with backend %s\n", argv[0], fname_read.c_str(),
+                    ref.backend >= 0 && ref.backend < BACKEND_COUNT ? k_backend_names[ref.backend] : "?");
+            return 1;
+        }
+        if (n_ctx != 0 && n_ctx != ref.n_ctx) {
+            fprintf(stderr, "%s: %s was written with n_ctx %d\n", argv[0], fname_read.c_str(), ref.n_ctx);
+            return 1;
+        }
+        n_ctx    = ref.n_ctx;
+        n_chunks = n_chunks == 0 ? ref.n_chunks : std::min(n_chunks, ref.n_chunks);
+    }
+    if (n_ctx == 0) {
+        n_ctx = 512;
+    }
+    n_batch = n_batch == 0 ? n_ctx : std::min(n_batch, n_ctx);
+
+    std::ifstream fin(fname_corpus);
+    if (!fin) {
+        fprintf(stderr, "%s: failed to open %s\n", argv[0], fname_corpus.c_str());
+        return 1;
+    }
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    const std::string text = ss.str();
+
+    llama_backend_init(false);
+
+    if (!model_load(cm, fname_model.c_str(), n_ctx, n_batch)) {
+        fprintf(stderr, "%s: failed to load %s with %s\n", argv[0], fname_model.c_str(), k_backend_names[cm.backend]);
+        model_free(cm);
+        return 1;
+    }
+
+    const int n_vocab = cm.n_vocab;
+    if (fp_ref != NULL && ref.n_vocab != n_vocab) {
+        fprintf(stderr, "%s: %s has n_vocab %d, the model %d\n", argv[0], fname_read.c_str(), ref.n_vocab, n_vocab);
+        model_free(cm);
+        return 1;
+    }
+
+    std::vector<int> tokens = model_tokenize(cm, text);
+    const int n_avail = (int) tokens.size()/n_ctx;
+    n_chunks = n_chunks == 0 ? n_avail : std::min(n_chunks, n_avail);
+    if (n_chunks == 0) {
+        fprintf(stderr, "%s: %zu tokens of %s do not fill a chunk of %d\n", argv[0], tokens.size(), fname_corpus.c_str(), n_ctx);
+        model_free(cm);
+        return 1;
+    }
+    tokens.resize((size_t) n_chunks*n_ctx);
+
+    // every chunk starts with BOS on llama, so that the first token is not scored out of context
+    if (cm.backend == BACKEND_LLAMA) {
+        for (int c = 0; c < n_chunks; c++) {
+            tokens[(size_t) c*n_ctx] = llama_token_bos(cm.llama);
+        }
+    }
+
+    if (n_shift > 0) {
+        printf("model: %s, backend: %s\n", fname_model.c_str(), k_backend_names[cm.backend]);
+        printf("corpus: %s, %zu tokens, window %d, shift %d, batch %d, n_vocab %d\n\n", fname_corpus.c_str(),
+                tokens.size(), n_ctx, n_shift, n_batch, n_vocab);
+
+        check_model cm_ref;
+        cm_ref.backend = cm.backend;
+        bool ok = model_load(cm_ref, fname_model.c_str(), n_ctx, n_batch);
+        if (!ok) {
+            fprintf(stderr, "%s: failed to load %s again\n", argv[0], fname_model.c_str());
+        }
+        ok = ok && check_shift(cm, cm_ref, tokens, n_ctx, n_batch, n_shift, n_threads, max_abs_delta);
+
+        model_free(cm_ref);
+        model_free(cm);
+        llama_backend_free();
+        return ok ? 0 : 1;
+    }
+
+    FILE * fp_out = NULL;
+    if (fp_ref != NULL) {
+        std::vector<int> ref_tokens(ref.n_chunks*(size_t) n_ctx);
+        if (fread(ref_tokens.data(), sizeof(int), ref_tokens.size(), fp_ref) != ref_tokens.size()) {
+            fprintf(stderr, "%s: failed to read %s\n", argv[0], fname_read.c_str());
+            model_free(cm);
+            return 1;
+        }
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (tokens[i] != ref_tokens[i]) {
+                fprintf(stderr, "%s: token %zu is %d, in the reference %d: the corpus or the tokenizer differ\n",
+                        argv[0], i, tokens[i], ref_tokens[i]);
+                model_free(cm);
+                return 1;
+            }
+        }
+    } else {
+        fp_out = fopen(fname_write.c_str(), "wb");
+        if (fp_out == NULL) {
+            fprintf(stderr, "%s: failed to open %s\n", argv[0], fname_write.c_str());
+            model_free(cm);
+            return 1;
+        }
+        ref_header hdr = { REF_MAGIC, REF_VERSION, cm.backend, n_vocab, n_ctx, n_chunks, 0.0 };
+        fwrite(&hdr, sizeof(hdr), 1, fp_out);
+        fwrite(tokens.data(), sizeof(int), tokens.size(), fp_out);
+    }
+
+    printf("model: %s, backend: %s\n", fname_model.c_str(), k_backend_names[cm.backend]);
+    printf("corpus: %s, %d chunks of %d tokens, batch %d, n_vocab %d\n\n", fname_corpus.c_str(), n_chunks, n_ctx, n_batch, n_vocab);
+    if (fp_ref != NULL) {
+        printf("%5s %10s %10s %12s %12s %8s\n", "chunk", "ppl", "ref ppl", "max |d|", "mean max |d|", "top1 %");
+    } else {
+        printf("%5s %10s\n", "chunk", "ppl");
+    }
+
+    std::vector<float> logits((size_t) n_ctx*n_vocab);
+    std::vector<float> logits_ref(fp_ref != NULL ? logits.size() : 0);
+
+    const int first = n_ctx/2;
+
+    double nll_sum     = 0.0;
+    double nll_ref_sum = 0.0;
+    int    n_scored    = 0;
+
+    double max_delta     = 0.0;
+    double sum_max_delta = 0.0;
+    size_t max_delta_pos = 0;
+    size_t n_top1        = 0;
+
+    bool ok = true;
+
+    for (int c = 0; c < n_chunks && ok; c++) {
+        const int * chunk = tokens.data() + (size_t) c*n_ctx;
+
+        for (int i = 0; i < n_ctx && ok; i += n_batch) {
+            const int n = std::min(n_batch, n_ctx - i);
+            if (!model_eval(cm, chunk + i, n, i, n_threads, logits.data() + (size_t) i*n_vocab)) {
+                fprintf(stderr, "%s: failed to eval\n", argv[0]);
+                ok = false;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+
+        double nll_chunk = 0.0;
+        for (int j = first; j < n_ctx - 1; j++) {
+            nll_chunk += nll(logits.data() + (size_t) j*n_vocab, n_vocab, chunk[j + 1]);
+        }
+        nll_sum  += nll_chunk;
+        n_scored += n_ctx - 1 - first;
+
+        if (fp_out != NULL) {
+            fwrite(logits.data(), sizeof(float), logits.size(), fp_out);
+            printf("%5d %10.4f\n", c + 1, exp(nll_sum/n_scored));
+            fflush(stdout);
+            continue;
+        }
+
+        if (fread(logits_ref.data(), sizeof(float), logits_ref.size(), fp_ref) != logits_ref.size()) {
+            fprintf(stderr, "%s: failed to read %s\n", argv[0], fname_read.c_str());
+            ok = false;
+            break;
+        }
+
+        double chunk_max_delta = 0.0;
+        for (int j = 0; j < n_ctx; j++) {
+            const float * l0 = logits_ref.data() + (size_t) j*n_vocab;
+            const float * l1 = logits.data()     + (size_t) j*n_vocab;
+
+            const double d = max_abs_diff(l0, l1, n_vocab);
+            if (!std::isnan(max_delta) && !(d <= max_delta)) {
+                max_delta     = d;
+                max_delta_pos = (size_t) c*n_ctx + j;
+            }
+            chunk_max_delta = std::max(chunk_max_delta, d);
+            sum_max_delta  += d;
+            n_top1         += argmax(l0, n_vocab) == argmax(l1, n_vocab);
+
+            if (j >= first && j < n_ctx - 1) {
+                nll_ref_sum += nll(l0, n_vocab, chunk[j + 1]);
+            }
+        }
+
+        const size_t n_pos = (size_t) (c + 1)*n_ctx;
+        printf("%5d %10.4f %10.4f %12.6f %12.6f %8.2f\n", c + 1, exp(nll_sum/n_scored), exp(nll_ref_sum/n_scored),
+                chunk_max_delta, sum_max_delta/n_pos, 100.0*n_top1/n_pos);
+        fflush(stdout);
+    }
+
+    model_free(cm);
+    llama_backend_free();
+
+    const double ppl = exp(nll_sum/std::max(1, n_scored));
+
+    if (fp_out != NULL) {
+        // the perplexity goes in the header once it is known
+        if (ok) {
+            ref_header hdr = { REF_MAGIC, REF_VERSION, cm.backend, n_vocab, n_ctx, n_chunks, ppl };
+            ok = fseek(fp_out, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, fp_out) == 1;
+        }
+        ok = ferror(fp_out) == 0 && ok;
+        ok = fclose(fp_out) == 0 && ok;
+        if (!ok) {
+            fprintf(stderr, "%s: failed to write %s\n", argv[0], fname_write.c_str());
+            return 1;
+        }
+        printf("\nperplexity: %.4f, reference written to %s\n", ppl, fname_write.c_str());
+        return 0;
+    }
+
+    fclose(fp_ref);
+    if (!ok) {
+        return 1;
+    }
+
+    // the reference perplexity of the chunks that were compared, -k may take fewer than it has
+    const double ppl_ref = exp(nll_ref_sum/std::max(1, n_scored));
+    const double ppl_rel = fabs(ppl/ppl_ref - 1.0);
+
+    const bool pass_delta = max_delta <= max_abs_delta;
+    const bool pass_ppl   = ppl_rel   <= max_ppl_rel;
+
+    printf("\n");
+    printf("perplexity:     %.4f, reference %.4f, %+.4f%% (max %.4f%%) %s\n", ppl, ppl_ref,
+            100.0*(ppl/ppl_ref - 1.0), 100.0*max_ppl_rel, pass_ppl ? "ok" : "FAIL");
+    printf("max |delta|:    %.6f at token %zu (chunk %zu, position %zu) (max %.6f) %s\n", max_delta, max_delta_pos,
+            max_delta_pos/n_ctx + 1, max_delta_pos%n_ctx, max_abs_delta, pass_delta ? "ok" : "FAIL");
+    printf("same top token: %.2f%% of %zu positions\n", 100.0*n_top1/tokens.size(), tokens.size());
+
+    return pass_delta && pass_ppl ? 0 : 1;
+}
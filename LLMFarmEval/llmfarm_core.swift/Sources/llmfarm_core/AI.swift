@@ -160,6 +160,9 @@ public func get_model_context_param_by_config(_ model_config:Dictionary<String,
     if (model_config["numberOfThreads"] != nil && model_config["numberOfThreads"] as! Int32 != 0){
         tmp_param.numberOfThreads = model_config["numberOfThreads"] as! Int32
     }
+    if (model_config["autotune"] != nil){
+        tmp_param.autotune = model_config["autotune"] as! Bool
+    }
     
     return tmp_param
 }
@@ -179,6 +182,7 @@ public struct ModelContextParams {
     public var processorsConunt  = Int32(ProcessInfo.processInfo.processorCount)
     public var use_metal = false
     public var grammar_path:String? = nil
+    public var autotune = false     // tune the threads and the prompt batch size of llama_eval() on the first evals
     
     public var warm_prompt = "\n\n\n"
 
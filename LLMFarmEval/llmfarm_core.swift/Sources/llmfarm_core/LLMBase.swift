@@ -250,6 +250,20 @@ public class LLMBase: Model {
         return false
     }
     
+    // Drops the first n tokens of the context window, see gpt_base_shift_kv_cache
+    func llm_shift_context(n: Int32) -> Bool{
+        gpt_base_shift_kv_cache(context, n)
+        return true
+    }
+    
+    // Slides the context window when n_tokens more would not fit in it
+    func llm_make_room(n_tokens: Int32, contextLength: Int32) {
+        let n_shift = nPast + n_tokens - contextLength
+        if n_shift > 0 && llm_shift_context(n: n_shift) {
+            nPast -= n_shift
+        }
+    }
+    
     func llm_init_logits() throws -> Bool {
         do{
             let inputs = [llm_token_bos(),llm_token_eos()]
@@ -321,6 +335,7 @@ public class LLMBase: Model {
             inputBatch.append(contentsOf: inputTokens[0 ..< evalCount])
             
             inputTokens.removeFirst(evalCount)
+            llm_make_room(n_tokens: Int32(evalCount), contextLength: contextLength)
             var eval_res:Bool? = nil
             let exception = tryBlock {
                 eval_res = try? self.llm_eval(inputBatch: inputBatch)
@@ -402,6 +417,7 @@ public class LLMBase: Model {
             // Check if we need to run another response eval
             if outputEnabled {
                 // Send generated token back into model for next generation
+                llm_make_room(n_tokens: 1, contextLength: contextLength)
                 var eval_res:Bool? = nil
                 let exception = tryBlock {
                     eval_res = try? self.llm_eval(inputBatch: [outputToken])
@@ -35,6 +35,7 @@ public class LLaMa: LLMBase {
         self.hardware_arch = Get_Machine_Hardware_Name()// Disable Metal on intel Mac
         if self.hardware_arch=="x86_64"{
             params.n_gpu_layers = 0
+            params.repack = true // interleaved Q4_0/Q4_K rows for the AVX2 kernels, needs use_mmap = false
         }
         params.use_mmap = false
         
@@ -50,6 +51,9 @@ public class LLaMa: LLMBase {
         if self.context == nil {
             return false
         }
+        if contextParams.autotune {
+            llama_set_autotune(self.context, true, "llmfarm_autotune.txt".localModelSaveURL().path)
+        }
 //        var tokens_tmp: [llama_token] = [Int32](repeating: 0, count: 100000)
 //        var tokens_count:Int = 0
 //        llama_load_session_file(self.context,"/Users/guinmoon/Library/Containers/com.guinmoon.LLMFarm/Data/Documents/models/dump_state.bin",tokens_tmp.mutPtr, 100000,&tokens_count)
@@ -67,6 +71,11 @@ public class LLaMa: LLMBase {
         llama_free_model(model)
     }
     
+    // the KV cache of llama_eval has no window to slide
+    override func llm_shift_context(n: Int32) -> Bool{
+        return false
+    }
+    
     override func llm_get_n_ctx(ctx: OpaquePointer!) -> Int32{
         return llama_n_ctx(ctx)
     }
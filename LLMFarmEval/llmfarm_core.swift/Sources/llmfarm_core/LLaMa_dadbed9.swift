@@ -46,6 +46,11 @@ public class LLaMa_dadbed9: LLMBase {
         llama_dadbed9_free(context)
     }
     
+    // the KV cache of llama_dadbed9_eval has no window to slide
+    override func llm_shift_context(n: Int32) -> Bool{
+        return false
+    }
+    
     override func llm_get_n_ctx(ctx: OpaquePointer!) -> Int32{
         return llama_dadbed9_n_ctx(ctx)
     }
@@ -93,6 +93,11 @@ public class RWKV: LLMBase {
         return self.pointerToLogits;
     }
    
+    // the state of RWKV is recurrent, there is no window to slide
+    override func llm_shift_context(n: Int32) -> Bool{
+        return false
+    }
+    
     override func llm_get_n_ctx(ctx: OpaquePointer!) -> Int32{
         return 4096
     }
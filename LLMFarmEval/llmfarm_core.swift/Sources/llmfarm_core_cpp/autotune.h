@@ -0,0 +1,255 @@
+// Online tuning of the thread count and the prompt batch size of the evaluations, see
+// llama_set_autotune().
+//
+// The fastest thread count differs between a single token eval, which streams the weights once
+// per token and stops scaling when the memory bandwidth is used up, and a prompt batch, which
+// is bound by the compute; both depend on the host. eval_autotuner tries candidates on the
+// evals the application makes anyway and keeps the fastest of each phase, with the throughput
+// of every candidate measured over a few evals. The caller runs the evals, times them and
+// reports them with add() / miss(), and stores the outcome (see entry_line()).
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum autotune_phase {
+    AUTOTUNE_DECODE,  // single token evals
+    AUTOTUNE_PREFILL, // prompt batches
+    AUTOTUNE_COUNT,
+};
+
+struct autotune_candidate {
+    int n_threads;
+    int n_batch;         // prefill: the pieces a prompt batch is split in, 0 to keep it whole
+
+    int     n_samples = 0;
+    int     n_miss    = 0;  // prompt batches too short to give a piece of n_batch
+    int64_t n_tokens  = 0;  // of the counted samples
+    int64_t t_us      = 0;
+
+    double tok_s() const {
+        return t_us > 0 ? 1e6*n_tokens/t_us : 0.0;
+    }
+};
+
+struct eval_autotuner {
+    // samples per candidate, the first ones after a switch are not counted: the caches and the
+    // branch predictors of the threads are still cold
+    static const int N_WARMUP_DECODE  = 1;
+    static const int N_SAMPLES_DECODE = 3;
+    static const int N_SAMPLES_PREFILL = 2;
+
+    // a batch size is dropped after this many prompt batches that were too short for it
+    static const int N_MISS = 3;
+
+    // the thread count search stops at the first candidate that is this much slower than the best
+    static constexpr double SLOWER = 0.9;
+
+    // the pieces of the prompt batches while the thread count of prefill is searched
+    static const int N_BATCH_PROBE = 64;
+
+    struct phase_state {
+        std::vector<autotune_candidate> cands;
+        int  cur  = 0;
+        bool done = false;
+
+        // the choice, or the best so far
+        int    n_threads = 0;
+        int    n_batch   = 0;
+        double tok_s     = 0.0;
+    };
+
+    bool enabled    = false;
+    bool started    = false;
+    bool from_cache = false;
+
+    int  n_threads_max = 0;   // the n_threads of the evals
+    int  n_batch_max   = 0;   // the largest batch of the context
+    bool can_split     = true;
+    bool batch_stage   = false; // the prefill thread count is settled, the batch sizes are tried
+
+    phase_state phases[AUTOTUNE_COUNT];
+
+    void reset() {
+        for (auto & ph : phases) {
+            ph = phase_state();
+        }
+        started     = false;
+        from_cache  = false;
+        batch_stage = false;
+    }
+
+    // a choice read from the cache, 0 for a phase that was not tuned yet
+    void set_choice(int n_threads_decode, int n_threads_prefill, int n_batch_prefill) {
+        if (n_threads_decode > 0) {
+            phases[AUTOTUNE_DECODE].done      = true;
+            phases[AUTOTUNE_DECODE].n_threads = n_threads_decode;
+        }
+        if (n_threads_prefill > 0) {
+            phases[AUTOTUNE_PREFILL].done      = true;
+            phases[AUTOTUNE_PREFILL].n_threads = n_threads_prefill;
+            phases[AUTOTUNE_PREFILL].n_batch   = n_batch_prefill;
+        }
+        from_cache = n_threads_decode > 0 || n_threads_prefill > 0;
+    }
+
+    // with the first eval, which gives the largest thread count
+    void start(int n_threads, int n_batch, bool split) {
+        started       = true;
+        n_threads_max = std::max(1, n_threads);
+        n_batch_max   = std::max(1, n_batch);
+        can_split     = split;
+
+        // from the largest down: the search stops where more threads stop paying
+        std::vector<int> threads;
+        for (int nt = n_threads_max; nt >= 1; nt = nt == n_threads_max ? pow2_below(nt) : nt/2) {
+            threads.push_back(nt);
+        }
+
+        const int probe = can_split ? std::min(N_BATCH_PROBE, n_batch_max) : 0;
+        for (const int nt : threads) {
+            if (!phases[AUTOTUNE_DECODE].done) {
+                phases[AUTOTUNE_DECODE].cands.push_back({ nt, 0 });
+            }
+            if (!phases[AUTOTUNE_PREFILL].done) {
+                phases[AUTOTUNE_PREFILL].cands.push_back({ nt, probe });
+            }
+        }
+        for (int p = 0; p < AUTOTUNE_COUNT; p++) {
+            if (!phases[p].done && phases[p].cands.size() == 1) {
+                finish_threads((autotune_phase) p);
+            }
+        }
+    }
+
+    // the thread count and the batch size of the next eval / piece of a prompt batch
+    int n_threads(autotune_phase p) const {
+        const phase_state & ph = phases[p];
+        return std::min(ph.done ? ph.n_threads : ph.cands[ph.cur].n_threads, n_threads_max);
+    }
+
+    int n_batch() const {
+        const phase_state & ph = phases[AUTOTUNE_PREFILL];
+        const int nb = ph.done ? ph.n_batch : ph.cands[ph.cur].n_batch;
+        return can_split ? std::min(nb, n_batch_max) : 0;
+    }
+
+    bool done(autotune_phase p) const {
+        return phases[p].done;
+    }
+
+    // an eval of the current candidate, returns true when the phase is settled by it
+    bool add(autotune_phase p, int n_tokens, int64_t t_us) {
+        phase_state & ph = phases[p];
+        if (ph.done) {
+            return false;
+        }
+        autotune_candidate & c = ph.cands[ph.cur];
+        const int n_warmup  = p == AUTOTUNE_DECODE ? N_WARMUP_DECODE  : 0;
+        const int n_samples = p == AUTOTUNE_DECODE ? N_SAMPLES_DECODE : N_SAMPLES_PREFILL;
+        if (c.n_samples++ >= n_warmup) {
+            c.n_tokens += n_tokens;
+            c.t_us     += t_us;
+        }
+        if (c.n_samples < n_warmup + n_samples) {
+            return false;
+        }
+
+        const bool better = c.tok_s() > ph.tok_s;
+        if (better) {
+            ph.n_threads = c.n_threads;
+            ph.n_batch   = c.n_batch;
+            ph.tok_s     = c.tok_s();
+        }
+        const bool last = ph.cur + 1 == (int) ph.cands.size();
+        if (p == AUTOTUNE_PREFILL && batch_stage) {
+            if (last) {
+                ph.done = true;
+            } else {
+                ph.cur++;
+            }
+            return ph.done;
+        }
+        if (last || (!better && c.tok_s() < SLOWER*ph.tok_s)) {
+            return finish_threads(p);
+        }
+        ph.cur++;
+        return false;
+    }
+
+    // a prompt batch that was too short for the batch size of the current candidate
+    bool miss() {
+        phase_state & ph = phases[AUTOTUNE_PREFILL];
+        if (ph.done || ++ph.cands[ph.cur].n_miss < N_MISS) {
+            return false;
+        }
+        if (!batch_stage) {
+            // the prompts are shorter than the probe, the thread count is measured on them whole
+            for (auto & c : ph.cands) {
+                c.n_batch = 0;
+                c.n_miss  = 0;
+            }
+            return false;
+        }
+        // the batch sizes go up, the prompts are too short for the remaining ones as well
+        ph.done = true;
+        return true;
+    }
+
+    std::string entry_line(const std::string & key) const {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "\t%d\t%d\t%d",
+                phases[AUTOTUNE_DECODE].done  ? phases[AUTOTUNE_DECODE].n_threads  : 0,
+                phases[AUTOTUNE_PREFILL].done ? phases[AUTOTUNE_PREFILL].n_threads : 0,
+                phases[AUTOTUNE_PREFILL].done ? phases[AUTOTUNE_PREFILL].n_batch   : 0);
+        return key + buf;
+    }
+
+private:
+    static int pow2_below(int n) {
+        int p = 1;
+        while (2*p < n) {
+            p *= 2;
+        }
+        return p;
+    }
+
+    // the thread count of the phase is the best so far, prefill goes on with the batch sizes
+    bool finish_threads(autotune_phase p) {
+        phase_state & ph = phases[p];
+        if (ph.n_threads == 0) {
+            ph.n_threads = ph.cands[ph.cur].n_threads;
+            ph.n_batch   = ph.cands[ph.cur].n_batch;
+        }
+        if (p == AUTOTUNE_DECODE || !can_split) {
+            ph.done = true;
+            return true;
+        }
+
+        // the batch sizes up to n_batch at the chosen thread count, the probe is measured already;
+        // without a probe the prompts were shorter than it, only the smaller sizes can be measured
+        const int probe = ph.n_batch;
+        const int n_max = probe > 0 ? n_batch_max : std::min(N_BATCH_PROBE, n_batch_max);
+        std::vector<autotune_candidate> batches;
+        for (int nb = 32; nb < n_max; nb *= 2) {
+            if (nb != probe) {
+                batches.push_back({ ph.n_threads, nb });
+            }
+        }
+        if (probe > 0 && n_batch_max != probe) {
+            batches.push_back({ ph.n_threads, n_batch_max });
+        }
+        if (batches.empty()) {
+            ph.done = true;
+            return true;
+        }
+        ph.cands     = batches;
+        ph.cur       = 0;
+        batch_stage  = true;
+        return false;
+    }
+};
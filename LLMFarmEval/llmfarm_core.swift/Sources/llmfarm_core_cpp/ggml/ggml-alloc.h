@@ -20,6 +20,9 @@ GGML_API void   ggml_allocr_reset(struct ggml_allocr * alloc);
 GGML_API void   ggml_allocr_alloc(struct ggml_allocr * alloc, struct ggml_tensor * tensor);
 GGML_API size_t ggml_allocr_alloc_graph(struct ggml_allocr * alloc, struct ggml_cgraph * graph);
 
+// the highest offset into the buffer that a tensor has been allocated up to, over all graphs so far
+GGML_API size_t ggml_allocr_max_size(struct ggml_allocr * alloc);
+
 
 #ifdef  __cplusplus
 }
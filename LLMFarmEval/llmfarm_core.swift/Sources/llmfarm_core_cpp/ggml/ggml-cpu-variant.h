@@ -0,0 +1,234 @@
+// Builds of the quantization kernels for x86-64 instruction sets above the build target.
+//
+// The package is compiled for a baseline that every supported Intel Mac runs (AVX + F16C).
+// ggml-quants.c and k_quants.c are compiled once more for each variant below, by wrapper
+// translation units (ggml-quants-avx2.c, k_quants-avx2.c, ...) that define GGML_CPU_VARIANT,
+// include this header and then include the kernel source:
+//
+//   avx2        AVX2 + FMA + F16C                       (Haswell, Zen, ...)
+//   avxvnni     avx2 + AVX-VNNI                         (Alder Lake, ...)
+//   avx512vnni  avx2 + AVX512F/BW/DQ/VL + AVX512_VNNI   (Cascade Lake, Ice Lake, Zen 4, ...)
+//
+// The F32/F16 kernels of ggml-vec.c and the kernels of the legacy ggml_dadbed9.c,
+// k_quants_dadbed9.c and ggml_d925ed.c have no use for VNNI and are only built for avx2, which
+// the VNNI CPUs run. The VNNI builds need a compiler that knows AVX-VNNI (GCC 11, clang 12);
+// with an older one the VNNI CPUs run the avx2 build as well.
+//
+// SwiftPM cannot set compiler flags per file, so the target pragmas below stand in for them,
+// and the external functions of the kernel sources get the variant name as a suffix so that
+// all builds link into the same library. ggml_init() installs the build that matches the CPU
+// into the type traits, see ggml_cpu_set_features().
+
+#ifndef GGML_CPU_VARIANT_H
+#define GGML_CPU_VARIANT_H
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GGML_CPU_VARIANTS
+#if defined(__has_include)
+#if __has_include(<avxvnniintrin.h>)
+#define GGML_CPU_VARIANTS_VNNI
+#endif
+#endif
+#endif
+
+// 0 is the build target
+#define GGML_CPU_VARIANT_AVX2       1
+#define GGML_CPU_VARIANT_AVXVNNI    2
+#define GGML_CPU_VARIANT_AVX512VNNI 3
+#define GGML_CPU_VARIANT_COUNT      4
+
+// the wrapper of GGML_CPU_VARIANT builds its kernel source
+#if defined(GGML_CPU_VARIANT)
+#if GGML_CPU_VARIANT == GGML_CPU_VARIANT_AVX2 && defined(GGML_CPU_VARIANTS)
+#define GGML_CPU_VARIANT_BUILD
+#elif GGML_CPU_VARIANT != GGML_CPU_VARIANT_AVX2 && defined(GGML_CPU_VARIANTS_VNNI)
+#define GGML_CPU_VARIANT_BUILD
+#endif
+#endif
+
+#if defined(GGML_CPU_VARIANT_BUILD)
+
+// the system headers keep the build target, only the kernels get the new one
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#if GGML_CPU_VARIANT == GGML_CPU_VARIANT_AVX2
+
+#define GGML_CPU_VARIANT_NAME(name) name ## _avx2
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma,f16c"))), apply_to = function)
+#else
+#pragma GCC target("avx2,fma,f16c")
+#endif
+
+#elif GGML_CPU_VARIANT == GGML_CPU_VARIANT_AVXVNNI
+
+#define GGML_CPU_VARIANT_NAME(name) name ## _avxvnni
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma,f16c,avxvnni"))), apply_to = function)
+#ifndef __AVXVNNI__
+#define __AVXVNNI__ 1
+#endif
+#else
+#pragma GCC target("avx2,fma,f16c,avxvnni")
+#endif
+
+#elif GGML_CPU_VARIANT == GGML_CPU_VARIANT_AVX512VNNI
+
+#define GGML_CPU_VARIANT_NAME(name) name ## _avx512vnni
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma,f16c,avx512f,avx512bw,avx512dq,avx512vl,avx512vnni"))), apply_to = function)
+#ifndef __AVX512F__
+#define __AVX512F__    1
+#endif
+#ifndef __AVX512BW__
+#define __AVX512BW__   1
+#endif
+#ifndef __AVX512DQ__
+#define __AVX512DQ__   1
+#endif
+#ifndef __AVX512VL__
+#define __AVX512VL__   1
+#endif
+#ifndef __AVX512VNNI__
+#define __AVX512VNNI__ 1
+#endif
+#else
+#pragma GCC target("avx2,fma,f16c,avx512f,avx512bw,avx512dq,avx512vl,avx512vnni")
+#endif
+
+#else
+#error "unknown GGML_CPU_VARIANT"
+#endif
+
+// GCC defines the feature macros of the target pragma, clang only applies the attribute
+#if defined(__clang__)
+#ifndef __AVX2__
+#define __AVX2__ 1
+#endif
+#ifndef __FMA__
+#define __FMA__  1
+#endif
+#ifndef __F16C__
+#define __F16C__ 1
+#endif
+#define GGML_CPU_VARIANT_END _Pragma("clang attribute pop")
+#else
+#define GGML_CPU_VARIANT_END
+#endif
+
+// ggml-quants.c
+#define quantize_row_q4_0_reference GGML_CPU_VARIANT_NAME(quantize_row_q4_0_reference)
+#define quantize_row_q4_1_reference GGML_CPU_VARIANT_NAME(quantize_row_q4_1_reference)
+#define quantize_row_q5_0_reference GGML_CPU_VARIANT_NAME(quantize_row_q5_0_reference)
+#define quantize_row_q5_1_reference GGML_CPU_VARIANT_NAME(quantize_row_q5_1_reference)
+#define quantize_row_q8_0_reference GGML_CPU_VARIANT_NAME(quantize_row_q8_0_reference)
+#define quantize_row_q8_1_reference GGML_CPU_VARIANT_NAME(quantize_row_q8_1_reference)
+#define quantize_row_q4_0           GGML_CPU_VARIANT_NAME(quantize_row_q4_0)
+#define quantize_row_q4_1           GGML_CPU_VARIANT_NAME(quantize_row_q4_1)
+#define quantize_row_q5_0           GGML_CPU_VARIANT_NAME(quantize_row_q5_0)
+#define quantize_row_q5_1           GGML_CPU_VARIANT_NAME(quantize_row_q5_1)
+#define quantize_row_q8_0           GGML_CPU_VARIANT_NAME(quantize_row_q8_0)
+#define quantize_row_q8_1           GGML_CPU_VARIANT_NAME(quantize_row_q8_1)
+#define dequantize_row_q4_0         GGML_CPU_VARIANT_NAME(dequantize_row_q4_0)
+#define dequantize_row_q4_1         GGML_CPU_VARIANT_NAME(dequantize_row_q4_1)
+#define dequantize_row_q5_0         GGML_CPU_VARIANT_NAME(dequantize_row_q5_0)
+#define dequantize_row_q5_1         GGML_CPU_VARIANT_NAME(dequantize_row_q5_1)
+#define dequantize_row_q8_0         GGML_CPU_VARIANT_NAME(dequantize_row_q8_0)
+#define ggml_vec_dot_q4_0_q8_0      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q4_0_q8_0)
+#define ggml_vec_dot_q4_1_q8_1      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q4_1_q8_1)
+#define ggml_vec_dot_q5_0_q8_0      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q5_0_q8_0)
+#define ggml_vec_dot_q5_1_q8_1      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q5_1_q8_1)
+#define ggml_vec_dot_q8_0_q8_0      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q8_0_q8_0)
+#define ggml_vec_dot_tile_q4_0_q8_0 GGML_CPU_VARIANT_NAME(ggml_vec_dot_tile_q4_0_q8_0)
+#define ggml_vec_dot_tile_q8_0_q8_0 GGML_CPU_VARIANT_NAME(ggml_vec_dot_tile_q8_0_q8_0)
+#define ggml_vec_dot_rows_q4_0_q8_0 GGML_CPU_VARIANT_NAME(ggml_vec_dot_rows_q4_0_q8_0)
+#define repack_rows_q4_0            GGML_CPU_VARIANT_NAME(repack_rows_q4_0)
+
+// k_quants.c
+#define quantize_row_q2_K_reference GGML_CPU_VARIANT_NAME(quantize_row_q2_K_reference)
+#define quantize_row_q3_K_reference GGML_CPU_VARIANT_NAME(quantize_row_q3_K_reference)
+#define quantize_row_q4_K_reference GGML_CPU_VARIANT_NAME(quantize_row_q4_K_reference)
+#define quantize_row_q5_K_reference GGML_CPU_VARIANT_NAME(quantize_row_q5_K_reference)
+#define quantize_row_q6_K_reference GGML_CPU_VARIANT_NAME(quantize_row_q6_K_reference)
+#define quantize_row_q8_K_reference GGML_CPU_VARIANT_NAME(quantize_row_q8_K_reference)
+#define quantize_row_q2_K           GGML_CPU_VARIANT_NAME(quantize_row_q2_K)
+#define quantize_row_q3_K           GGML_CPU_VARIANT_NAME(quantize_row_q3_K)
+#define quantize_row_q4_K           GGML_CPU_VARIANT_NAME(quantize_row_q4_K)
+#define quantize_row_q5_K           GGML_CPU_VARIANT_NAME(quantize_row_q5_K)
+#define quantize_row_q6_K           GGML_CPU_VARIANT_NAME(quantize_row_q6_K)
+#define quantize_row_q8_K           GGML_CPU_VARIANT_NAME(quantize_row_q8_K)
+#define dequantize_row_q2_K         GGML_CPU_VARIANT_NAME(dequantize_row_q2_K)
+#define dequantize_row_q3_K         GGML_CPU_VARIANT_NAME(dequantize_row_q3_K)
+#define dequantize_row_q4_K         GGML_CPU_VARIANT_NAME(dequantize_row_q4_K)
+#define dequantize_row_q5_K         GGML_CPU_VARIANT_NAME(dequantize_row_q5_K)
+#define dequantize_row_q6_K         GGML_CPU_VARIANT_NAME(dequantize_row_q6_K)
+#define dequantize_row_q8_K         GGML_CPU_VARIANT_NAME(dequantize_row_q8_K)
+#define ggml_vec_dot_q2_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q2_K_q8_K)
+#define ggml_vec_dot_q3_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q3_K_q8_K)
+#define ggml_vec_dot_q4_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q4_K_q8_K)
+#define ggml_vec_dot_q5_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q5_K_q8_K)
+#define ggml_vec_dot_q6_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_vec_dot_q6_K_q8_K)
+#define ggml_vec_dot_tile_q4_K_q8_K GGML_CPU_VARIANT_NAME(ggml_vec_dot_tile_q4_K_q8_K)
+#define ggml_vec_dot_tile_q6_K_q8_K GGML_CPU_VARIANT_NAME(ggml_vec_dot_tile_q6_K_q8_K)
+#define ggml_vec_dot_rows_q4_K_q8_K GGML_CPU_VARIANT_NAME(ggml_vec_dot_rows_q4_K_q8_K)
+#define repack_rows_q4_K            GGML_CPU_VARIANT_NAME(repack_rows_q4_K)
+#define ggml_quantize_q2_K          GGML_CPU_VARIANT_NAME(ggml_quantize_q2_K)
+#define ggml_quantize_q3_K          GGML_CPU_VARIANT_NAME(ggml_quantize_q3_K)
+#define ggml_quantize_q4_K          GGML_CPU_VARIANT_NAME(ggml_quantize_q4_K)
+#define ggml_quantize_q5_K          GGML_CPU_VARIANT_NAME(ggml_quantize_q5_K)
+#define ggml_quantize_q6_K          GGML_CPU_VARIANT_NAME(ggml_quantize_q6_K)
+
+// ggml-vec.c
+#define ggml_vec_dot_f32            GGML_CPU_VARIANT_NAME(ggml_vec_dot_f32)
+#define ggml_vec_dot_f16            GGML_CPU_VARIANT_NAME(ggml_vec_dot_f16)
+#define ggml_vec_mad_f32            GGML_CPU_VARIANT_NAME(ggml_vec_mad_f32)
+#define ggml_vec_mad_f16_f32        GGML_CPU_VARIANT_NAME(ggml_vec_mad_f16_f32)
+
+// ggml_dadbed9.c
+#define ggml_dadbed9_type_traits            GGML_CPU_VARIANT_NAME(ggml_dadbed9_type_traits)
+
+// ggml_d925ed.c
+#define ggml_d925ed_type_traits             GGML_CPU_VARIANT_NAME(ggml_d925ed_type_traits)
+
+// k_quants_dadbed9.c
+#define quantize_row_dadbed9_q2_K_reference GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q2_K_reference)
+#define quantize_row_dadbed9_q3_K_reference GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q3_K_reference)
+#define quantize_row_dadbed9_q4_K_reference GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q4_K_reference)
+#define quantize_row_dadbed9_q5_K_reference GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q5_K_reference)
+#define quantize_row_dadbed9_q6_K_reference GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q6_K_reference)
+#define quantize_row_dadbed9_q8_K_reference GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q8_K_reference)
+#define quantize_row_dadbed9_q2_K           GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q2_K)
+#define quantize_row_dadbed9_q3_K           GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q3_K)
+#define quantize_row_dadbed9_q4_K           GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q4_K)
+#define quantize_row_dadbed9_q5_K           GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q5_K)
+#define quantize_row_dadbed9_q6_K           GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q6_K)
+#define quantize_row_dadbed9_q8_K           GGML_CPU_VARIANT_NAME(quantize_row_dadbed9_q8_K)
+#define dequantize_row_dadbed9_q2_K         GGML_CPU_VARIANT_NAME(dequantize_row_dadbed9_q2_K)
+#define dequantize_row_dadbed9_q3_K         GGML_CPU_VARIANT_NAME(dequantize_row_dadbed9_q3_K)
+#define dequantize_row_dadbed9_q4_K         GGML_CPU_VARIANT_NAME(dequantize_row_dadbed9_q4_K)
+#define dequantize_row_dadbed9_q5_K         GGML_CPU_VARIANT_NAME(dequantize_row_dadbed9_q5_K)
+#define dequantize_row_dadbed9_q6_K         GGML_CPU_VARIANT_NAME(dequantize_row_dadbed9_q6_K)
+#define dequantize_row_dadbed9_q8_K         GGML_CPU_VARIANT_NAME(dequantize_row_dadbed9_q8_K)
+#define ggml_dadbed9_vec_dot_q2_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_dadbed9_vec_dot_q2_K_q8_K)
+#define ggml_dadbed9_vec_dot_q3_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_dadbed9_vec_dot_q3_K_q8_K)
+#define ggml_dadbed9_vec_dot_q4_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_dadbed9_vec_dot_q4_K_q8_K)
+#define ggml_dadbed9_vec_dot_q5_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_dadbed9_vec_dot_q5_K_q8_K)
+#define ggml_dadbed9_vec_dot_q6_K_q8_K      GGML_CPU_VARIANT_NAME(ggml_dadbed9_vec_dot_q6_K_q8_K)
+#define ggml_dadbed9_quantize_q2_K          GGML_CPU_VARIANT_NAME(ggml_dadbed9_quantize_q2_K)
+#define ggml_dadbed9_quantize_q3_K          GGML_CPU_VARIANT_NAME(ggml_dadbed9_quantize_q3_K)
+#define ggml_dadbed9_quantize_q4_K          GGML_CPU_VARIANT_NAME(ggml_dadbed9_quantize_q4_K)
+#define ggml_dadbed9_quantize_q5_K          GGML_CPU_VARIANT_NAME(ggml_dadbed9_quantize_q5_K)
+#define ggml_dadbed9_quantize_q6_K          GGML_CPU_VARIANT_NAME(ggml_dadbed9_quantize_q6_K)
+
+#endif // GGML_CPU_VARIANT_BUILD
+
+#endif // GGML_CPU_VARIANT_H
@@ -0,0 +1,9 @@
+// AVX512_VNNI build of ggml-quants.c, see ggml-cpu-variant.h
+
+#define GGML_CPU_VARIANT GGML_CPU_VARIANT_AVX512VNNI
+#include "ggml-cpu-variant.h"
+
+#if defined(GGML_CPU_VARIANT_BUILD)
+#include "ggml-quants.c"
+GGML_CPU_VARIANT_END
+#endif
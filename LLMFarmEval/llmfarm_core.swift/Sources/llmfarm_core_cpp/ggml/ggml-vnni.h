@@ -0,0 +1,23 @@
+// Integer dot products using the VNNI instructions (vpdpbusd, vpdpwssd) on x86-64.
+//
+// GGML_VNNI is defined when the code is compiled for one of the two encodings of the same
+// instructions on 256-bit registers:
+//
+//   AVX512_VNNI + AVX512VL  EVEX encoded (Ice Lake, Zen 4, ...)
+//   AVX-VNNI                VEX encoded  (Alder Lake, ...)
+//
+// The package build target has neither; the VNNI kernels come from the avx512vnni and avxvnni
+// builds of ggml-quants.c and k_quants.c, see ggml-cpu-variant.h. Include this header after the
+// target of the translation unit is set.
+
+#pragma once
+
+#if defined(__AVX2__) && defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define GGML_VNNI
+#define GGML_VNNI_DPBUSD _mm256_dpbusd_epi32
+#define GGML_VNNI_DPWSSD _mm256_dpwssd_epi32
+#elif defined(__AVX2__) && defined(__AVXVNNI__)
+#define GGML_VNNI
+#define GGML_VNNI_DPBUSD _mm256_dpbusd_avx_epi32
+#define GGML_VNNI_DPWSSD _mm256_dpwssd_avx_epi32
+#endif
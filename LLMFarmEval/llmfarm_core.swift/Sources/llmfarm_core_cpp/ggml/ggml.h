@@ -328,6 +328,9 @@ extern "C" {
         GGML_TYPE_I8,
         GGML_TYPE_I16,
         GGML_TYPE_I32,
+        // row-interleaved layouts made at load time, see ggml_repack()
+        GGML_TYPE_Q4_0_R4,
+        GGML_TYPE_Q4_K_R4,
         GGML_TYPE_COUNT,
     };
 
@@ -381,6 +384,7 @@ extern "C" {
         GGML_OP_RMS_NORM,
         GGML_OP_RMS_NORM_BACK,
         GGML_OP_GROUP_NORM,
+        GGML_OP_RMS_NORM_MUL,
 
         GGML_OP_MUL_MAT,
         GGML_OP_OUT_PROD,
@@ -402,6 +406,7 @@ extern "C" {
         GGML_OP_SOFT_MAX_BACK,
         GGML_OP_ROPE,
         GGML_OP_ROPE_BACK,
+        GGML_OP_ROPE_KV,
         GGML_OP_ALIBI,
         GGML_OP_CLAMP,
         GGML_OP_CONV_1D,
@@ -421,6 +426,7 @@ extern "C" {
         GGML_OP_ADD_REL_POS,
 
         GGML_OP_UNARY,
+        GGML_OP_SWIGLU,
 
         GGML_OP_MAP_UNARY,
         GGML_OP_MAP_BINARY,
@@ -499,6 +505,7 @@ extern "C" {
         int     perf_runs;
         int64_t perf_cycles;
         int64_t perf_time_us;
+        int64_t perf_tail_us; // time between the first and the last thread finishing the node
 
         struct ggml_tensor * view_src;
         size_t               view_offs;
@@ -509,11 +516,14 @@ extern "C" {
 
         void * extra; // extra things e.g. for ggml-cuda.cu
 
-        char padding[4];
+        char padding[12];
     };
 
     static const size_t GGML_TENSOR_SIZE = sizeof(struct ggml_tensor);
 
+    // per-node timings recorded by ggml_graph_compute(), see ggml_profile_new()
+    struct ggml_profile;
+
     // the compute plan that needs to be prepared for ggml_graph_compute()
     // since https://github.com/ggerganov/ggml/issues/287
     struct ggml_cplan {
@@ -528,6 +538,12 @@ extern "C" {
         // abort ggml_graph_compute when true
         bool (*abort_callback)(void * data);
         void * abort_callback_data;
+
+        // split the rows of each node evenly across the threads instead of letting them claim chunks
+        bool static_split;
+
+        // record the start and end of every node on every thread when not NULL
+        struct ggml_profile * profile;
     };
 
     // next prime after GGML_MAX_NODES
@@ -579,6 +595,8 @@ extern "C" {
         GGML_TASK_FINALIZE,
     };
 
+    struct ggml_compute_state_shared;
+
     struct ggml_compute_params {
         enum ggml_task_type type;
 
@@ -588,6 +606,9 @@ extern "C" {
         // work buffer for all threads
         size_t wsize;
         void * wdata;
+
+        // state shared by the threads computing the graph, NULL when the node is computed on its own
+        struct ggml_compute_state_shared * shared;
     };
 
     // misc
@@ -934,6 +955,13 @@ extern "C" {
             struct ggml_context * ctx,
             struct ggml_tensor  * a);
 
+    // silu(a)*b, the gated linear unit of the llama feed forward
+    // a and b have the same shape
+    GGML_API struct ggml_tensor * ggml_swiglu(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b);
+
     // a - x
     // b - dy
     GGML_API struct ggml_tensor * ggml_silu_back(
@@ -962,6 +990,14 @@ extern "C" {
             struct ggml_tensor  * a,
             float                 eps);
 
+    // rms_norm(a)*b in one pass over the rows of a
+    // b is broadcast to a like in ggml_mul
+    GGML_API struct ggml_tensor * ggml_rms_norm_mul(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            float                 eps);
+
     // group normalize along ne0*ne1*n_groups
     // used in stable-diffusion
     // TODO: eps is hardcoded to 1e-6 for now
@@ -994,6 +1030,7 @@ extern "C" {
     // A: m columns, n rows,
     // B: p columns, n rows,
     // result is m columns, p rows
+    // A can be F16 and is broadcast to B in dims 2 and 3
     GGML_API struct ggml_tensor * ggml_out_prod(
             struct ggml_context * ctx,
             struct ggml_tensor  * a,
@@ -1284,6 +1321,22 @@ extern "C" {
             float                 base,
             bool                  down);
 
+    // RoPE of a (as ggml_rope_custom, mode 0 or 2) stored into the K cache view k,
+    // and b stored into the V cache view v, in one pass over the new tokens
+    // a and k have the same number of elements, b and v the same shape
+    // returns view(k)
+    GGML_API struct ggml_tensor * ggml_rope_kv(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            struct ggml_tensor  * k,
+            struct ggml_tensor  * v,
+            int                   n_past,
+            int                   n_dims,
+            int                   mode,
+            float                 freq_base,
+            float                 freq_scale);
+
     // rotary position embedding backward, i.e compute dx from dy
     // a - dy
     GGML_API struct ggml_tensor * ggml_rope_back(
@@ -1669,6 +1722,19 @@ extern "C" {
     // dump the graph into a file using the dot format
     GGML_API void ggml_graph_dump_dot(const struct ggml_cgraph * gb, const struct ggml_cgraph * gf, const char * filename);
 
+    // profiling at run time, independent of GGML_PERF
+    // set cplan.profile to record the INIT, COMPUTE and FINALIZE passes of each node on each thread,
+    // the records of all graphs computed with the profile add up until ggml_profile_reset()
+    GGML_API struct ggml_profile * ggml_profile_new  (void);
+    GGML_API void                  ggml_profile_free (struct ggml_profile * profile);
+    GGML_API void                  ggml_profile_reset(struct ggml_profile * profile);
+
+    // print the time spent per op and per tensor name
+    GGML_API void ggml_profile_print(const struct ggml_profile * profile);
+
+    // write the records in the Chrome trace event format, for chrome://tracing or ui.perfetto.dev
+    GGML_API bool ggml_profile_export_trace(const struct ggml_profile * profile, const char * fname);
+
     //
     // optimization
     //
@@ -1980,6 +2046,7 @@ extern "C" {
     GGML_API int ggml_cpu_has_avx512     (void);
     GGML_API int ggml_cpu_has_avx512_vbmi(void);
     GGML_API int ggml_cpu_has_avx512_vnni(void);
+    GGML_API int ggml_cpu_has_avx_vnni   (void);
     GGML_API int ggml_cpu_has_fma        (void);
     GGML_API int ggml_cpu_has_neon       (void);
     GGML_API int ggml_cpu_has_arm_fma    (void);
@@ -1995,6 +2062,30 @@ extern "C" {
     GGML_API int ggml_cpu_has_ssse3      (void);
     GGML_API int ggml_cpu_has_vsx        (void);
 
+    // instruction set extensions that the CPU kernels can select at run time
+    // the VNNI kernels also need GGML_CPU_FEATURE_AVX2, and AVX512_VNNI needs AVX512
+    enum ggml_cpu_feature {
+        GGML_CPU_FEATURE_AVX512_VNNI = 1 << 0,
+        GGML_CPU_FEATURE_AVX_VNNI    = 1 << 1,
+        GGML_CPU_FEATURE_AVX2        = 1 << 2, // AVX2 + FMA + F16C
+        GGML_CPU_FEATURE_AVX512      = 1 << 3, // AVX512F + AVX512BW + AVX512DQ + AVX512VL
+    };
+
+    // features of this CPU that have kernels in this build (a mask of enum ggml_cpu_feature)
+    GGML_API int ggml_cpu_features(void);
+
+    // restrict the kernels to a subset of ggml_cpu_features(), 0 selects the kernels of the
+    // build target; returns the features in use
+    // not thread safe: call it while no graph is being computed
+    // by default ggml_init() enables all of ggml_cpu_features()
+    GGML_API int ggml_cpu_set_features(int features);
+
+    // interleaves the rows of a Q4_0 or Q4_K matrix in groups of GGML_REPACK_ROWS, in place, and
+    // switches it to the matching *_R4 type, which only mul_mat supports (as src0)
+    // returns false and leaves the tensor as is if the type has no interleaved layout, the number
+    // of rows is not a multiple of GGML_REPACK_ROWS or the CPU has no faster kernels for it
+    GGML_API bool ggml_repack(struct ggml_tensor * tensor);
+
     //
     // Internal types and functions exposed for tests and benchmarks
     //
@@ -2009,6 +2100,22 @@ extern "C" {
     typedef void (*ggml_from_float_t)(const float * GGML_RESTRICT x, void  * GGML_RESTRICT y, int k);
     typedef void (*ggml_vec_dot_t)   (const int n, float * GGML_RESTRICT s, const void * GGML_RESTRICT x, const void * GGML_RESTRICT y);
 
+    // register-blocked dot products of GGML_VEC_DOT_TILE_X rows of x (bx bytes apart) with
+    // GGML_VEC_DOT_TILE_Y rows of y (by bytes apart): s[iy*bs + ix] = x[ix] . y[iy]
+    #define GGML_VEC_DOT_TILE_X 2
+    #define GGML_VEC_DOT_TILE_Y 4
+
+    typedef void (*ggml_vec_dot_tile_t)(const int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT x, size_t bx, const void * GGML_RESTRICT y, size_t by);
+
+    // dot products of the GGML_REPACK_ROWS rows interleaved in x with ny <= GGML_VEC_DOT_TILE_Y
+    // rows of y (by bytes apart), for the types made by ggml_repack(): s[iy*bs + ix] = x[ix] . y[iy]
+    #define GGML_REPACK_ROWS 4
+
+    typedef void (*ggml_vec_dot_rows_t)(const int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT x, const void * GGML_RESTRICT y, size_t by, int ny);
+
+    // y[i] += x[i]*v for the n elements of a row of x, accumulating in F32
+    typedef void (*ggml_vec_mad_t)(const int n, float * GGML_RESTRICT y, const void * GGML_RESTRICT x, const float v);
+
     typedef struct {
         const char      * type_name;
         int               blck_size;
@@ -2019,6 +2126,9 @@ extern "C" {
         ggml_from_float_t from_float_reference;
         ggml_vec_dot_t    vec_dot;
         enum ggml_type    vec_dot_type;
+        ggml_vec_dot_tile_t vec_dot_tile; // optional
+        ggml_vec_dot_rows_t vec_dot_rows; // row-interleaved types only
+        ggml_vec_mad_t      vec_mad;      // F32 and F16 only
     } ggml_type_traits_t;
 
     ggml_type_traits_t ggml_internal_get_type_traits(enum ggml_type type);
@@ -1994,6 +1994,12 @@ extern "C" {
     GGML_d925ed_API int ggml_d925ed_cpu_has_ssse3      (void);
     GGML_d925ed_API int ggml_d925ed_cpu_has_vsx        (void);
 
+    // restrict the kernels to a subset of ggml_cpu_features() of ggml.h, 0 selects the kernels of
+    // the build target; returns the features in use, of which only GGML_CPU_FEATURE_AVX2 has kernels
+    // not thread safe: call it while no graph is being computed
+    // by default ggml_d925ed_init() enables all of ggml_cpu_features()
+    GGML_d925ed_API int ggml_d925ed_cpu_set_features(int features);
+
     //
     // Internal types and functions exposed for tests and benchmarks
     //
@@ -0,0 +1,9 @@
+// AVX2 build of ggml_dadbed9.c, see ggml-cpu-variant.h
+
+#define GGML_CPU_VARIANT GGML_CPU_VARIANT_AVX2
+#include "ggml-cpu-variant.h"
+
+#if defined(GGML_CPU_VARIANT_BUILD)
+#include "ggml_dadbed9.c"
+GGML_CPU_VARIANT_END
+#endif
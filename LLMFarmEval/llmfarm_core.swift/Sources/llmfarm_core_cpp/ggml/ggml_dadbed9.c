@@ -7,6 +7,12 @@
 #include "k_quants_dadbed9.h"
 #endif
 
+#include "ggml-cpu-variant.h"
+
+#if !defined(GGML_CPU_VARIANT)
+#include "ggml.h"
+#endif
+
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #include <malloc.h> // using malloc.h with MSC/MINGW
 #elif !defined(__FreeBSD__) && !defined(__NetBSD__) && !defined(__OpenBSD__)
@@ -432,6 +438,8 @@ static inline ggml_dadbed9_fp16_t ggml_dadbed9_compute_fp32_to_fp16(float f) {
 // global data
 //
 
+// a variant build (see ggml_dadbed9-avx2.c) only has the kernels, up to the vec_dot functions
+#if !defined(GGML_CPU_VARIANT)
 // precomputed gelu table for f16 (128 KB)
 static ggml_dadbed9_fp16_t table_gelu_f16[1 << 16];
 
@@ -443,9 +451,14 @@ static ggml_dadbed9_fp16_t table_silu_f16[1 << 16];
 
 // precomputed exp table for f16 (128 KB)
 static ggml_dadbed9_fp16_t table_exp_f16[1 << 16];
+#endif
 
-// precomputed f32 table for f16 (256 KB)
-static float table_f32_f16[1 << 16];
+// precomputed f32 table for f16 (256 KB), also read by the variant builds
+#if defined(GGML_CPU_VARIANT)
+extern float ggml_dadbed9_table_f32_f16[1 << 16];
+#else
+float ggml_dadbed9_table_f32_f16[1 << 16];
+#endif
 
 #if defined(__ARM_NEON) || defined(__wasm_simd128__)
 #define B1(c,s,n)  0x ## n ## c ,  0x ## n ## s
@@ -470,7 +483,7 @@ static const uint64_t table_b2b_1[1 << 8] = { B8(10, 00) }; // (!b) << 4
 inline static float ggml_dadbed9_lookup_fp16_to_fp32(ggml_dadbed9_fp16_t f) {
     uint16_t s;
     memcpy(&s, &f, sizeof(uint16_t));
-    return table_f32_f16[s];
+    return ggml_dadbed9_table_f32_f16[s];
 }
 
 #define GGML_dadbed9_FP16_TO_FP32(x) ggml_dadbed9_lookup_fp16_to_fp32(x)
@@ -478,6 +491,7 @@ inline static float ggml_dadbed9_lookup_fp16_to_fp32(ggml_dadbed9_fp16_t f) {
 
 #endif
 
+#if !defined(GGML_CPU_VARIANT)
 // note: do not use these inside ggml.c
 // these are meant to be used via the ggml.h API
 float ggml_dadbed9_fp16_to_fp32(ggml_dadbed9_fp16_t x) {
@@ -562,6 +576,7 @@ int64_t ggml_dadbed9_cycles(void) {
 int64_t ggml_dadbed9_cycles_per_ms(void) {
     return CLOCKS_PER_SEC/1000;
 }
+#endif // !GGML_CPU_VARIANT
 
 #ifdef GGML_dadbed9_PERF
 #define ggml_dadbed9_perf_time_ms()       ggml_dadbed9_time_ms()
@@ -1642,7 +1657,12 @@ static void ggml_dadbed9_vec_dot_q5_0_q8_0(const int n, float * restrict s, cons
 static void ggml_dadbed9_vec_dot_q5_1_q8_1(const int n, float * restrict s, const void * restrict vx, const void * restrict vy);
 static void ggml_dadbed9_vec_dot_q8_0_q8_0(const int n, float * restrict s, const void * restrict vx, const void * restrict vy);
 
-static const ggml_dadbed9_type_traits_t type_traits[GGML_dadbed9_TYPE_COUNT] = {
+// the kernels of this build; a variant build exports its table for ggml_dadbed9_cpu_set_features()
+#if defined(GGML_CPU_VARIANT)
+const ggml_dadbed9_type_traits_t ggml_dadbed9_type_traits[GGML_dadbed9_TYPE_COUNT] = {
+#else
+static const ggml_dadbed9_type_traits_t ggml_dadbed9_type_traits[GGML_dadbed9_TYPE_COUNT] = {
+#endif
     [GGML_dadbed9_TYPE_I8] = {
         .type_name                = "i8",
         .blck_size                = 1,
@@ -1810,11 +1830,36 @@ static const ggml_dadbed9_type_traits_t type_traits[GGML_dadbed9_TYPE_COUNT] = {
 #endif
 };
 
+#if !defined(GGML_CPU_VARIANT)
+#if defined(GGML_CPU_VARIANTS)
+extern const ggml_dadbed9_type_traits_t ggml_dadbed9_type_traits_avx2[GGML_dadbed9_TYPE_COUNT];
+#endif
+
+// the table of the build for the CPU, see ggml_dadbed9_cpu_set_features()
+static const ggml_dadbed9_type_traits_t * type_traits = ggml_dadbed9_type_traits;
+
+static int ggml_dadbed9_cpu_features_enabled = -1;
+
+int ggml_dadbed9_cpu_set_features(int features) {
+    features &= ggml_cpu_features();
+
+    // only AVX2 has a build, see ggml_dadbed9-avx2.c
+    features &= GGML_CPU_FEATURE_AVX2;
+
+#if defined(GGML_CPU_VARIANTS)
+    type_traits = features ? ggml_dadbed9_type_traits_avx2 : ggml_dadbed9_type_traits;
+#endif
+    ggml_dadbed9_cpu_features_enabled = features;
+
+    return features;
+}
+
 // For internal test use
 ggml_dadbed9_type_traits_t ggml_dadbed9_internal_get_type_traits(enum ggml_dadbed9_type type) {
     GGML_dadbed9_ASSERT(type < GGML_dadbed9_TYPE_COUNT);
     return type_traits[type];
 }
+#endif
 
 
 //
@@ -3426,6 +3471,7 @@ static void ggml_dadbed9_vec_dot_q8_0_q8_0(const int n, float * restrict s, cons
 #endif
 }
 
+#if !defined(GGML_CPU_VARIANT)
 // compute GGML_dadbed9_VEC_DOT_UNROLL dot products at once
 // xs - x row stride in bytes
 inline static void ggml_dadbed9_vec_dot_f16_unroll(const int n, const int xs, float * restrict s, void * restrict xv, ggml_dadbed9_fp16_t * restrict y) {
@@ -4299,7 +4345,7 @@ struct ggml_dadbed9_context * ggml_dadbed9_init(struct ggml_dadbed9_init_params
             for (int i = 0; i < (1 << 16); ++i) {
                 uint16_t ui = i;
                 memcpy(&ii, &ui, sizeof(ii));
-                const float f = table_f32_f16[i] = GGML_dadbed9_COMPUTE_FP16_TO_FP32(ii);
+                const float f = ggml_dadbed9_table_f32_f16[i] = GGML_dadbed9_COMPUTE_FP16_TO_FP32(ii);
                 table_gelu_f16[i] = GGML_dadbed9_FP32_TO_FP16(ggml_dadbed9_gelu_f32(f));
                 table_gelu_quick_f16[i] = GGML_dadbed9_FP32_TO_FP16(ggml_dadbed9_gelu_quick_f32(f));
                 table_silu_f16[i] = GGML_dadbed9_FP32_TO_FP16(ggml_dadbed9_silu_f32(f));
@@ -4340,6 +4386,10 @@ struct ggml_dadbed9_context * ggml_dadbed9_init(struct ggml_dadbed9_init_params
 
         ggml_dadbed9_setup_op_has_task_pass();
 
+        if (ggml_dadbed9_cpu_features_enabled < 0) {
+            ggml_dadbed9_cpu_set_features(ggml_cpu_features());
+        }
+
         is_first_call = false;
     }
 
@@ -18554,7 +18604,7 @@ int ggml_dadbed9_cpu_has_avx2(void) {
 #if defined(__AVX2__)
     return 1;
 #else
-    return 0;
+    return ggml_dadbed9_cpu_features_enabled > 0;
 #endif
 }
 
@@ -18586,7 +18636,7 @@ int ggml_dadbed9_cpu_has_fma(void) {
 #if defined(__FMA__)
     return 1;
 #else
-    return 0;
+    return ggml_dadbed9_cpu_features_enabled > 0;
 #endif
 }
 
@@ -18675,3 +18725,5 @@ int ggml_dadbed9_cpu_has_vsx(void) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+
+#endif // !GGML_CPU_VARIANT
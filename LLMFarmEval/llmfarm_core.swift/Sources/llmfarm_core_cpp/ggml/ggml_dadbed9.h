@@ -1737,6 +1737,12 @@ extern "C" {
     GGML_dadbed9_API int ggml_dadbed9_cpu_has_sse3       (void);
     GGML_dadbed9_API int ggml_dadbed9_cpu_has_vsx        (void);
 
+    // restrict the kernels to a subset of ggml_cpu_features() of ggml.h, 0 selects the kernels of
+    // the build target; returns the features in use, of which only GGML_CPU_FEATURE_AVX2 has kernels
+    // not thread safe: call it while no graph is being computed
+    // by default ggml_dadbed9_init() enables all of ggml_cpu_features()
+    GGML_dadbed9_API int ggml_dadbed9_cpu_set_features(int features);
+
     //
     // Internal types and functions exposed for tests and benchmarks
     //
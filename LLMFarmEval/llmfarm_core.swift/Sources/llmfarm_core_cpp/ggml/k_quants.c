@@ -1,5 +1,6 @@
 #include "k_quants.h"
 #include "ggml.h"
+#include "ggml-vnni.h"
 
 #include <math.h>
 #include <string.h>
@@ -2676,6 +2677,71 @@ void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restri
 
     *s = sumf;
 
+#elif defined(GGML_VNNI)
+
+    // maddubs for the products of the quants, vpdpwssd folds the multiplication with the
+    // sub-block scales into the accumulation; same int32 sums as the AVX2 kernel
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+
+    __m256 acc = _mm256_setzero_ps();
+    __m128 acc_m = _mm_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * ggml_fp16_to_fp32(x[i].d);
+        const float dmin = -y[i].d * ggml_fp16_to_fp32(x[i].dmin);
+
+        memcpy(utmp, x[i].scales, 12);
+        utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+        const uint32_t uaux = utmp[1] & kmask1;
+        utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+        utmp[2] = uaux;
+        utmp[0] &= kmask1;
+
+        const uint8_t * restrict q4 = x[i].qs;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const __m256i mins_and_scales = _mm256_cvtepu8_epi16(_mm_set_epi32(utmp[3], utmp[2], utmp[1], utmp[0]));
+
+        const __m256i q8sums = _mm256_loadu_si256((const __m256i*)y[i].bsums);
+        const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+        const __m128i prod = _mm_madd_epi16(_mm256_extracti128_si256(mins_and_scales, 1), q8s);
+        acc_m = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(prod), acc_m);
+
+        const __m128i sc128  = _mm256_extracti128_si256(mins_and_scales, 0);
+        const __m256i scales = MM256_SET_M128I(sc128, sc128);
+
+        // two chains, vpdpwssd has a latency of several cycles
+        __m256i sumi_l = _mm256_setzero_si256();
+        __m256i sumi_h = _mm256_setzero_si256();
+
+        for (int j = 0; j < QK_K/64; ++j) {
+
+            const __m256i scale_l = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+0));
+            const __m256i scale_h = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+1));
+
+            const __m256i q4bits = _mm256_loadu_si256((const __m256i*)q4); q4 += 32;
+            const __m256i q4l = _mm256_and_si256(q4bits, m4);
+            const __m256i q4h = _mm256_and_si256(_mm256_srli_epi16(q4bits, 4), m4);
+
+            const __m256i q8l = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+            sumi_l = GGML_VNNI_DPWSSD(sumi_l, scale_l, _mm256_maddubs_epi16(q4l, q8l));
+
+            const __m256i q8h = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+            sumi_h = GGML_VNNI_DPWSSD(sumi_h, scale_h, _mm256_maddubs_epi16(q4h, q8h));
+        }
+
+        const __m256i sumi = _mm256_add_epi32(sumi_l, sumi_h);
+
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc);
+    }
+
+    acc_m = _mm_add_ps(acc_m, _mm_movehl_ps(acc_m, acc_m));
+    acc_m = _mm_add_ss(acc_m, _mm_movehdup_ps(acc_m));
+
+    *s = hsum_float_8(acc) + _mm_cvtss_f32(acc_m);
+
 #elif defined __AVX2__
 
     const __m256i m4 = _mm256_set1_epi8(0xF);
@@ -2882,6 +2948,223 @@ void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restri
     *s = sumf;
 #endif
 }
+
+// x is decoded once per super-block and reused for GGML_VEC_DOT_TILE_Y rows of y
+void ggml_vec_dot_tile_q4_K_q8_K(const int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by) {
+    assert(n % QK_K == 0);
+
+#if defined(__ARM_NEON) || defined(__AVX2__)
+
+    const int nb = n / QK_K;
+
+    static const uint32_t kmask1 = 0x3f3f3f3f;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+    static const uint32_t kmask3 = 0x03030303;
+
+    uint32_t utmp[4];
+
+    const block_q8_K * restrict y[GGML_VEC_DOT_TILE_Y];
+
+    for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+        y[iy] = (const block_q8_K *) ((const char *) vy + iy*by);
+    }
+
+#endif
+
+#ifdef __ARM_NEON
+
+    const uint8x16_t m4b = vdupq_n_u8(0xf);
+#ifdef __ARM_FEATURE_DOTPROD
+    const int32x4_t mzero = vdupq_n_s32(0);
+#endif
+
+    for (int ix = 0; ix < GGML_VEC_DOT_TILE_X; ++ix) {
+        const block_q4_K * restrict x = (const block_q4_K *) ((const char *) vx + ix*bx);
+
+        float sumf[GGML_VEC_DOT_TILE_Y] = { 0 };
+
+        for (int i = 0; i < nb; ++i) {
+
+            const float xd    = ggml_fp16_to_fp32(x[i].d);
+            const float xdmin = ggml_fp16_to_fp32(x[i].dmin);
+
+            memcpy(utmp, x[i].scales, 12);
+
+            uint32x2_t mins8 = { 0 };
+            mins8 = vset_lane_u32(utmp[1] & kmask1, mins8, 0);
+            mins8 = vset_lane_u32(((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4), mins8, 1);
+
+            utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+            utmp[0] &= kmask1;
+
+            const int16x8_t mins = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(mins8)));
+
+            const uint8_t * scales = (const uint8_t *)utmp;
+
+            int8x16x2_t q4l[QK_K/64];
+            int8x16x2_t q4h[QK_K/64];
+
+            for (int j = 0; j < QK_K/64; ++j) {
+                const uint8x16x2_t q4bits = vld1q_u8_x2(x[i].qs + 32*j);
+
+                q4l[j].val[0] = vreinterpretq_s8_u8(vandq_u8  (q4bits.val[0], m4b));
+                q4l[j].val[1] = vreinterpretq_s8_u8(vandq_u8  (q4bits.val[1], m4b));
+                q4h[j].val[0] = vreinterpretq_s8_u8(vshrq_n_u8(q4bits.val[0], 4));
+                q4h[j].val[1] = vreinterpretq_s8_u8(vshrq_n_u8(q4bits.val[1], 4));
+            }
+
+            for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+
+                const float d    = y[iy][i].d * xd;
+                const float dmin = y[iy][i].d * xdmin;
+
+                const int16x8_t q8sums = vpaddq_s16(vld1q_s16(y[iy][i].bsums), vld1q_s16(y[iy][i].bsums + 8));
+                const int32x4_t prod = vaddq_s32(vmull_s16(vget_low_s16 (q8sums), vget_low_s16 (mins)),
+                                                 vmull_s16(vget_high_s16(q8sums), vget_high_s16(mins)));
+                sumf[iy] -= dmin * vaddvq_s32(prod);
+
+                const int8_t * restrict q8 = y[iy][i].qs;
+
+                int32_t sumi1 = 0;
+                int32_t sumi2 = 0;
+
+                for (int j = 0; j < QK_K/64; ++j) {
+
+#ifdef __ARM_FEATURE_DOTPROD
+                    int8x16x2_t q8bytes = vld1q_s8_x2(q8); q8 += 32;
+
+                    const int32x4_t p1 = vdotq_s32(vdotq_s32(mzero, q4l[j].val[0], q8bytes.val[0]), q4l[j].val[1], q8bytes.val[1]);
+                    sumi1 += vaddvq_s32(p1) * scales[2*j+0];
+
+                    q8bytes = vld1q_s8_x2(q8); q8 += 32;
+
+                    const int32x4_t p2 = vdotq_s32(vdotq_s32(mzero, q4h[j].val[0], q8bytes.val[0]), q4h[j].val[1], q8bytes.val[1]);
+                    sumi2 += vaddvq_s32(p2) * scales[2*j+1];
+#else
+                    int8x16x2_t q8bytes = vld1q_s8_x2(q8); q8 += 32;
+
+                    const int16x8_t p0 = vaddq_s16(vmull_s8(vget_low_s8 (q4l[j].val[0]), vget_low_s8 (q8bytes.val[0])),
+                                                   vmull_s8(vget_high_s8(q4l[j].val[0]), vget_high_s8(q8bytes.val[0])));
+                    const int16x8_t p1 = vaddq_s16(vmull_s8(vget_low_s8 (q4l[j].val[1]), vget_low_s8 (q8bytes.val[1])),
+                                                   vmull_s8(vget_high_s8(q4l[j].val[1]), vget_high_s8(q8bytes.val[1])));
+                    sumi1 += vaddvq_s16(vaddq_s16(p0, p1)) * scales[2*j+0];
+
+                    q8bytes = vld1q_s8_x2(q8); q8 += 32;
+
+                    const int16x8_t p2 = vaddq_s16(vmull_s8(vget_low_s8 (q4h[j].val[0]), vget_low_s8 (q8bytes.val[0])),
+                                                   vmull_s8(vget_high_s8(q4h[j].val[0]), vget_high_s8(q8bytes.val[0])));
+                    const int16x8_t p3 = vaddq_s16(vmull_s8(vget_low_s8 (q4h[j].val[1]), vget_low_s8 (q8bytes.val[1])),
+                                                   vmull_s8(vget_high_s8(q4h[j].val[1]), vget_high_s8(q8bytes.val[1])));
+                    sumi2 += vaddvq_s16(vaddq_s16(p2, p3)) * scales[2*j+1];
+#endif
+                }
+
+                sumf[iy] += d * (sumi1 + sumi2);
+            }
+        }
+
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            s[iy*bs + ix] = sumf[iy];
+        }
+    }
+
+#elif defined __AVX2__
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+
+    for (int ix = 0; ix < GGML_VEC_DOT_TILE_X; ++ix) {
+        const block_q4_K * restrict x = (const block_q4_K *) ((const char *) vx + ix*bx);
+
+        __m256 acc  [GGML_VEC_DOT_TILE_Y];
+        __m128 acc_m[GGML_VEC_DOT_TILE_Y];
+
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            acc  [iy] = _mm256_setzero_ps();
+            acc_m[iy] = _mm_setzero_ps();
+        }
+
+        for (int i = 0; i < nb; ++i) {
+
+            const float xd    = ggml_fp16_to_fp32(x[i].d);
+            const float xdmin = ggml_fp16_to_fp32(x[i].dmin);
+
+            memcpy(utmp, x[i].scales, 12);
+            utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+            const uint32_t uaux = utmp[1] & kmask1;
+            utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+            utmp[2] = uaux;
+            utmp[0] &= kmask1;
+
+            const __m256i mins_and_scales = _mm256_cvtepu8_epi16(_mm_set_epi32(utmp[3], utmp[2], utmp[1], utmp[0]));
+
+            const __m128i mins   = _mm256_extracti128_si256(mins_and_scales, 1);
+            const __m128i sc128  = _mm256_extracti128_si256(mins_and_scales, 0);
+            const __m256i scales = MM256_SET_M128I(sc128, sc128);
+
+            __m256i q4l[QK_K/64];
+            __m256i q4h[QK_K/64];
+
+            for (int j = 0; j < QK_K/64; ++j) {
+                const __m256i q4bits = _mm256_loadu_si256((const __m256i*)(x[i].qs + 32*j));
+                q4l[j] = _mm256_and_si256(q4bits, m4);
+                q4h[j] = _mm256_and_si256(_mm256_srli_epi16(q4bits, 4), m4);
+            }
+
+            for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+
+                const float d    =  y[iy][i].d * xd;
+                const float dmin = -y[iy][i].d * xdmin;
+
+                const int8_t * restrict q8 = y[iy][i].qs;
+
+                const __m256i q8sums = _mm256_loadu_si256((const __m256i*)y[iy][i].bsums);
+                const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+                const __m128i prod = _mm_madd_epi16(mins, q8s);
+                acc_m[iy] = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(prod), acc_m[iy]);
+
+                __m256i sumi = _mm256_setzero_si256();
+
+                for (int j = 0; j < QK_K/64; ++j) {
+
+                    const __m256i scale_l = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+0));
+                    const __m256i scale_h = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+1));
+
+                    const __m256i q8l = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+                    __m256i p16l = _mm256_maddubs_epi16(q4l[j], q8l);
+                    p16l = _mm256_madd_epi16(scale_l, p16l);
+
+                    const __m256i q8h = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+                    __m256i p16h = _mm256_maddubs_epi16(q4h[j], q8h);
+                    p16h = _mm256_madd_epi16(scale_h, p16h);
+                    const __m256i sumj = _mm256_add_epi32(p16l, p16h);
+
+                    sumi = _mm256_add_epi32(sumi, sumj);
+                }
+
+                acc[iy] = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc[iy]);
+            }
+        }
+
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            __m128 acc_mi = acc_m[iy];
+            acc_mi = _mm_add_ps(acc_mi, _mm_movehl_ps(acc_mi, acc_mi));
+            acc_mi = _mm_add_ss(acc_mi, _mm_movehdup_ps(acc_mi));
+
+            s[iy*bs + ix] = hsum_float_8(acc[iy]) + _mm_cvtss_f32(acc_mi);
+        }
+    }
+
+#else
+
+    // no register-blocked kernel for this target, use the row kernel
+    for (int ix = 0; ix < GGML_VEC_DOT_TILE_X; ++ix) {
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            ggml_vec_dot_q4_K_q8_K(n, &s[iy*bs + ix], (const char *) vx + ix*bx, (const char *) vy + iy*by);
+        }
+    }
+
+#endif
+}
 #else
 void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
@@ -3209,6 +3492,84 @@ void ggml_vec_dot_q5_K_q8_K(const int n, float * restrict s, const void * restri
 
     *s = sumf;
 
+#elif defined(GGML_VNNI)
+
+    // maddubs for the products of the quants, vpdpwssd folds the multiplication with the
+    // sub-block scales into the accumulation; same int32 sums as the AVX2 kernel
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+    const __m128i mzero = _mm_setzero_si128();
+    const __m256i mone  = _mm256_set1_epi8(1);
+
+    __m256 acc = _mm256_setzero_ps();
+
+    float summs = 0.f;
+
+    for (int i = 0; i < nb; ++i) {
+
+        const uint8_t * restrict q5 = x[i].qs;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const float d = y[i].d * ggml_fp16_to_fp32(x[i].d);
+        const float dmin = -y[i].d * ggml_fp16_to_fp32(x[i].dmin);
+
+        memcpy(utmp, x[i].scales, 12);
+        utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+        const uint32_t uaux = utmp[1] & kmask1;
+        utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+        utmp[2] = uaux;
+        utmp[0] &= kmask1;
+
+        const __m256i mins_and_scales = _mm256_cvtepu8_epi16(_mm_set_epi32(utmp[3], utmp[2], utmp[1], utmp[0]));
+
+        const __m256i q8sums = _mm256_loadu_si256((const __m256i*)y[i].bsums);
+        const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+        const __m128i prod = _mm_madd_epi16(_mm256_extracti128_si256(mins_and_scales, 1), q8s);
+        const __m128i hsum = _mm_hadd_epi32(_mm_hadd_epi32(prod, mzero), mzero);
+        summs += dmin * _mm_extract_epi32(hsum, 0);
+
+        const __m128i sc128  = _mm256_extracti128_si256(mins_and_scales, 0);
+        const __m256i scales = MM256_SET_M128I(sc128, sc128);
+
+        const __m256i hbits = _mm256_loadu_si256((const __m256i*)x[i].qh);
+        __m256i hmask = mone;
+
+        __m256i sumi_0 = _mm256_setzero_si256();
+        __m256i sumi_1 = _mm256_setzero_si256();
+
+        int bit = 0;
+
+        for (int j = 0; j < QK_K/64; ++j) {
+
+            const __m256i scale_0 = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+0));
+            const __m256i scale_1 = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+1));
+
+            const __m256i q5bits = _mm256_loadu_si256((const __m256i*)q5); q5 += 32;
+
+            const __m256i q5l_0 = _mm256_and_si256(q5bits, m4);
+            const __m256i q5h_0 = _mm256_slli_epi16(_mm256_srli_epi16(_mm256_and_si256(hbits, hmask), bit++), 4);
+            const __m256i q5_0  = _mm256_add_epi8(q5l_0, q5h_0);
+            hmask = _mm256_slli_epi16(hmask, 1);
+
+            const __m256i q5l_1 = _mm256_and_si256(_mm256_srli_epi16(q5bits, 4), m4);
+            const __m256i q5h_1 = _mm256_slli_epi16(_mm256_srli_epi16(_mm256_and_si256(hbits, hmask), bit++), 4);
+            const __m256i q5_1  = _mm256_add_epi8(q5l_1, q5h_1);
+            hmask = _mm256_slli_epi16(hmask, 1);
+
+            const __m256i q8_0 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+            const __m256i q8_1 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+
+            sumi_0 = GGML_VNNI_DPWSSD(sumi_0, scale_0, _mm256_maddubs_epi16(q5_0, q8_0));
+            sumi_1 = GGML_VNNI_DPWSSD(sumi_1, scale_1, _mm256_maddubs_epi16(q5_1, q8_1));
+        }
+
+        const __m256i sumi = _mm256_add_epi32(sumi_0, sumi_1);
+
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc);
+    }
+
+    *s = hsum_float_8(acc) + summs;
+
 #elif defined __AVX2__
 
     const __m256i m4 = _mm256_set1_epi8(0xF);
@@ -3826,6 +4187,78 @@ void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restri
     }
     *s = sum;
 
+#elif defined(GGML_VNNI)
+
+    // maddubs for the products of the quants, vpdpwssd folds the multiplication with the
+    // sub-block scales into the accumulation; same int32 sums as the AVX2 kernel
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+    const __m256i m2 = _mm256_set1_epi8(3);
+    const __m256i m32s = _mm256_set1_epi8(32);
+
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * ggml_fp16_to_fp32(x[i].d);
+
+        const uint8_t * restrict q4 = x[i].ql;
+        const uint8_t * restrict qh = x[i].qh;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const __m128i scales = _mm_loadu_si128((const __m128i*)x[i].scales);
+
+        __m256i sumi_0 = _mm256_setzero_si256();
+        __m256i sumi_1 = _mm256_setzero_si256();
+
+        int is = 0;
+
+        for (int j = 0; j < QK_K/128; ++j) {
+
+            const __m128i scale_0 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 0));
+            const __m128i scale_1 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 1));
+            const __m128i scale_2 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 2));
+            const __m128i scale_3 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 3));
+            is += 4;
+
+            const __m256i q4bits1 = _mm256_loadu_si256((const __m256i*)q4); q4 += 32;
+            const __m256i q4bits2 = _mm256_loadu_si256((const __m256i*)q4); q4 += 32;
+            const __m256i q4bitsH = _mm256_loadu_si256((const __m256i*)qh); qh += 32;
+
+            const __m256i q4h_0 = _mm256_slli_epi16(_mm256_and_si256(q4bitsH, m2), 4);
+            const __m256i q4h_1 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 2), m2), 4);
+            const __m256i q4h_2 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 4), m2), 4);
+            const __m256i q4h_3 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 6), m2), 4);
+
+            const __m256i q4_0 = _mm256_or_si256(_mm256_and_si256(q4bits1, m4), q4h_0);
+            const __m256i q4_1 = _mm256_or_si256(_mm256_and_si256(q4bits2, m4), q4h_1);
+            const __m256i q4_2 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits1, 4), m4), q4h_2);
+            const __m256i q4_3 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits2, 4), m4), q4h_3);
+
+            const __m256i q8_0 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+            const __m256i q8_1 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+            const __m256i q8_2 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+            const __m256i q8_3 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+
+            // (q6 - 32) . q8 in 16 bits, as in the AVX2 kernel
+            const __m256i p16_0 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_0, q8_0), _mm256_maddubs_epi16(m32s, q8_0));
+            const __m256i p16_1 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_1, q8_1), _mm256_maddubs_epi16(m32s, q8_1));
+            const __m256i p16_2 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_2, q8_2), _mm256_maddubs_epi16(m32s, q8_2));
+            const __m256i p16_3 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_3, q8_3), _mm256_maddubs_epi16(m32s, q8_3));
+
+            sumi_0 = GGML_VNNI_DPWSSD(sumi_0, _mm256_cvtepi8_epi16(scale_0), p16_0);
+            sumi_1 = GGML_VNNI_DPWSSD(sumi_1, _mm256_cvtepi8_epi16(scale_1), p16_1);
+            sumi_0 = GGML_VNNI_DPWSSD(sumi_0, _mm256_cvtepi8_epi16(scale_2), p16_2);
+            sumi_1 = GGML_VNNI_DPWSSD(sumi_1, _mm256_cvtepi8_epi16(scale_3), p16_3);
+        }
+
+        const __m256i sumi = _mm256_add_epi32(sumi_0, sumi_1);
+
+        acc = _mm256_fmadd_ps(_mm256_broadcast_ss(&d), _mm256_cvtepi32_ps(sumi), acc);
+    }
+
+    *s = hsum_float_8(acc);
+
 #elif defined __AVX2__
 
     const __m256i m4 = _mm256_set1_epi8(0xF);
@@ -4068,6 +4501,234 @@ void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restri
 #endif
 }
 
+// x is decoded once per super-block and reused for GGML_VEC_DOT_TILE_Y rows of y
+void ggml_vec_dot_tile_q6_K_q8_K(const int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by) {
+    assert(n % QK_K == 0);
+
+#if defined(__ARM_NEON) || defined(__AVX2__)
+
+    const int nb = n / QK_K;
+
+    const block_q8_K * restrict y[GGML_VEC_DOT_TILE_Y];
+
+    for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+        y[iy] = (const block_q8_K *) ((const char *) vy + iy*by);
+    }
+
+#endif
+
+#ifdef __ARM_NEON
+
+    const uint8x16_t m4b = vdupq_n_u8(0xF);
+#if defined(__ARM_FEATURE_DOTPROD)
+    const int32x4_t  vzero = vdupq_n_s32(0);
+#endif
+
+    const uint8x16_t mone = vdupq_n_u8(3);
+
+    for (int ix = 0; ix < GGML_VEC_DOT_TILE_X; ++ix) {
+        const block_q6_K * restrict x = (const block_q6_K *) ((const char *) vx + ix*bx);
+
+        float sum[GGML_VEC_DOT_TILE_Y] = { 0 };
+
+        for (int i = 0; i < nb; ++i) {
+
+            const float d_all = ggml_fp16_to_fp32(x[i].d);
+
+            const int8x16_t scales = vld1q_s8(x[i].scales);
+            const int16x8x2_t q6scales = {vmovl_s8(vget_low_s8(scales)), vmovl_s8(vget_high_s8(scales))};
+
+            // 6-bit values of the super-block, in the order they meet the q8 bytes
+            int8x16x4_t q6bytes[2*(QK_K/128)];
+
+            for (int j = 0; j < QK_K/128; ++j) {
+
+                const uint8x16x2_t qhbits = vld1q_u8_x2(x[i].qh + 32*j);
+                const uint8x16x4_t q6bits = vld1q_u8_x4(x[i].ql + 64*j);
+
+                uint8x16x4_t q6h;
+
+                q6h.val[0] = vshlq_n_u8(vandq_u8(mone, qhbits.val[0]), 4);
+                q6h.val[1] = vshlq_n_u8(vandq_u8(mone, qhbits.val[1]), 4);
+                q6h.val[2] = vshlq_n_u8(vandq_u8(mone, vshrq_n_u8(qhbits.val[0], 2)), 4);
+                q6h.val[3] = vshlq_n_u8(vandq_u8(mone, vshrq_n_u8(qhbits.val[1], 2)), 4);
+
+                q6bytes[2*j+0].val[0] = vreinterpretq_s8_u8(vorrq_u8(vandq_u8(q6bits.val[0], m4b), q6h.val[0]));
+                q6bytes[2*j+0].val[1] = vreinterpretq_s8_u8(vorrq_u8(vandq_u8(q6bits.val[1], m4b), q6h.val[1]));
+                q6bytes[2*j+0].val[2] = vreinterpretq_s8_u8(vorrq_u8(vandq_u8(q6bits.val[2], m4b), q6h.val[2]));
+                q6bytes[2*j+0].val[3] = vreinterpretq_s8_u8(vorrq_u8(vandq_u8(q6bits.val[3], m4b), q6h.val[3]));
+
+                q6h.val[0] = vshlq_n_u8(vandq_u8(mone, vshrq_n_u8(qhbits.val[0], 4)), 4);
+                q6h.val[1] = vshlq_n_u8(vandq_u8(mone, vshrq_n_u8(qhbits.val[1], 4)), 4);
+                q6h.val[2] = vshlq_n_u8(vandq_u8(mone, vshrq_n_u8(qhbits.val[0], 6)), 4);
+                q6h.val[3] = vshlq_n_u8(vandq_u8(mone, vshrq_n_u8(qhbits.val[1], 6)), 4);
+
+                q6bytes[2*j+1].val[0] = vreinterpretq_s8_u8(vorrq_u8(vshrq_n_u8(q6bits.val[0], 4), q6h.val[0]));
+                q6bytes[2*j+1].val[1] = vreinterpretq_s8_u8(vorrq_u8(vshrq_n_u8(q6bits.val[1], 4), q6h.val[1]));
+                q6bytes[2*j+1].val[2] = vreinterpretq_s8_u8(vorrq_u8(vshrq_n_u8(q6bits.val[2], 4), q6h.val[2]));
+                q6bytes[2*j+1].val[3] = vreinterpretq_s8_u8(vorrq_u8(vshrq_n_u8(q6bits.val[3], 4), q6h.val[3]));
+            }
+
+            for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+
+                const int8_t * restrict q8    = y[iy][i].qs;
+                const int8_t * restrict scale = x[i].scales;
+
+                const int16x8x2_t q8sums = vld1q_s16_x2(y[iy][i].bsums);
+
+                const int32x4_t prod = vaddq_s32(vaddq_s32(vmull_s16(vget_low_s16 (q8sums.val[0]), vget_low_s16 (q6scales.val[0])),
+                                                           vmull_s16(vget_high_s16(q8sums.val[0]), vget_high_s16(q6scales.val[0]))),
+                                                 vaddq_s32(vmull_s16(vget_low_s16 (q8sums.val[1]), vget_low_s16 (q6scales.val[1])),
+                                                           vmull_s16(vget_high_s16(q8sums.val[1]), vget_high_s16(q6scales.val[1]))));
+                const int32_t isum_mins = vaddvq_s32(prod);
+
+                int32_t isum = 0;
+
+                for (int k = 0; k < 2*(QK_K/128); ++k) {
+
+                    const int8x16x4_t q8bytes = vld1q_s8_x4(q8); q8 += 64;
+                    const int8x16x4_t q6b     = q6bytes[k];
+
+#if defined(__ARM_FEATURE_DOTPROD)
+                    isum += vaddvq_s32(vdotq_s32(vzero, q6b.val[0], q8bytes.val[0])) * scale[0] +
+                            vaddvq_s32(vdotq_s32(vzero, q6b.val[1], q8bytes.val[1])) * scale[1] +
+                            vaddvq_s32(vdotq_s32(vzero, q6b.val[2], q8bytes.val[2])) * scale[2] +
+                            vaddvq_s32(vdotq_s32(vzero, q6b.val[3], q8bytes.val[3])) * scale[3];
+                    scale += 4;
+#else
+                    const int16x8_t p0 = vaddq_s16(vmull_s8(vget_low_s8 (q6b.val[0]), vget_low_s8 (q8bytes.val[0])),
+                                                   vmull_s8(vget_high_s8(q6b.val[0]), vget_high_s8(q8bytes.val[0])));
+                    const int16x8_t p1 = vaddq_s16(vmull_s8(vget_low_s8 (q6b.val[1]), vget_low_s8 (q8bytes.val[1])),
+                                                   vmull_s8(vget_high_s8(q6b.val[1]), vget_high_s8(q8bytes.val[1])));
+                    isum += vaddvq_s16(p0) * scale[0] + vaddvq_s16(p1) * scale[1];
+                    scale += 2;
+
+                    const int16x8_t p2 = vaddq_s16(vmull_s8(vget_low_s8 (q6b.val[2]), vget_low_s8 (q8bytes.val[2])),
+                                                   vmull_s8(vget_high_s8(q6b.val[2]), vget_high_s8(q8bytes.val[2])));
+                    const int16x8_t p3 = vaddq_s16(vmull_s8(vget_low_s8 (q6b.val[3]), vget_low_s8 (q8bytes.val[3])),
+                                                   vmull_s8(vget_high_s8(q6b.val[3]), vget_high_s8(q8bytes.val[3])));
+                    isum += vaddvq_s16(p2) * scale[0] + vaddvq_s16(p3) * scale[1];
+                    scale += 2;
+#endif
+                }
+
+                sum[iy] += d_all * y[iy][i].d * (isum - 32 * isum_mins);
+            }
+        }
+
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            s[iy*bs + ix] = sum[iy];
+        }
+    }
+
+#elif defined __AVX2__
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+    const __m256i m2 = _mm256_set1_epi8(3);
+    const __m256i m32s = _mm256_set1_epi8(32);
+
+    for (int ix = 0; ix < GGML_VEC_DOT_TILE_X; ++ix) {
+        const block_q6_K * restrict x = (const block_q6_K *) ((const char *) vx + ix*bx);
+
+        __m256 acc[GGML_VEC_DOT_TILE_Y];
+
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            acc[iy] = _mm256_setzero_ps();
+        }
+
+        for (int i = 0; i < nb; ++i) {
+
+            const float xd = ggml_fp16_to_fp32(x[i].d);
+
+            const __m128i scales = _mm_loadu_si128((const __m128i*)x[i].scales);
+
+            // 6-bit values of the super-block, 4 vectors per 128 quants
+            __m256i q6[QK_K/32];
+
+            for (int j = 0; j < QK_K/128; ++j) {
+                const __m256i q4bits1 = _mm256_loadu_si256((const __m256i*)(x[i].ql + 64*j));
+                const __m256i q4bits2 = _mm256_loadu_si256((const __m256i*)(x[i].ql + 64*j + 32));
+                const __m256i q4bitsH = _mm256_loadu_si256((const __m256i*)(x[i].qh + 32*j));
+
+                const __m256i q4h_0 = _mm256_slli_epi16(_mm256_and_si256(q4bitsH, m2), 4);
+                const __m256i q4h_1 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 2), m2), 4);
+                const __m256i q4h_2 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 4), m2), 4);
+                const __m256i q4h_3 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 6), m2), 4);
+
+                q6[4*j+0] = _mm256_or_si256(_mm256_and_si256(q4bits1, m4), q4h_0);
+                q6[4*j+1] = _mm256_or_si256(_mm256_and_si256(q4bits2, m4), q4h_1);
+                q6[4*j+2] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits1, 4), m4), q4h_2);
+                q6[4*j+3] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits2, 4), m4), q4h_3);
+            }
+
+            for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+
+                const float d = y[iy][i].d * xd;
+
+                const int8_t * restrict q8 = y[iy][i].qs;
+
+                __m256i sumi = _mm256_setzero_si256();
+
+                int is = 0;
+
+                for (int j = 0; j < QK_K/128; ++j) {
+
+                    const __m128i scale_0 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 0));
+                    const __m128i scale_1 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 1));
+                    const __m128i scale_2 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 2));
+                    const __m128i scale_3 = _mm_shuffle_epi8(scales, get_scale_shuffle(is + 3));
+                    is += 4;
+
+                    const __m256i q8_0 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+                    const __m256i q8_1 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+                    const __m256i q8_2 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+                    const __m256i q8_3 = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+
+                    __m256i q8s_0 = _mm256_maddubs_epi16(m32s, q8_0);
+                    __m256i q8s_1 = _mm256_maddubs_epi16(m32s, q8_1);
+                    __m256i q8s_2 = _mm256_maddubs_epi16(m32s, q8_2);
+                    __m256i q8s_3 = _mm256_maddubs_epi16(m32s, q8_3);
+
+                    __m256i p16_0 = _mm256_maddubs_epi16(q6[4*j+0], q8_0);
+                    __m256i p16_1 = _mm256_maddubs_epi16(q6[4*j+1], q8_1);
+                    __m256i p16_2 = _mm256_maddubs_epi16(q6[4*j+2], q8_2);
+                    __m256i p16_3 = _mm256_maddubs_epi16(q6[4*j+3], q8_3);
+
+                    p16_0 = _mm256_sub_epi16(p16_0, q8s_0);
+                    p16_1 = _mm256_sub_epi16(p16_1, q8s_1);
+                    p16_2 = _mm256_sub_epi16(p16_2, q8s_2);
+                    p16_3 = _mm256_sub_epi16(p16_3, q8s_3);
+
+                    p16_0 = _mm256_madd_epi16(_mm256_cvtepi8_epi16(scale_0), p16_0);
+                    p16_1 = _mm256_madd_epi16(_mm256_cvtepi8_epi16(scale_1), p16_1);
+                    p16_2 = _mm256_madd_epi16(_mm256_cvtepi8_epi16(scale_2), p16_2);
+                    p16_3 = _mm256_madd_epi16(_mm256_cvtepi8_epi16(scale_3), p16_3);
+
+                    sumi = _mm256_add_epi32(sumi, _mm256_add_epi32(p16_0, p16_1));
+                    sumi = _mm256_add_epi32(sumi, _mm256_add_epi32(p16_2, p16_3));
+                }
+
+                acc[iy] = _mm256_fmadd_ps(_mm256_broadcast_ss(&d), _mm256_cvtepi32_ps(sumi), acc[iy]);
+            }
+        }
+
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            s[iy*bs + ix] = hsum_float_8(acc[iy]);
+        }
+    }
+
+#else
+
+    // no register-blocked kernel for this target, use the row kernel
+    for (int ix = 0; ix < GGML_VEC_DOT_TILE_X; ++ix) {
+        for (int iy = 0; iy < GGML_VEC_DOT_TILE_Y; ++iy) {
+            ggml_vec_dot_q6_K_q8_K(n, &s[iy*bs + ix], (const char *) vx + ix*bx, (const char *) vy + iy*by);
+        }
+    }
+
+#endif
+}
+
 #else
 
 void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
@@ -4316,3 +4977,238 @@ void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restri
 }
 
 #endif
+
+//
+// row-interleaved layouts, see ggml_repack()
+//
+
+#if QK_K == 256
+// the scales and mins of the rows, 16 bytes per row (scales then mins) and 64 in all, are
+// stored as 32 bytes of low 4 bits (byte l: u[l] | u[l + 32] << 4) followed by 16 bytes of
+// high 2 bits (byte l: u[l] | u[l + 16] << 2 | u[l + 32] << 4 | u[l + 48] << 6)
+static inline void unpack_scales_q4_K_r4(const uint8_t * restrict s, uint8_t * restrict u) {
+    for (int l = 0; l < 32; ++l) {
+        u[l +  0] = (s[l] & 0xF) | (((s[32 + l%16] >> 2*(l/16 + 0)) & 3) << 4);
+        u[l + 32] = (s[l] >>  4) | (((s[32 + l%16] >> 2*(l/16 + 2)) & 3) << 4);
+    }
+}
+
+void repack_rows_q4_K(const void * restrict vx, size_t bx, void * restrict vy, int k) {
+    assert(k % QK_K == 0);
+    const int nb = k / QK_K;
+
+    block_q4_K_r4 * restrict y = vy;
+
+    uint8_t u[GGML_REPACK_ROWS*16];
+
+    for (int i = 0; i < nb; i++) {
+        for (int r = 0; r < GGML_REPACK_ROWS; r++) {
+            const block_q4_K * restrict x = (const block_q4_K *) ((const char *) vx + r*bx);
+
+            y[i].d[r]    = x[i].d;
+            y[i].dmin[r] = x[i].dmin;
+            for (int j = 0; j < QK_K/32; ++j) {
+                get_scale_min_k4(j, x[i].scales, &u[16*r + j], &u[16*r + 8 + j]);
+            }
+            memcpy(y[i].qs[r], x[i].qs, QK_K/2);
+        }
+
+        for (int l = 0; l < 32; ++l) {
+            y[i].scales[l] = (u[l] & 0xF) | (u[l + 32] & 0xF) << 4;
+        }
+        for (int l = 0; l < 16; ++l) {
+            y[i].scales[32 + l] = (u[l] >> 4) | (u[l + 16] >> 4) << 2 | (u[l + 32] >> 4) << 4 | (u[l + 48] >> 4) << 6;
+        }
+    }
+}
+
+#if defined(__AVX2__)
+// horizontal sums of GGML_REPACK_ROWS vectors at once, with the additions in the same order as
+// hsum_float_8 and the reduction of acc_m in the row kernels
+static inline __m128 hsum_float_4_x4(const __m128 * x) {
+    const __m128 x01 = _mm_add_ps(_mm_unpacklo_ps(x[0], x[1]), _mm_unpackhi_ps(x[0], x[1]));
+    const __m128 x23 = _mm_add_ps(_mm_unpacklo_ps(x[2], x[3]), _mm_unpackhi_ps(x[2], x[3]));
+
+    return _mm_add_ps(_mm_movelh_ps(x01, x23), _mm_movehl_ps(x23, x01));
+}
+
+static inline __m128 hsum_float_8_x4(const __m256 * x) {
+    __m128 r[GGML_REPACK_ROWS];
+
+    for (int k = 0; k < GGML_REPACK_ROWS; ++k) {
+        r[k] = _mm_add_ps(_mm256_extractf128_ps(x[k], 1), _mm256_castps256_ps128(x[k]));
+    }
+
+    return hsum_float_4_x4(r);
+}
+#endif
+
+// the rows share the loads of y and the horizontal sums, and are read as one stream
+void ggml_vec_dot_rows_q4_K_q8_K(const int n, float * restrict s, size_t bs, const void * restrict vx, const void * restrict vy, size_t by, int ny) {
+    assert(n % QK_K == 0);
+
+    const block_q4_K_r4 * restrict x = vx;
+
+    const int nb = n / QK_K;
+
+#if defined(__AVX2__)
+
+    const block_q8_K * restrict y[GGML_VEC_DOT_TILE_Y];
+
+    assert(ny <= GGML_VEC_DOT_TILE_Y);
+
+    for (int iy = 0; iy < ny; ++iy) {
+        y[iy] = (const block_q8_K *) ((const char *) vy + iy*by);
+    }
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+    const __m256i m3 = _mm256_set1_epi8(3);
+
+    // shifts of the high 2 bits of the scales and mins of rows 0 and 1, and of rows 2 and 3
+    const __m256i hs01 = _mm256_set_epi32(2, 2, 2, 2, 0, 0, 0, 0);
+    const __m256i hs23 = _mm256_set_epi32(6, 6, 6, 6, 4, 4, 4, 4);
+
+    __m256 acc  [GGML_VEC_DOT_TILE_Y][GGML_REPACK_ROWS];
+    __m128 acc_m[GGML_VEC_DOT_TILE_Y][GGML_REPACK_ROWS];
+
+    for (int iy = 0; iy < ny; ++iy) {
+        for (int r = 0; r < GGML_REPACK_ROWS; ++r) {
+            acc  [iy][r] = _mm256_setzero_ps();
+            acc_m[iy][r] = _mm_setzero_ps();
+        }
+    }
+
+    for (int i = 0; i < nb; ++i) {
+
+        __m128i q8s[GGML_VEC_DOT_TILE_Y];
+
+        for (int iy = 0; iy < ny; ++iy) {
+            const __m256i q8sums = _mm256_loadu_si256((const __m256i*)y[iy][i].bsums);
+            q8s[iy] = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+        }
+
+        // the scales and mins of all rows at once, see unpack_scales_q4_K_r4()
+        const __m256i sl = _mm256_loadu_si256((const __m256i *) x[i].scales);
+        const __m256i sh = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (x[i].scales + 32)));
+
+        const __m256i u01 = _mm256_or_si256(_mm256_and_si256(sl, m4),
+                _mm256_slli_epi16(_mm256_and_si256(_mm256_srlv_epi32(sh, hs01), m3), 4));
+        const __m256i u23 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(sl, 4), m4),
+                _mm256_slli_epi16(_mm256_and_si256(_mm256_srlv_epi32(sh, hs23), m3), 4));
+
+        // each row is decoded once and reused for all rows of y, as in the tile kernel
+        for (int r = 0; r < GGML_REPACK_ROWS; ++r) {
+
+            const float xd    = ggml_fp16_to_fp32(x[i].d[r]);
+            const float xdmin = ggml_fp16_to_fp32(x[i].dmin[r]);
+
+            const __m256i u = r < 2 ? u01 : u23;
+            const __m256i mins_and_scales = _mm256_cvtepu8_epi16(r % 2 ? _mm256_extracti128_si256(u, 1) : _mm256_castsi256_si128(u));
+
+            const __m128i mins   = _mm256_extracti128_si256(mins_and_scales, 1);
+            const __m128i sc128  = _mm256_extracti128_si256(mins_and_scales, 0);
+            const __m256i scales = MM256_SET_M128I(sc128, sc128);
+
+            __m256i q4l[QK_K/64];
+            __m256i q4h[QK_K/64];
+
+            for (int j = 0; j < QK_K/64; ++j) {
+                const __m256i q4bits = _mm256_loadu_si256((const __m256i*)(x[i].qs[r] + 32*j));
+                q4l[j] = _mm256_and_si256(q4bits, m4);
+                q4h[j] = _mm256_and_si256(_mm256_srli_epi16(q4bits, 4), m4);
+            }
+
+            for (int iy = 0; iy < ny; ++iy) {
+
+                const float d    =  y[iy][i].d * xd;
+                const float dmin = -y[iy][i].d * xdmin;
+
+                const __m128i prod = _mm_madd_epi16(mins, q8s[iy]);
+                acc_m[iy][r] = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(prod), acc_m[iy][r]);
+
+                const int8_t * restrict q8 = y[iy][i].qs;
+
+                __m256i sumi_l = _mm256_setzero_si256();
+                __m256i sumi_h = _mm256_setzero_si256();
+
+                for (int j = 0; j < QK_K/64; ++j) {
+
+                    const __m256i scale_l = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+0));
+                    const __m256i scale_h = _mm256_shuffle_epi8(scales, get_scale_shuffle_k4(2*j+1));
+
+                    const __m256i q8l = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+                    const __m256i q8h = _mm256_loadu_si256((const __m256i*)q8); q8 += 32;
+
+#if defined(GGML_VNNI)
+                    sumi_l = GGML_VNNI_DPWSSD(sumi_l, scale_l, _mm256_maddubs_epi16(q4l[j], q8l));
+                    sumi_h = GGML_VNNI_DPWSSD(sumi_h, scale_h, _mm256_maddubs_epi16(q4h[j], q8h));
+#else
+                    sumi_l = _mm256_add_epi32(sumi_l, _mm256_madd_epi16(scale_l, _mm256_maddubs_epi16(q4l[j], q8l)));
+                    sumi_h = _mm256_add_epi32(sumi_h, _mm256_madd_epi16(scale_h, _mm256_maddubs_epi16(q4h[j], q8h)));
+#endif
+                }
+
+                const __m256i sumi = _mm256_add_epi32(sumi_l, sumi_h);
+
+                acc[iy][r] = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc[iy][r]);
+            }
+        }
+    }
+
+    for (int iy = 0; iy < ny; ++iy) {
+        _mm_storeu_ps(s + iy*bs, _mm_add_ps(hsum_float_8_x4(acc[iy]), hsum_float_4_x4(acc_m[iy])));
+    }
+
+#else
+
+    uint8_t u[GGML_REPACK_ROWS*16];
+
+    float sumf[GGML_VEC_DOT_TILE_Y][GGML_REPACK_ROWS] = { { 0.0f } };
+
+    assert(ny <= GGML_VEC_DOT_TILE_Y);
+
+    for (int i = 0; i < nb; ++i) {
+        unpack_scales_q4_K_r4(x[i].scales, u);
+
+        for (int iy = 0; iy < ny; ++iy) {
+            const block_q8_K * restrict y = (const block_q8_K *) ((const char *) vy + iy*by);
+
+            for (int r = 0; r < GGML_REPACK_ROWS; ++r) {
+                const uint8_t * restrict sc = u + 16*r;
+                const uint8_t * restrict mn = u + 16*r + 8;
+
+                const uint8_t * restrict q4 = x[i].qs[r];
+                const int8_t  * restrict q8 = y[i].qs;
+
+                int sumi = 0;
+                for (int j = 0; j < QK_K/64; ++j) {
+                    int sum1 = 0;
+                    int sum2 = 0;
+                    for (int l = 0; l < 32; ++l) {
+                        sum1 += (q4[l] & 0xF) * q8[l];
+                        sum2 += (q4[l] >>  4) * q8[l + 32];
+                    }
+                    sumi += sum1*sc[2*j+0] + sum2*sc[2*j+1];
+                    q4 += 32;
+                    q8 += 64;
+                }
+
+                int summ = 0;
+                for (int j = 0; j < QK_K/32; ++j) {
+                    summ += mn[j] * (y[i].bsums[2*j+0] + y[i].bsums[2*j+1]);
+                }
+
+                sumf[iy][r] += y[i].d * (ggml_fp16_to_fp32(x[i].d[r]) * sumi - ggml_fp16_to_fp32(x[i].dmin[r]) * summ);
+            }
+        }
+    }
+
+    for (int iy = 0; iy < ny; ++iy) {
+        for (int r = 0; r < GGML_REPACK_ROWS; ++r) {
+            s[iy*bs + r] = sumf[iy][r];
+        }
+    }
+
+#endif
+}
+#endif
@@ -125,6 +125,19 @@ typedef struct {
 } block_q8_K;
 static_assert(sizeof(block_q8_K) == sizeof(float) + QK_K + QK_K/16*sizeof(int16_t), "wrong q8_K block size/padding");
 
+#if QK_K == 256
+// GGML_REPACK_ROWS rows of q4_K, interleaved super-block by super-block
+// the 6-bit scales and mins of all rows are split into a stream of low 4 bits and one of high
+// 2 bits, so that they unpack together with a few SIMD instructions, see repack_rows_q4_K()
+typedef struct {
+    ggml_fp16_t d[GGML_REPACK_ROWS];                    // super-block scales for quantized scales
+    ggml_fp16_t dmin[GGML_REPACK_ROWS];                 // super-block scales for quantized mins
+    uint8_t scales[GGML_REPACK_ROWS*K_SCALE_SIZE];      // scales and mins, quantized with 6 bits
+    uint8_t qs[GGML_REPACK_ROWS][QK_K/2];               // 4--bit quants
+} block_q4_K_r4;
+static_assert(sizeof(block_q4_K_r4) == GGML_REPACK_ROWS*sizeof(block_q4_K), "wrong q4_K_r4 block size/padding");
+#endif
+
 
 // Quantization
 void quantize_row_q2_K_reference(const float * restrict x, block_q2_K * restrict y, int k);
@@ -156,6 +169,17 @@ void ggml_vec_dot_q4_K_q8_K(int n, float * restrict s, const void * restrict vx,
 void ggml_vec_dot_q5_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
 void ggml_vec_dot_q6_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
 
+#if QK_K == 256
+// Register-blocked dot products, see ggml_vec_dot_tile_t
+void ggml_vec_dot_tile_q4_K_q8_K(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by);
+void ggml_vec_dot_tile_q6_K_q8_K(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by);
+
+// Row-interleaved layouts, see ggml_repack() and ggml_vec_dot_rows_t
+void repack_rows_q4_K(const void * restrict x, size_t bx, void * restrict y, int k);
+
+void ggml_vec_dot_rows_q4_K_q8_K(int n, float * restrict s, size_t bs, const void * restrict vx, const void * restrict vy, size_t by, int ny);
+#endif
+
 // Quantization with histogram collection
 size_t ggml_quantize_q2_K(const float * src, void * dst, int n, int k, int64_t * hist);
 size_t ggml_quantize_q3_K(const float * src, void * dst, int n, int k, int64_t * hist);
@@ -113,7 +113,9 @@ void gpt2_free(struct gpt2_context * ctx) {
 }
 
 // load the model's weights from a file
-bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab & vocab) {
+bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab & vocab, load_timings & load) {
+    int64_t t_start_us = ggml_dadbed9_time_us();
+
     printf("%s: loading model from '%s'\n", __func__, fname.c_str());
 
     auto fin = std::ifstream(fname, std::ios::binary);
@@ -156,6 +158,9 @@ bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab &
         hparams.ftype %= GGML_QNT_VERSION_FACTOR;
     }
 
+    load.add(LOAD_PHASE_META, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load vocab
     {
         int32_t n_vocab = 0;
@@ -183,6 +188,9 @@ bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab &
         }
     }
 
+    load.add(LOAD_PHASE_VOCAB, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // for the big tensors, we have the option to store the data in 16-bit floats or quantized
     // in order to save memory and also to speed up the computation
     ggml_type wtype = ggml_ftype_to_ggml_type((ggml_ftype) (model.hparams.ftype));
@@ -229,8 +237,8 @@ bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab &
         ctx_size += n_layer*(4*n_embd*n_embd*ggml_type_sizef(wtype));         // c_mlp_proj_w
         ctx_size += n_layer*(         n_embd*ggml_type_sizef(GGML_TYPE_F32)); // c_mlp_proj_b
 
-        ctx_size += n_ctx*n_layer*n_embd*ggml_type_sizef(GGML_TYPE_F32); // memory_k
-        ctx_size += n_ctx*n_layer*n_embd*ggml_type_sizef(GGML_TYPE_F32); // memory_v
+        ctx_size += gpt_kv_n_rows(n_ctx)*n_layer*n_embd*ggml_type_sizef(GGML_TYPE_F32); // memory_k
+        ctx_size += gpt_kv_n_rows(n_ctx)*n_layer*n_embd*ggml_type_sizef(GGML_TYPE_F32); // memory_v
 
         ctx_size += (6 + 12*n_layer)*512; // object overhead
 
@@ -329,7 +337,8 @@ bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab &
         const int n_layer = hparams.n_layer;
         const int n_ctx   = hparams.n_ctx;
 
-        const int n_mem      = n_layer*n_ctx;
+        // the context window slides over the spare rows, see gpt_kv_window
+        const int n_mem      = n_layer*gpt_kv_n_rows(n_ctx);
         const int n_elements = n_embd*n_mem;
 
         model.memory_k = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n_elements);
@@ -340,6 +349,9 @@ bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab &
         printf("%s: memory size = %8.2f MB, n_mem = %d\n", __func__, memory_size/1024.0/1024.0, n_mem);
     }
 
+    load.add(LOAD_PHASE_TENSORS, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load weights
     {
         size_t total_size = 0;
@@ -418,6 +430,8 @@ bool gpt2_model_load(const std::string & fname, gpt2_model & model, gpt_vocab &
 
     fin.close();
 
+    load.add(LOAD_PHASE_DATA, t_start_us, ggml_dadbed9_time_us());
+
     return true;
 }
 
@@ -426,6 +440,7 @@ struct ggml_cgraph * gpt2_graph(
         const gpt2_model & model,
         struct ggml_allocr * allocr,
         const int n_past,
+        const gpt_kv_window & kv,
         const std::vector<gpt_vocab::id> & embd_inp) {
     const int N = embd_inp.size();
 
@@ -433,9 +448,12 @@ struct ggml_cgraph * gpt2_graph(
 
     const int n_embd  = hparams.n_embd;
     const int n_layer = hparams.n_layer;
-    const int n_ctx   = hparams.n_ctx;
     const int n_head  = hparams.n_head;
 
+    // cache rows per layer and the first row of the window
+    const int n_rows  = kv.n_rows;
+    const int kv_head = kv.head;
+
     // since we are using ggml-alloc, this buffer only needs enough space to hold the ggml_tensor and ggml_cgraph structs, but not the tensor data
     static size_t buf_size = ggml_tensor_overhead()*GGML_MAX_NODES + ggml_graph_overhead();
     static std::vector<uint8_t> buf(buf_size);
@@ -521,8 +539,8 @@ struct ggml_cgraph * gpt2_graph(
 
             // store key and value to memory
             if (N >= 1) {
-                struct ggml_tensor * k = ggml_view_1d(ctx0, model.memory_k, N*n_embd, (ggml_element_size(model.memory_k)*n_embd)*(il*n_ctx + n_past));
-                struct ggml_tensor * v = ggml_view_1d(ctx0, model.memory_v, N*n_embd, (ggml_element_size(model.memory_v)*n_embd)*(il*n_ctx + n_past));
+                struct ggml_tensor * k = ggml_view_1d(ctx0, model.memory_k, N*n_embd, (ggml_element_size(model.memory_k)*n_embd)*(il*n_rows + kv_head + n_past));
+                struct ggml_tensor * v = ggml_view_1d(ctx0, model.memory_v, N*n_embd, (ggml_element_size(model.memory_v)*n_embd)*(il*n_rows + kv_head + n_past));
 
                 ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
                 ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
@@ -542,7 +560,7 @@ struct ggml_cgraph * gpt2_graph(
             struct ggml_tensor * K =
                 ggml_permute(ctx0,
                         ggml_reshape_3d(ctx0,
-                            ggml_view_1d(ctx0, model.memory_k, (n_past + N)*n_embd, il*n_ctx*ggml_element_size(model.memory_k)*n_embd),
+                            ggml_view_1d(ctx0, model.memory_k, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_element_size(model.memory_k)*n_embd),
                             n_embd/n_head, n_head, n_past + N),
                         0, 2, 1, 3);
 
@@ -551,7 +569,7 @@ struct ggml_cgraph * gpt2_graph(
             //    ggml_cpy(ctx0,
             //            ggml_permute(ctx0,
             //                ggml_reshape_3d(ctx0,
-            //                    ggml_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, il*n_ctx*ggml_element_size(model.memory_v)*n_embd),
+            //                    ggml_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_element_size(model.memory_v)*n_embd),
             //                    n_embd/n_head, n_head, n_past + N),
             //                1, 2, 0, 3),
             //            ggml_new_tensor_3d(ctx0, GGML_TYPE_F32, n_past + N, n_embd/n_head, n_head));
@@ -583,7 +601,7 @@ struct ggml_cgraph * gpt2_graph(
                 ggml_cpy(ctx0,
                         ggml_permute(ctx0,
                             ggml_reshape_3d(ctx0,
-                                ggml_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, il*n_ctx*ggml_element_size(model.memory_v)*n_embd),
+                                ggml_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_element_size(model.memory_v)*n_embd),
                                 n_embd/n_head, n_head, n_past + N),
                             1, 2, 0, 3),
                         ggml_new_tensor_3d(ctx0, model.memory_v->type, n_past + N, n_embd/n_head, n_head));
@@ -716,8 +734,10 @@ bool gpt2_eval(
         struct ggml_allocr * allocr,
         const int n_threads,
         const int n_past,
+        const gpt_kv_window & kv,
         const std::vector<gpt_vocab::id> & embd_inp,
-              std::vector<float>         & embd_w) {
+              std::vector<float>         & embd_w,
+              bool                         logits_all) {
     const int N = embd_inp.size();
 
     const auto & hparams = model.hparams;
@@ -727,7 +747,7 @@ bool gpt2_eval(
     // reset the allocator to free all the memory allocated during the previous inference
     ggml_allocr_reset(allocr);
 
-    struct ggml_cgraph * gf = gpt2_graph(model, allocr, n_past, embd_inp);
+    struct ggml_cgraph * gf = gpt2_graph(model, allocr, n_past, kv, embd_inp);
 
     // allocate tensors
     ggml_allocr_alloc_graph(allocr, gf);
@@ -747,12 +767,15 @@ bool gpt2_eval(
     // in this case, the output tensor is the last one in the graph
     struct ggml_tensor * inpL = gf->nodes[gf->n_nodes - 1];
 
-    //embd_w.resize(n_vocab*N);
-    //memcpy(embd_w.data(), ggml_get_data(inpL), sizeof(float)*n_vocab*N);
-
-    // return result just for the last token
-    embd_w.resize(n_vocab);
-    memcpy(embd_w.data(), (float *) ggml_get_data(inpL) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+    if (logits_all) {
+        // return result for all tokens
+        embd_w.resize(n_vocab*N);
+        memcpy(embd_w.data(), ggml_get_data(inpL), sizeof(float)*n_vocab*N);
+    } else {
+        // return result just for the last token
+        embd_w.resize(n_vocab);
+        memcpy(embd_w.data(), (float *) ggml_get_data(inpL) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+    }
 
     return true;
 }
@@ -772,27 +795,43 @@ struct gpt2_context * gpt2_init_from_file(const char * path_model, struct gpt_co
     ggml_dadbed9_time_init();
 
     gpt2_context * ctx = new gpt2_context;
+    ctx->t_start_us = ggml_dadbed9_time_us();
 
     if (params.seed <= 0) {
         params.seed = time(NULL);
     }
 
     ctx->rng = std::mt19937(params.seed);
-//    ctx->logits_all = params.logits_all;
+    ctx->logits_all = params.logits_all;
 
 //    ggml_dadbed9_type memory_type = params.f16_kv ? GGML_dadbed9_TYPE_F16 : GGML_dadbed9_TYPE_F32;
     
-    if (!gpt2_model_load(path_model, ctx->model, ctx->vocab)) {
+    if (!gpt2_model_load(path_model, ctx->model, ctx->vocab, ctx->load)) {
         fprintf(stderr, "%s: failed to load model\n", __func__);
         delete ctx;
         return nullptr;
     }
+
+    const int64_t t_start_context_us = ggml_dadbed9_time_us();
+
+    // the context window in the KV cache
+    {
+        auto & kv = ctx->kv_window;
+        kv.k        = (uint8_t *) ctx->model.memory_k->data;
+        kv.v        = (uint8_t *) ctx->model.memory_v->data;
+        kv.elt_size = ggml_element_size(ctx->model.memory_k);
+        kv.n_embd   = ctx->model.hparams.n_embd;
+        kv.n_layer  = ctx->model.hparams.n_layer;
+        kv.n_rows   = gpt_kv_n_rows(ctx->model.hparams.n_ctx);
+        kv.v_trans  = false;
+    }
+
     ctx->allocr = ggml_allocr_new_measure(GGML_MEM_ALIGN);
 
     // create the worst case graph for memory usage estimation
     int n_tokens = std::min(ctx->model.hparams.n_ctx, params.n_batch);
     int n_past = ctx->model.hparams.n_ctx - n_tokens;
-    struct ggml_cgraph * gf = gpt2_graph(ctx->model, ctx->allocr, n_past, std::vector<gpt_vocab::id>(n_tokens, 0));
+    struct ggml_cgraph * gf = gpt2_graph(ctx->model, ctx->allocr, n_past, ctx->kv_window, std::vector<gpt_vocab::id>(n_tokens, 0));
 
     // compute the required memory
     size_t mem_size = ggml_allocr_alloc_graph(ctx->allocr, gf) + GGML_MEM_ALIGN;
@@ -836,6 +875,8 @@ struct gpt2_context * gpt2_init_from_file(const char * path_model, struct gpt_co
 ////        ctx->buf_scratch[1].resize(MEM_REQ_SCRATCH1().at(ctx->model.type));
 //    }
 
+    ctx->load.add(LOAD_PHASE_CONTEXT, t_start_context_us, ggml_dadbed9_time_us());
+
     return ctx;
 }
 
@@ -849,7 +890,8 @@ int gpt2_init_logits(struct gpt2_context * ctx,int   n_threads){
 //            const int n_past,
 //            const std::vector<gpt_vocab::id> & embd_inp,
 //                  std::vector<float>         & embd_w)
-    if (!gpt2_eval(ctx->model,ctx->allocr, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits)) {
+    gpt_kv_window_prepare(&ctx->kv_window, 0, 4);
+    if (!gpt2_eval(ctx->model,ctx->allocr, n_threads, 0, ctx->kv_window, { 0, 1, 2, 3 }, ctx->logits, false)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -871,7 +913,9 @@ int gpt2_eval(
     size_t mem_per_token = 0;
 //    gpt2_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, mem_per_token);
     //    if (!gptneox_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads)) {
-    if (!gpt2_eval(ctx->model,ctx->allocr, n_threads, n_past, embd, ctx->logits)) {
+    const int64_t t_start_us = ggml_dadbed9_time_us();
+    gpt_kv_window_prepare(&ctx->kv_window, n_past, n_tokens);
+    if (!gpt2_eval(ctx->model,ctx->allocr, n_threads, n_past, ctx->kv_window, embd, ctx->logits, ctx->logits_all)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -879,7 +923,9 @@ int gpt2_eval(
     if (!ctx->has_evaluated_once) {
         ctx->t_load_us = ggml_dadbed9_time_us() - ctx->t_start_us;
         ctx->has_evaluated_once = true;
+        ctx->load.add(LOAD_PHASE_FIRST_EVAL, t_start_us, ggml_dadbed9_time_us());
     }
+    gpt_base_eval_done(ctx, n_tokens, n_past, t_start_us);
     return 0;
 }
 //
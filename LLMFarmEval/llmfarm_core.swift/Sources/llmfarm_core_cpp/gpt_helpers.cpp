@@ -19,6 +19,61 @@ int test_fn()
     return 42;
 }
 
+void gpt_kv_window_prepare(struct gpt_kv_window * kv, int n_past, int n_tokens) {
+    if (n_past == 0) {
+        kv->head      = 0;
+        kv->n_shifted = 0;
+        return;
+    }
+
+    if (kv->head == 0 || kv->head + n_past + n_tokens <= kv->n_rows) {
+        return;
+    }
+
+    // move the window to the first row of every layer
+    const size_t row_size = kv->elt_size*kv->n_embd;
+
+    for (int il = 0; il < kv->n_layer; ++il) {
+        uint8_t * k = kv->k + (size_t) il*kv->n_rows*row_size;
+        memmove(k, k + (size_t) kv->head*row_size, (size_t) n_past*row_size);
+
+        if (kv->v_trans) {
+            for (int e = 0; e < kv->n_embd; ++e) {
+                uint8_t * v = kv->v + ((size_t) il*kv->n_embd + e)*kv->n_rows*kv->elt_size;
+                memmove(v, v + (size_t) kv->head*kv->elt_size, (size_t) n_past*kv->elt_size);
+            }
+        } else {
+            uint8_t * v = kv->v + (size_t) il*kv->n_rows*row_size;
+            memmove(v, v + (size_t) kv->head*row_size, (size_t) n_past*row_size);
+        }
+    }
+
+    kv->head = 0;
+}
+
+void gpt_base_eval_done(struct gpt_base_context * ctx, int n_tokens, int n_past, int64_t t_start_us) {
+    const int64_t t_eval_us = ggml_dadbed9_time_us() - t_start_us;
+    if (n_tokens == 1) {
+        ctx->t_eval_us += t_eval_us;
+        ctx->n_eval++;
+    } else if (n_tokens > 1) {
+        ctx->t_p_eval_us += t_eval_us;
+        ctx->n_p_eval += n_tokens;
+    }
+
+    ctx->latency.eval_begin(n_tokens, n_past, t_start_us);
+    ctx->latency.eval_end(n_tokens, t_eval_us);
+
+    ctx->n_logits_rows = ctx->logits_all ? n_tokens : 1;
+}
+
+void gpt_base_sample_done(struct gpt_base_context * ctx, int64_t t_start_sample_us) {
+    const int64_t t_now_us = ggml_dadbed9_time_us();
+    ctx->t_sample_us += t_now_us - t_start_sample_us;
+    ctx->n_sample++;
+    ctx->latency.token_sampled(t_now_us, ctx->t_sample_us);
+}
+
 
 
 static const std::map<e_model, size_t> & MEM_REQ_SCRATCH0()
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include "ggml/ggml_dadbed9.h"
 #include "ggml/common.h"
+#include "latency_stats.h"
+#include "load_timings.h"
 
 #include <cassert>
 #include <random>
@@ -47,6 +49,31 @@ struct gpt_base_hparams {
     int32_t ftype   = 0;
 };
 
+// The KV cache of a gpt_base model has gpt_kv_n_rows(n_ctx) rows per layer. The context window
+// is rows [head, head + n_past) of every layer: gpt_base_shift_kv_cache() drops tokens from the
+// front of the window by moving head, without touching the cache, and gpt_kv_window_prepare()
+// moves the window back to the first row only when an eval would run past the last one. The
+// spare rows past n_ctx set how many tokens can be shifted out before that happens.
+static inline int gpt_kv_n_rows(int n_ctx) {
+    return n_ctx + n_ctx/4;
+}
+
+struct gpt_kv_window {
+    uint8_t * k = NULL; // [n_embd, n_rows, n_layer]
+    uint8_t * v = NULL; // [n_embd, n_rows, n_layer], or [n_rows, n_embd, n_layer] if v_trans
+    size_t elt_size = 0;
+    int  n_embd  = 0;
+    int  n_layer = 0;
+    int  n_rows  = 0;
+    bool v_trans = false;
+
+    int head      = 0; // first row of the window
+    int n_shifted = 0; // tokens shifted out of the window, RoPE positions continue after them
+};
+
+// makes room for n_tokens rows after the n_past rows of the window, n_past = 0 starts a new one
+void gpt_kv_window_prepare(struct gpt_kv_window * kv, int n_past, int n_tokens);
+
 struct gpt_buffer {
     uint8_t * addr = NULL;
     size_t size = 0;
@@ -162,6 +189,12 @@ struct gpt_base_context {
     int32_t n_eval   = 0; // number of eval calls
     int32_t n_p_eval = 0; // number of tokens in eval calls for the prompt (with batch size > 1)
 
+    // distributions of the above per step, and the time to first token
+    latency_tracker latency;
+
+    // the phases of the *_init_from_file functions and the first eval
+    load_timings load;
+
     gpt_base_model model;
     gpt_vocab vocab;
     
@@ -170,13 +203,20 @@ struct gpt_base_context {
     // decode output (2-dimensional array: [n_tokens][n_vocab])
     std::vector<float> logits;
     bool logits_all = false;
+    int32_t n_logits_rows = 0; // rows of logits the last eval left
 
     // input embedding (1-dimensional array: [n_embd])
     std::vector<float> embedding;
 
-    
+    // where the model keeps the context window in its KV cache
+    gpt_kv_window kv_window;
 };
 
+// account an eval of n_tokens at n_past that started at t_start_us, and a sampled token whose
+// sampling started at t_start_sample_us, in the counters above
+void gpt_base_eval_done(struct gpt_base_context * ctx, int n_tokens, int n_past, int64_t t_start_us);
+void gpt_base_sample_done(struct gpt_base_context * ctx, int64_t t_start_sample_us);
+
 
 
 static const char *gpt_model_type_name(e_model type) {
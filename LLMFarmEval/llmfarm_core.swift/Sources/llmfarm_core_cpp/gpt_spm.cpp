@@ -5,17 +5,23 @@
 #include "./spm-headers/rwkv.h"
 #include "grammar-parser.h"
 #include "ggml/ggml_dadbed9.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cinttypes>
 #include <fstream>
+#include <iterator>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <random>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 
 
 
@@ -81,6 +87,12 @@ int gpt_base_n_embd(struct gpt_base_context * ctx) {
 }
 
 float * gpt_base_get_logits(struct gpt_base_context * ctx) {
+    // replit keeps a tokenizer of its own, so the row is cut by the row count rather than the vocab
+    const size_t n_rows = std::max(ctx->n_logits_rows, 1);
+    return ctx->logits.data() + ctx->logits.size()/n_rows*(n_rows - 1);
+}
+
+float * gpt_base_get_logits_all(struct gpt_base_context * ctx) {
     return ctx->logits.data();
 }
 
@@ -123,32 +135,111 @@ int gpt_base_tokenize(
     return res.size();
 }
 
+// Drops the first n tokens of the context window, the next eval continues at n_past - n. The
+// window only moves its start, see gpt_kv_window_prepare() for when the cache is compacted.
 void gpt_base_shift_kv_cache(struct gpt_base_context * ctx, int n) {
-    auto & model = ctx->model;
-    auto & kv_self = model.kv_self;
-    auto & hparams = model.hparams;
-    auto n_layer = hparams.n_layer;
-    auto n_embd = hparams.n_embd;
-    auto n_ctx = hparams.n_ctx;
-    for(int il = 0; il < n_layer; il++) {
-        // K: Embeddings are in regular order so moving them is easy as copying the memory
-        {
-            int elem_byte_size = ggml_dadbed9_element_size(kv_self.k);
-            uint8_t * dst_ptr = ((uint8_t *)kv_self.k->data) + (elem_byte_size * n_embd * (il * n_ctx));
-            uint8_t * src_ptr = ((uint8_t *)kv_self.k->data) + (elem_byte_size * n_embd * (il * n_ctx + n));
-            memcpy(dst_ptr, src_ptr, elem_byte_size * n_embd * (n_ctx - n));
-        }
-        
-        // V: Embeddings are transposed so each embedding element must be copied separately
-        {
-            int elem_byte_size = ggml_dadbed9_element_size(kv_self.v);
-            for(int i = 0; i < n_embd; i++) {
-                uint8_t * dst_ptr = ((uint8_t *)kv_self.v->data) + (elem_byte_size * (il * n_ctx * i));
-                uint8_t * src_ptr = ((uint8_t *)kv_self.v->data) + (elem_byte_size * (il * n_ctx * i + n));
-                memcpy(dst_ptr, src_ptr, elem_byte_size * (n_ctx - n));
-            }
-        }
-    }
+    auto & kv = ctx->kv_window;
+    kv.head      += n;
+    kv.n_shifted += n;
+}
+
+struct gpt_base_timings gpt_base_get_timings(struct gpt_base_context * ctx) {
+    struct gpt_base_timings result = {
+        /*.t_start_ms  =*/ 1e-3 * ctx->t_start_us,
+        /*.t_end_ms    =*/ 1e-3 * ggml_dadbed9_time_us(),
+        /*.t_load_ms   =*/ 1e-3 * ctx->t_load_us,
+        /*.t_sample_ms =*/ 1e-3 * ctx->t_sample_us,
+        /*.t_p_eval_ms =*/ 1e-3 * ctx->t_p_eval_us,
+        /*.t_eval_ms   =*/ 1e-3 * ctx->t_eval_us,
+
+        /*.t_first_token_ms =*/ 1e-3 * ctx->latency.t_first_token_us,
+
+        /*.n_sample =*/ std::max(1, ctx->n_sample),
+        /*.n_p_eval =*/ std::max(1, ctx->n_p_eval),
+        /*.n_eval   =*/ std::max(1, ctx->n_eval),
+    };
+
+    return result;
+}
+
+struct gpt_load_timings gpt_base_get_load_timings(const struct gpt_base_context * ctx) {
+    const auto & load = ctx->load;
+
+    struct gpt_load_timings result = {
+        /*.t_meta_ms       =*/ 1e-3 * load.t_us[LOAD_PHASE_META],
+        /*.t_vocab_ms      =*/ 1e-3 * load.t_us[LOAD_PHASE_VOCAB],
+        /*.t_tensors_ms    =*/ 1e-3 * load.t_us[LOAD_PHASE_TENSORS],
+        /*.t_data_ms       =*/ 1e-3 * load.t_us[LOAD_PHASE_DATA],
+        /*.t_repack_ms     =*/ 1e-3 * load.t_us[LOAD_PHASE_REPACK],
+        /*.t_mlock_ms      =*/ 1e-3 * load.t_us[LOAD_PHASE_MLOCK],
+        /*.t_context_ms    =*/ 1e-3 * load.t_us[LOAD_PHASE_CONTEXT],
+        /*.t_first_eval_ms =*/ 1e-3 * load.t_us[LOAD_PHASE_FIRST_EVAL],
+        /*.t_total_ms      =*/ 1e-3 * load.total_us(),
+    };
+
+    return result;
+}
+
+void gpt_base_reset_timings(struct gpt_base_context * ctx) {
+    ctx->t_start_us = ggml_dadbed9_time_us();
+    ctx->t_sample_us = ctx->n_sample = 0;
+    ctx->t_eval_us   = ctx->n_eval   = 0;
+    ctx->t_p_eval_us = ctx->n_p_eval = 0;
+    ctx->latency.reset();
+}
+
+static_assert((int) GPT_LATENCY_TOKEN       == (int) LATENCY_TOKEN,       "gpt_latency mismatch");
+static_assert((int) GPT_LATENCY_EVAL        == (int) LATENCY_EVAL,        "gpt_latency mismatch");
+static_assert((int) GPT_LATENCY_P_EVAL      == (int) LATENCY_P_EVAL,      "gpt_latency mismatch");
+static_assert((int) GPT_LATENCY_SAMPLE      == (int) LATENCY_SAMPLE,      "gpt_latency mismatch");
+static_assert((int) GPT_LATENCY_FIRST_TOKEN == (int) LATENCY_FIRST_TOKEN, "gpt_latency mismatch");
+
+struct gpt_latency_stats gpt_base_get_latency_stats(struct gpt_base_context * ctx, enum gpt_latency latency) {
+    GGML_dadbed9_ASSERT((int) latency >= 0 && (int) latency < LATENCY_COUNT);
+
+    const latency_histogram & hist = ctx->latency.hist[latency];
+
+    struct gpt_latency_stats result = {
+        /*.n       =*/ (int32_t) hist.n,
+        /*.min_ms  =*/ 1e-3 * hist.min_us,
+        /*.mean_ms =*/ 1e-3 * hist.mean_us(),
+        /*.p50_ms  =*/ 1e-3 * hist.percentile_us(50.0),
+        /*.p90_ms  =*/ 1e-3 * hist.percentile_us(90.0),
+        /*.p99_ms  =*/ 1e-3 * hist.percentile_us(99.0),
+        /*.max_ms  =*/ 1e-3 * hist.max_us,
+    };
+
+    return result;
+}
+
+double gpt_base_get_latency_percentile(struct gpt_base_context * ctx, enum gpt_latency latency, double p) {
+    GGML_dadbed9_ASSERT((int) latency >= 0 && (int) latency < LATENCY_COUNT);
+
+    return 1e-3 * ctx->latency.hist[latency].percentile_us(p);
+}
+
+void gpt_base_dump_timing_info_yaml(FILE * stream, const struct gpt_base_context * ctx) {
+    fprintf(stream, "\n");
+    fprintf(stream, "###########\n");
+    fprintf(stream, "# Timings #\n");
+    fprintf(stream, "###########\n");
+    fprintf(stream, "\n");
+
+    fprintf(stream, "mst_eval: %.2f  # ms / token during generation\n",
+            1.0e-3 * ctx->t_eval_us / std::max(1, ctx->n_eval));
+    fprintf(stream, "mst_p_eval: %.2f  # ms / token during prompt processing\n",
+            1.0e-3 * ctx->t_p_eval_us / std::max(1, ctx->n_p_eval));
+    fprintf(stream, "mst_sample: %.2f  # ms / token during sampling\n",
+            1.0e-3 * ctx->t_sample_us / std::max(1, ctx->n_sample));
+    fprintf(stream, "n_eval: %d  # number of tokens generated (excluding the first one)\n", ctx->n_eval);
+    fprintf(stream, "n_p_eval: %d  # number of tokens processed in batches at the beginning\n", ctx->n_p_eval);
+    fprintf(stream, "n_sample: %d  # number of sampled tokens\n", ctx->n_sample);
+    fprintf(stream, "t_eval_us: %" PRId64 "  # total microseconds spent generating tokens\n", ctx->t_eval_us);
+    fprintf(stream, "t_load_us: %" PRId64 "  # total microseconds spent loading the model\n", ctx->t_load_us);
+    fprintf(stream, "t_p_eval_us: %" PRId64 "  # total microseconds spent prompt processing\n", ctx->t_p_eval_us);
+    fprintf(stream, "t_sample_us: %" PRId64 "  # total microseconds spent sampling\n", ctx->t_sample_us);
+    ctx->load.dump_yaml(stream);
+    ctx->latency.dump_yaml(stream);
 }
 
 
@@ -157,9 +248,7 @@ int32_t gpt_base_sample(struct gpt_base_context * ctx, int top_k, float top_p, f
     const int64_t t_start_sample_us = ggml_dadbed9_time_us();
     int n_logits = ctx->vocab.id_to_token.size();
     gpt_vocab::id smpl = gpt_sample_top_k_top_p(n_logits, ctx->logits.data() + (ctx->logits.size() - ctx->vocab.id_to_token.size()), top_k, top_p, temp, ctx->rng);
-    if (ctx) {
-        ctx->t_sample_us += ggml_dadbed9_time_us() - t_start_sample_us;
-    }
+    gpt_base_sample_done(ctx, t_start_sample_us);
     return  smpl;
 }
 
@@ -177,9 +266,7 @@ int32_t gpt_base_sample_repeat(struct gpt_base_context * ctx,
                                                        top_k, top_p, temp,
                                                        repeat_last_n,repeat_penalty,
                                                        ctx->rng);
-    if (ctx) {
-        ctx->t_sample_us += ggml_dadbed9_time_us() - t_start_sample_us;
-    }
+    gpt_base_sample_done(ctx, t_start_sample_us);
     return  smpl;
 }
 
@@ -235,30 +322,55 @@ int32_t rwkv_sample_repeat(int n_logits, float * logits,
     return  smpl;
 }
 
+// state files are session files without a prompt: only the used KV rows are written,
+// streamed straight from the cache
 bool llama_save_state(struct llama_context * ctx, const char * fname){
-    const size_t state_size = llama_get_state_size(ctx);
-    uint8_t * state_mem = new uint8_t[state_size];
-    FILE *fp_write = fopen(fname, "wb");
-    llama_copy_state_data(ctx, state_mem); // could also copy directly to memory mapped file
-    fwrite(&state_size, 1, sizeof(state_size), fp_write);
-    fwrite(state_mem, 1, state_size, fp_write);
-    fclose(fp_write);
-    delete[] state_mem;
-    return  true;
+    try {
+        return llama_save_session_file(ctx, fname, nullptr, 0);
+    } catch (const std::exception & err) {
+        fprintf(stderr, "\n%s : failed to save state: %s\n", __func__, err.what());
+        return false;
+    }
 }
 
 bool llama_load_state(struct llama_context * ctx, const char * fname){
     FILE *fp_read = fopen(fname, "rb");
+    if (fp_read == NULL) {
+        fprintf(stderr, "\n%s : failed to open %s\n", __func__, fname);
+        return false;
+    }
+    uint32_t magic = 0;
+    fread(&magic, 1, sizeof(magic), fp_read);
+    if (magic == LLAMA_SESSION_MAGIC) {
+        fclose(fp_read);
+        size_t n_token_count = 0;
+        return llama_load_session_file(ctx, fname, nullptr, 0, &n_token_count);
+    }
+
+    // legacy state file: size followed by a llama_copy_state_data dump, restored
+    // straight from a mapping of the file rather than through a heap copy
+    rewind(fp_read);
     size_t state_size = 0;
-    fread(&state_size, 1, sizeof(state_size), fp_read);
-    uint8_t * state_mem = new uint8_t[state_size];
-    const size_t ret = fread(state_mem, 1, state_size, fp_read);
-    if (ret != state_size) {
+    struct stat st;
+    if (fread(&state_size, 1, sizeof(state_size), fp_read) != sizeof(state_size) ||
+        fstat(fileno(fp_read), &st) != 0 || (size_t) st.st_size < sizeof(state_size) + state_size) {
         fprintf(stderr, "\n%s : failed to read state\n", __func__);
-        GGML_ASSERT(false);
+        fclose(fp_read);
+        return false;
     }
-    llama_set_state_data(ctx, state_mem);
-    delete[] state_mem;
+    void * addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp_read), 0);
+    fclose(fp_read);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "\n%s : failed to map state\n", __func__);
+        return false;
+    }
+    if (!llama_check_state_data(ctx, (const uint8_t *) addr + sizeof(state_size), state_size)) {
+        fprintf(stderr, "\n%s : the state in %s does not fit the context\n", __func__, fname);
+        munmap(addr, st.st_size);
+        return false;
+    }
+    llama_set_state_data(ctx, (uint8_t *) addr + sizeof(state_size));
+    munmap(addr, st.st_size);
     return  true;
 }
 
@@ -282,27 +394,47 @@ const char * llama_token_to_str(const struct llama_context * ctx, llama_token to
 }
 
 
+// Within a process a parsed grammar is kept as a prototype per source path and every load returns
+// a copy of it, so a fixed schema is parsed once and its copies share the per-state token masks.
+// The prototype is parsed again when the text of the source changes.
+struct llama_grammar_cache_entry {
+    std::string src;
+    struct llama_grammar * grammar;
+};
+
+static std::mutex llama_grammar_cache_mutex;
+static std::map<std::string, llama_grammar_cache_entry> llama_grammar_cache;
+
 struct llama_grammar* llama_load_grammar(const char* grammar_path){
-    struct llama_grammar * grammar = NULL;
-    grammar_parser::parse_state parsed_grammar;
-    
-    std::ifstream infile;
-    infile.open(grammar_path, std::ios::binary);
-    infile.seekg(0, std::ios::end);
-    size_t file_size_in_byte = infile.tellg();
-    std::vector<char> grammar_context; // used to store text data
-    grammar_context.resize(file_size_in_byte);
-    infile.seekg(0, std::ios::beg);
-    infile.read(&grammar_context[0], file_size_in_byte);
-    
-    parsed_grammar = grammar_parser::parse(grammar_context.data());
+    std::ifstream infile(grammar_path, std::ios::binary);
+    if (!infile) {
+        fprintf(stderr, "%s: failed to open grammar '%s'\n", __func__, grammar_path);
+        return NULL;
+    }
+    std::string src((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+
+    std::lock_guard<std::mutex> lock(llama_grammar_cache_mutex);
+
+    auto it = llama_grammar_cache.find(grammar_path);
+    if (it != llama_grammar_cache.end()) {
+        if (it->second.src == src) {
+            return llama_grammar_copy(it->second.grammar);
+        }
+        llama_grammar_free(it->second.grammar);
+        llama_grammar_cache.erase(it);
+    }
+
+    grammar_parser::parse_state parsed_grammar = grammar_parser::parse(src.c_str());
     // will be empty (default) if there are parse errors
     if (parsed_grammar.rules.empty()) {
         return NULL;
     }
     grammar_parser::print_grammar(stderr, parsed_grammar);
     std::vector<const llama_grammar_element *> grammar_rules(parsed_grammar.c_rules());
-    grammar = llama_grammar_init(grammar_rules.data(), grammar_rules.size(), parsed_grammar.symbol_ids.at("root"));
-    return grammar;
+    struct llama_grammar * grammar = llama_grammar_init(grammar_rules.data(), grammar_rules.size(), parsed_grammar.symbol_ids.at("root"));
+
+    llama_grammar_cache[grammar_path] = { std::move(src), grammar };
+
+    return llama_grammar_copy(grammar);
 }
 
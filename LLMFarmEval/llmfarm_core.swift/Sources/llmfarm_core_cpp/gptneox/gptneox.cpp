@@ -97,7 +97,9 @@ void gpt_neox_free(struct gpt_neox_context * ctx) {
 
 
 // load the model's weights from a file
-bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_vocab & vocab, int max_n_ctx) {
+bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_vocab & vocab, int max_n_ctx, load_timings & load) {
+    int64_t t_start_us = ggml_dadbed9_time_us();
+
     printf("%s: loading model from '%s' - please wait ...\n", __func__, fname.c_str());
 
     auto fin = std::ifstream(fname, std::ios::binary);
@@ -152,6 +154,9 @@ bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_
         hparams.ftype %= GGML_dadbed9_QNT_VERSION_FACTOR;
     }
 
+    load.add(LOAD_PHASE_META, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load vocab
     {
         const int32_t n_vocab = model.hparams.n_vocab;
@@ -172,6 +177,9 @@ bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_
         }
     }
 
+    load.add(LOAD_PHASE_VOCAB, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // for the big tensors, we have the option to store the data in 16-bit floats or quantized
     // in order to save memory and also to speed up the computation
     ggml_dadbed9_type wtype = ggml_dadbed9_ftype_to_ggml_dadbed9_type((ggml_dadbed9_ftype) (model.hparams.ftype));
@@ -219,8 +227,8 @@ bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_
         ctx_size += n_layer*(4*n_embd*n_embd*ggml_dadbed9_type_sizef(wtype));         // c_mlp_proj_w
         ctx_size += n_layer*(         n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32)); // c_mlp_proj_b
 
-        ctx_size += n_ctx*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_k
-        ctx_size += n_ctx*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_v
+        ctx_size += gpt_kv_n_rows(n_ctx)*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_k
+        ctx_size += gpt_kv_n_rows(n_ctx)*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_v
 
         size_t overhead =ggml_dadbed9_tensor_overhead();
         ctx_size += (6 + 16*n_layer)*1024; // object overhead
@@ -320,7 +328,8 @@ bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_
         const int n_layer = hparams.n_layer;
         const int n_ctx   = hparams.n_ctx;
 
-        const int64_t n_mem      = n_layer*n_ctx;
+        // the context window slides over the spare rows, see gpt_kv_window
+        const int64_t n_mem      = n_layer*gpt_kv_n_rows(n_ctx);
         const int64_t n_elements = n_embd*n_mem;
 
         model.memory_k = ggml_dadbed9_new_tensor_1d(ctx, GGML_dadbed9_TYPE_F16, n_elements);
@@ -331,6 +340,9 @@ bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_
         printf("%s: memory_size = %8.2f MB, n_mem = %" PRId64 "\n", __func__, memory_size/1024.0/1024.0, n_mem);
     }
 
+    load.add(LOAD_PHASE_TENSORS, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load weights
     {
         int n_tensors = 0;
@@ -407,6 +419,8 @@ bool gpt_neox_model_load(const std::string & fname, gpt_neox_model & model, gpt_
 
     fin.close();
 
+    load.add(LOAD_PHASE_DATA, t_start_us, ggml_dadbed9_time_us());
+
     return true;
 }
 
@@ -452,6 +466,7 @@ ggml_dadbed9_tensor * gpt_neox_ff(
 //   - model:     the model
 //   - n_threads: number of threads to use
 //   - n_past:    the context size so far
+//   - kv:        where the context window is in the KV cache
 //   - embd_inp:  the embeddings of the tokens in the context
 //   - embd_w:    the predicted logits for the next token
 //
@@ -459,8 +474,10 @@ bool gpt_neox_eval(
         const gpt_neox_model & model,
         const int n_threads,
         const int n_past,
+        const gpt_kv_window & kv,
         const std::vector<gpt_vocab::id> & embd_inp,
               std::vector<float>         & embd_w,
+              bool                         logits_all,
               size_t                     & mem_per_token) {
     const int N = embd_inp.size();
 
@@ -468,11 +485,14 @@ bool gpt_neox_eval(
 
     const int n_embd  = hparams.n_embd;
     const int n_layer = hparams.n_layer;
-    const int n_ctx   = hparams.n_ctx;
     const int n_head  = hparams.n_head;
     const int n_vocab = hparams.n_vocab;
     const int n_rot   = hparams.n_rot;
 
+    // cache rows per layer and the first row of the window
+    const int n_rows  = kv.n_rows;
+    const int kv_head = kv.head;
+
     static size_t buf_size = 256u*1024*1024;
 //    static size_t buf_size = 256u*1024*ggml_dadbed9_tensor_overhead();
     static void * buf = malloc(buf_size);
@@ -546,17 +566,18 @@ bool gpt_neox_eval(
             struct ggml_dadbed9_tensor * Vcur = ggml_dadbed9_cont(ctx0, ggml_dadbed9_view_3d(ctx0, cur, n_embd/n_head, n_head, N, cur->nb[1]/n_head, cur->nb[1], 2*sizeof(float)*n_embd/n_head));
 
             // using mode = 2 for GPT-NeoX mode
-            Qcur = ggml_dadbed9_rope_inplace(ctx0, Qcur, n_past, n_rot, 2, 0);
-            Kcur = ggml_dadbed9_rope_inplace(ctx0, Kcur, n_past, n_rot, 2, 0);
+            // the cached keys keep their positions when the window is shifted, new ones continue after them
+            Qcur = ggml_dadbed9_rope_inplace(ctx0, Qcur, kv.n_shifted + n_past, n_rot, 2, 0);
+            Kcur = ggml_dadbed9_rope_inplace(ctx0, Kcur, kv.n_shifted + n_past, n_rot, 2, 0);
 
             // store key and value to memory
             {
                 Vcur = ggml_dadbed9_transpose(ctx0, ggml_dadbed9_reshape_2d(ctx0, Vcur, n_embd, N));
 
-                struct ggml_dadbed9_tensor * k = ggml_dadbed9_view_1d(ctx0, model.memory_k, N*n_embd, (ggml_dadbed9_element_size(model.memory_k)*n_embd)*(il*n_ctx + n_past));
+                struct ggml_dadbed9_tensor * k = ggml_dadbed9_view_1d(ctx0, model.memory_k, N*n_embd, (ggml_dadbed9_element_size(model.memory_k)*n_embd)*(il*n_rows + kv_head + n_past));
                 struct ggml_dadbed9_tensor * v = ggml_dadbed9_view_2d(ctx0, model.memory_v, N, n_embd,
-                        (   n_ctx)*ggml_dadbed9_element_size(model.memory_v),
-                        (il*n_ctx)*ggml_dadbed9_element_size(model.memory_v)*n_embd + n_past*ggml_dadbed9_element_size(model.memory_v));
+                        (   n_rows)*ggml_dadbed9_element_size(model.memory_v),
+                        (il*n_rows)*ggml_dadbed9_element_size(model.memory_v)*n_embd + (kv_head + n_past)*ggml_dadbed9_element_size(model.memory_v));
 
                 ggml_dadbed9_build_forward_expand(&gf, ggml_dadbed9_cpy(ctx0, Kcur, k));
                 ggml_dadbed9_build_forward_expand(&gf, ggml_dadbed9_cpy(ctx0, Vcur, v));
@@ -572,7 +593,7 @@ bool gpt_neox_eval(
             struct ggml_dadbed9_tensor * K =
                 ggml_dadbed9_permute(ctx0,
                         ggml_dadbed9_reshape_3d(ctx0,
-                            ggml_dadbed9_view_1d(ctx0, model.memory_k, (n_past + N)*n_embd, il*n_ctx*ggml_dadbed9_element_size(model.memory_k)*n_embd),
+                            ggml_dadbed9_view_1d(ctx0, model.memory_k, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_dadbed9_element_size(model.memory_k)*n_embd),
                             n_embd/n_head, n_head, n_past + N),
                         0, 2, 1, 3);
 
@@ -596,9 +617,9 @@ bool gpt_neox_eval(
             struct ggml_dadbed9_tensor * V =
                 ggml_dadbed9_view_3d(ctx0, model.memory_v,
                         n_past + N, n_embd/n_head, n_head,
-                        n_ctx*ggml_dadbed9_element_size(model.memory_v),
-                        n_ctx*ggml_dadbed9_element_size(model.memory_v)*n_embd/n_head,
-                        il*n_ctx*ggml_dadbed9_element_size(model.memory_v)*n_embd);
+                        n_rows*ggml_dadbed9_element_size(model.memory_v),
+                        n_rows*ggml_dadbed9_element_size(model.memory_v)*n_embd/n_head,
+                        il*n_rows*ggml_dadbed9_element_size(model.memory_v)*n_embd + kv_head*ggml_dadbed9_element_size(model.memory_v));
 
             // KQV = transpose(V) * KQ_soft_max
             struct ggml_dadbed9_tensor * KQV = ggml_dadbed9_mul_mat(ctx0, V, KQ_soft_max);
@@ -682,12 +703,15 @@ bool gpt_neox_eval(
     //    ggml_dadbed9_graph_dump_dot(&gf, NULL, "gpt-2.dot");
     //}
 
-    //embd_w.resize(n_vocab*N);
-    //memcpy(embd_w.data(), ggml_dadbed9_get_data(inpL), sizeof(float)*n_vocab*N);
-
-    // return result for just the last token
-    embd_w.resize(n_vocab);
-    memcpy(embd_w.data(), (float *) ggml_dadbed9_get_data(inpL) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+    if (logits_all) {
+        // return result for all tokens
+        embd_w.resize(n_vocab*N);
+        memcpy(embd_w.data(), (float *) ggml_dadbed9_get_data(inpL), sizeof(float)*n_vocab*N);
+    } else {
+        // return result for just the last token
+        embd_w.resize(n_vocab);
+        memcpy(embd_w.data(), (float *) ggml_dadbed9_get_data(inpL) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+    }
 
     if (mem_per_token == 0) {
         mem_per_token = ggml_dadbed9_used_mem(ctx0)/N;
@@ -707,6 +731,7 @@ struct gpt_neox_context * gpt_neox_init_from_file(const char * path_model, struc
     ggml_dadbed9_time_init();
 
     gpt_neox_context * ctx = new gpt_neox_context;
+    ctx->t_start_us = ggml_dadbed9_time_us();
 
     if (params.seed <= 0) {
         params.seed = time(NULL);
@@ -719,12 +744,26 @@ struct gpt_neox_context * gpt_neox_init_from_file(const char * path_model, struc
 
     ggml_dadbed9_type memory_type = params.f16_kv ? GGML_dadbed9_TYPE_F16 : GGML_dadbed9_TYPE_F32;
     
-    if (!gpt_neox_model_load(path_model, ctx->model, ctx->vocab,params.n_ctx)) {
+    if (!gpt_neox_model_load(path_model, ctx->model, ctx->vocab,params.n_ctx, ctx->load)) {
         fprintf(stderr, "%s: failed to load model\n", __func__);
         gpt_neox_free(ctx);
         return nullptr;
     }
 
+    const int64_t t_start_context_us = ggml_dadbed9_time_us();
+
+    // the context window in the KV cache, V is stored transposed
+    {
+        auto & kv = ctx->kv_window;
+        kv.k        = (uint8_t *) ctx->model.memory_k->data;
+        kv.v        = (uint8_t *) ctx->model.memory_v->data;
+        kv.elt_size = ggml_dadbed9_element_size(ctx->model.memory_k);
+        kv.n_embd   = ctx->model.hparams.n_embd;
+        kv.n_layer  = ctx->model.hparams.n_layer;
+        kv.n_rows   = gpt_kv_n_rows(ctx->model.hparams.n_ctx);
+        kv.v_trans  = true;
+    }
+
     // reserve memory for context buffers
     if (!params.vocab_only) {
 //        if (!kv_cache_init(ctx->model.hparams, ctx->model.kv_self, memory_type, ctx->model.hparams.n_ctx)) {
@@ -757,6 +796,8 @@ struct gpt_neox_context * gpt_neox_init_from_file(const char * path_model, struc
 //        ctx->buf_scratch[1].resize(MEM_REQ_SCRATCH1().at(ctx->model.type));
     }
 
+    ctx->load.add(LOAD_PHASE_CONTEXT, t_start_context_us, ggml_dadbed9_time_us());
+
     return ctx;
 }
 
@@ -800,7 +841,8 @@ struct gpt_neox_context * gpt_neox_init_from_file(const char * path_model, struc
 
 int gpt_neox_init_logits(struct gpt_neox_context * ctx,int   n_threads){
     size_t mem_per_token = 0;
-    if (!gpt_neox_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, mem_per_token)) {
+    gpt_kv_window_prepare(&ctx->kv_window, 0, 4);
+    if (!gpt_neox_eval(ctx->model, n_threads, 0, ctx->kv_window, { 0, 1, 2, 3 }, ctx->logits, false, mem_per_token)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -822,7 +864,9 @@ int gpt_neox_eval(
     size_t mem_per_token = 0;
 //    gpt_neox_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, mem_per_token);
     //    if (!gptneox_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads)) {
-    if (!gpt_neox_eval(ctx->model, n_threads, n_past, embd, ctx->logits, mem_per_token)) {
+    const int64_t t_start_us = ggml_dadbed9_time_us();
+    gpt_kv_window_prepare(&ctx->kv_window, n_past, n_tokens);
+    if (!gpt_neox_eval(ctx->model, n_threads, n_past, ctx->kv_window, embd, ctx->logits, ctx->logits_all, mem_per_token)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -830,7 +874,9 @@ int gpt_neox_eval(
     if (!ctx->has_evaluated_once) {
         ctx->t_load_us = ggml_dadbed9_time_us() - ctx->t_start_us;
         ctx->has_evaluated_once = true;
+        ctx->load.add(LOAD_PHASE_FIRST_EVAL, t_start_us, ggml_dadbed9_time_us());
     }
+    gpt_base_eval_done(ctx, n_tokens, n_past, t_start_us);
     return 0;
 }
 
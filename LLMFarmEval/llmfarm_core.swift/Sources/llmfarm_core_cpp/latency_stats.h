@@ -0,0 +1,190 @@
+// Latency distributions of the inference contexts (llama_context and gpt_base_context).
+//
+// The cumulative counters (t_eval_us / n_eval, ...) give the mean only. latency_tracker keeps a
+// histogram per kind of step so that the tail latency and the time to first token can be read
+// back at any time, see llama_get_latency_stats() and gpt_base_get_latency_stats().
+
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Histogram of durations in microseconds with buckets of bounded relative width, in the manner
+// of HdrHistogram: the values below 2^SUB_BITS get a bucket each, above that every power of two
+// is split in 2^SUB_BITS buckets, so a value is known to within 1/2^SUB_BITS (6%) of itself.
+// Values from 2^(MAX_BITS + 1) us (25 days) on land in the last bucket.
+struct latency_histogram {
+    static const int SUB_BITS  = 4;
+    static const int MAX_BITS  = 40;
+    static const int N_SUB     = 1 << SUB_BITS;
+    static const int N_BUCKETS = (MAX_BITS - SUB_BITS + 2)*N_SUB;
+
+    uint32_t counts[N_BUCKETS];
+
+    int64_t n;
+    int64_t sum_us;
+    int64_t min_us;
+    int64_t max_us;
+
+    latency_histogram() {
+        reset();
+    }
+
+    void reset() {
+        memset(counts, 0, sizeof(counts));
+        n      = 0;
+        sum_us = 0;
+        min_us = 0;
+        max_us = 0;
+    }
+
+    static int bucket(int64_t v) {
+        if (v < N_SUB) {
+            return (int) std::max<int64_t>(v, 0);
+        }
+        int e = SUB_BITS;
+        while (e < MAX_BITS && (v >> e) >= 2) {
+            e++;
+        }
+        if ((v >> e) >= 2) {
+            return N_BUCKETS - 1;
+        }
+        return (e - SUB_BITS + 1)*N_SUB + (int) (v >> (e - SUB_BITS)) - N_SUB;
+    }
+
+    // the values of bucket i are in [bucket_lo(i), bucket_lo(i) + bucket_width(i))
+    static int64_t bucket_lo(int i) {
+        if (i < N_SUB) {
+            return i;
+        }
+        const int e = i/N_SUB + SUB_BITS - 1;
+        return (int64_t) (i%N_SUB + N_SUB) << (e - SUB_BITS);
+    }
+
+    static int64_t bucket_width(int i) {
+        return i < N_SUB ? 1 : (int64_t) 1 << (i/N_SUB - 1);
+    }
+
+    void add(int64_t us) {
+        us = std::max<int64_t>(us, 0);
+        counts[bucket(us)]++;
+        min_us  = n == 0 ? us : std::min(min_us, us);
+        max_us  = n == 0 ? us : std::max(max_us, us);
+        sum_us += us;
+        n++;
+    }
+
+    double mean_us() const {
+        return n > 0 ? (double) sum_us/n : 0.0;
+    }
+
+    // the value that p percent of the samples do not exceed, the middle of its bucket
+    double percentile_us(double p) const {
+        if (n == 0) {
+            return 0.0;
+        }
+        const int64_t rank = std::max<int64_t>(1, (int64_t) (p/100.0*n + 0.5));
+        int64_t seen = 0;
+        for (int i = 0; i < N_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                const double mid = bucket_lo(i) + 0.5*(bucket_width(i) - 1);
+                return std::min(std::max(mid, (double) min_us), (double) max_us);
+            }
+        }
+        return (double) max_us;
+    }
+};
+
+// The steps of a conversation turn: the prompt is evaluated in one or more batches, then tokens
+// are sampled and evaluated one at a time.
+//
+// A turn starts with the first eval after creation or reset, with every eval at n_past 0, and with
+// every eval of more than one token after a token was sampled. Its time to first token runs from
+// the start of that eval to the end of the first sampling of a token, the inter-token latency from
+// one sampled token to the next, so it includes the eval and the caller's own work in between.
+enum latency_kind {
+    LATENCY_TOKEN,       // between two sampled tokens of a turn
+    LATENCY_EVAL,        // single token evals
+    LATENCY_P_EVAL,      // prompt batches (evals of more than one token)
+    LATENCY_SAMPLE,      // all sampling calls since the previous sampled token
+    LATENCY_FIRST_TOKEN, // time to first token of each turn
+    LATENCY_COUNT,
+};
+
+struct latency_tracker {
+    latency_histogram hist[LATENCY_COUNT];
+
+    int64_t t_first_token_us = 0;  // time to first token of the last turn
+
+    bool    in_turn      = false;
+    bool    turn_sampled = false;   // a token was sampled in the current turn
+    int64_t t_turn_start_us = 0;
+    int64_t t_last_token_us = 0;
+    int64_t t_sample_us_last = 0;   // the cumulative sampling time at the previous sampled token
+
+    void reset() {
+        for (auto & h : hist) {
+            h.reset();
+        }
+        t_first_token_us = 0;
+        in_turn          = false;
+        turn_sampled     = false;
+        t_sample_us_last = 0;
+    }
+
+    void eval_begin(int n_tokens, int n_past, int64_t t_start_us) {
+        if (!in_turn || n_past == 0 || (n_tokens > 1 && turn_sampled)) {
+            in_turn         = true;
+            turn_sampled    = false;
+            t_turn_start_us = t_start_us;
+        }
+    }
+
+    void eval_end(int n_tokens, int64_t t_us) {
+        hist[n_tokens > 1 ? LATENCY_P_EVAL : LATENCY_EVAL].add(t_us);
+    }
+
+    // t_sample_us is the cumulative sampling time of the context, including this token
+    void token_sampled(int64_t t_now_us, int64_t t_sample_us) {
+        hist[LATENCY_SAMPLE].add(t_sample_us - t_sample_us_last);
+        t_sample_us_last = t_sample_us;
+
+        if (in_turn && !turn_sampled) {
+            t_first_token_us = t_now_us - t_turn_start_us;
+            hist[LATENCY_FIRST_TOKEN].add(t_first_token_us);
+            turn_sampled = true;
+        } else if (in_turn) {
+            hist[LATENCY_TOKEN].add(t_now_us - t_last_token_us);
+        }
+        t_last_token_us = t_now_us;
+    }
+
+    // the rest of llama_dump_timing_info_yaml() and gpt_base_dump_timing_info_yaml()
+    void dump_yaml(FILE * stream) const {
+        static const char * names[LATENCY_COUNT] = { "token", "eval", "p_eval", "sample", "first_token" };
+        static const char * descs[LATENCY_COUNT] = {
+            "between two sampled tokens of a turn",
+            "single token evals",
+            "prompt batch evals",
+            "sampling per sampled token",
+            "time to first token per turn",
+        };
+
+        fprintf(stream, "ttft_ms: %.2f  # time to first token of the last turn\n", 1.0e-3 * t_first_token_us);
+        for (int i = 0; i < LATENCY_COUNT; i++) {
+            const latency_histogram & h = hist[i];
+            fprintf(stream, "latency_%s_ms:  # %s\n", names[i], descs[i]);
+            fprintf(stream, "  n: %" PRId64 "\n", h.n);
+            fprintf(stream, "  min: %.3f\n",  1.0e-3 * h.min_us);
+            fprintf(stream, "  mean: %.3f\n", 1.0e-3 * h.mean_us());
+            fprintf(stream, "  p50: %.3f\n",  1.0e-3 * h.percentile_us(50.0));
+            fprintf(stream, "  p90: %.3f\n",  1.0e-3 * h.percentile_us(90.0));
+            fprintf(stream, "  p99: %.3f\n",  1.0e-3 * h.percentile_us(99.0));
+            fprintf(stream, "  max: %.3f\n",  1.0e-3 * h.max_us);
+        }
+    }
+};
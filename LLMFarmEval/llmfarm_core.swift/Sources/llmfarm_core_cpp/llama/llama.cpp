@@ -4,6 +4,10 @@
 #include "../ggml/ggml.h"
 
 #include "../ggml/ggml-alloc.h"
+#include "../latency_stats.h"
+#include "../autotune.h"
+#include "../load_timings.h"
+#include "../throttle.h"
 
 #ifdef GGML_USE_CUBLAS
 #  include "ggml-cuda.h"
@@ -39,6 +43,10 @@
     #endif
 #endif
 
+#if defined(__APPLE__)
+    #include <sys/sysctl.h>
+#endif
+
 #if defined(_WIN32)
     #define WIN32_LEAN_AND_MEAN
     #ifndef NOMINMAX
@@ -51,6 +59,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
 #include <climits>
@@ -466,8 +475,9 @@ struct LLM_TN {
 // ggml helpers
 //
 
-static void ggml_graph_compute_helper(std::vector<uint8_t> & buf, ggml_cgraph * graph, int n_threads) {
+static void ggml_graph_compute_helper(std::vector<uint8_t> & buf, ggml_cgraph * graph, int n_threads, ggml_profile * profile = nullptr) {
     struct ggml_cplan plan = ggml_graph_plan(graph, n_threads);
+    plan.profile = profile;
 
     if (plan.work_size > 0) {
         buf.resize(plan.work_size);
@@ -614,6 +624,20 @@ struct llama_file {
         write_raw(&val, sizeof(val));
     }
 
+    // cuts the file at new_size, the position is undefined afterwards
+    void truncate(size_t new_size) {
+        std::fflush(fp);
+#ifdef _WIN32
+        const int ret = _chsize_s(_fileno(fp), (__int64) new_size);
+#else
+        const int ret = ftruncate(fileno(fp), (off_t) new_size);
+#endif
+        if (ret != 0) {
+            throw std::runtime_error(format("failed to truncate file: %s", strerror(errno)));
+        }
+        size = new_size;
+    }
+
     ~llama_file() {
         if (fp) {
             std::fclose(fp);
@@ -729,6 +753,36 @@ struct llama_mmap {
 #endif
 };
 
+// bytes of [addr, addr + size) in physical memory, all of them where this cannot be queried
+static size_t llama_resident_size(const void * addr, size_t size) {
+    if (addr == NULL || size == 0) {
+        return 0;
+    }
+#ifdef _POSIX_MAPPED_FILES
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin  = (uintptr_t) addr / page_size * page_size;
+    const uintptr_t end    = (uintptr_t) addr + size;
+    const size_t    n_pages = (end - begin + page_size - 1) / page_size;
+
+#ifdef __APPLE__
+    std::vector<char> vec(n_pages);
+#else
+    std::vector<unsigned char> vec(n_pages);
+#endif
+    if (mincore((void *) begin, end - begin, vec.data()) != 0) {
+        return size;
+    }
+
+    size_t n_resident = 0;
+    for (size_t i = 0; i < n_pages; i++) {
+        n_resident += vec[i] & 1;
+    }
+    return std::min(size, n_resident*page_size);
+#else
+    return size;
+#endif
+}
+
 // Represents some region of memory being locked using mlock or VirtualLock;
 // will automatically unlock on destruction.
 struct llama_mlock {
@@ -1015,6 +1069,11 @@ struct llama_kv_cache {
 
     int n; // number of tokens currently in the cache
 
+    // V is stored transposed, one row of n_ctx elements per embedding dimension, so that the
+    // attention reads it with mul_mat; otherwise it has one row per token, like K, and the
+    // attention uses out_prod (CPU only)
+    bool v_trans = true;
+
     ~llama_kv_cache() {
         if (ctx) {
             ggml_free(ctx);
@@ -1027,11 +1086,19 @@ struct llama_kv_cache {
     }
 };
 
+// a new one for every vocab, caches that outlive the model tell the vocabs apart by it
+static uint64_t llama_vocab_next_generation() {
+    static std::atomic<uint64_t> generation{0};
+    return ++generation;
+}
+
 struct llama_vocab {
     using id    = int32_t;
     using token = std::string;
     using ttype = llama_token_type;
 
+    const uint64_t generation = llama_vocab_next_generation();
+
     struct token_data {
         token text;
         float score;
@@ -1109,6 +1176,9 @@ struct llama_model {
     int64_t t_load_us = 0;
     int64_t t_start_us = 0;
 
+    // the phases of llama_model_load, the context adds its own
+    load_timings load;
+
     ~llama_model() {
         if (ctx) {
             ggml_free(ctx);
@@ -1128,7 +1198,7 @@ struct llama_model {
 };
 
 struct llama_context {
-    llama_context(const llama_model & model) : model(model), t_load_us(model.t_load_us), t_start_us(model.t_start_us) {}
+    llama_context(const llama_model & model) : model(model), t_load_us(model.t_load_us), t_start_us(model.t_start_us), load(model.load) {}
     ~llama_context() {
         if (model_owner) {
             delete &model;
@@ -1141,6 +1211,7 @@ struct llama_context {
         if (alloc) {
             ggml_allocr_free(alloc);
         }
+        ggml_profile_free(profile);
     }
 
     std::mt19937 rng;
@@ -1155,6 +1226,13 @@ struct llama_context {
     int32_t n_eval   = 0; // number of eval calls
     int32_t n_p_eval = 0; // number of tokens in eval calls for the prompt (with batch size > 1)
 
+    int64_t t_pause_us  = 0;
+    int32_t n_pause     = 0; // evals paused by the throttle
+    int32_t n_throttled = 0; // evals run with fewer threads by the throttle
+
+    // distributions of the above per step, and the time to first token
+    latency_tracker latency;
+
     const llama_model & model;
 
     bool model_owner = false;
@@ -1162,6 +1240,9 @@ struct llama_context {
     int64_t t_load_us;
     int64_t t_start_us;
 
+    // the phases of loading the model and creating this context, see llama_get_load_timings
+    load_timings load;
+
     // key + value cache for the self attention
     struct llama_kv_cache kv_self;
 
@@ -1172,9 +1253,38 @@ struct llama_context {
     // input embedding (1-dimensional array: [n_embd])
     std::vector<float> embedding;
 
+    // active token mask, one bit per vocab id (see llama_token_mask_*)
+    std::vector<uint32_t> token_mask;
+
+    // KV layout of a batched beam search step, n_slots == 0 for regular evaluation
+    // the cache holds the prefix shared by all beams in rows [0, n_past), followed by n_blocks
+    // blocks of n_slots rows: row n_past + j*n_slots + s holds the j-th private token of slot s
+    // the N tokens of a step are one per slot, all at position n_past + n_blocks
+    struct {
+        int n_slots  = 0;
+        int n_blocks = 0;
+    } beam_layout;
+
     // reusable buffer for `struct ggml_graph_plan.work_data`
     std::vector<uint8_t> work_buffer;
 
+    // per-node timings of the evaluations on the CPU, see llama_set_profiling
+    ggml_profile * profile = NULL;
+    bool profiling = false;
+
+    // the largest batch the compute buffer is sized for
+    int n_batch = 0;
+
+    // thread count and prompt batch size of llama_eval, see llama_set_autotune
+    eval_autotuner autotune;
+    std::string    autotune_path;
+    std::string    autotune_key;
+
+    // pauses and thread counts of llama_eval under heat, see llama_set_throttle
+    eval_throttle            throttle;
+    llama_throttle_policy_fn throttle_policy           = NULL;
+    void *                   throttle_policy_user_data = NULL;
+
     // memory buffers used to evaluate the model
     llama_buffer buf_compute;
 
@@ -1199,7 +1309,8 @@ static bool llama_kv_cache_init(
              struct llama_kv_cache & cache,
                          ggml_type   wtype,
                                int   n_ctx,
-                               int   n_gpu_layers) {
+                               int   n_gpu_layers,
+                              bool   v_trans) {
     const int n_embd  = hparams.n_embd_gqa();
     const int n_layer = hparams.n_layer;
 
@@ -1208,6 +1319,7 @@ static bool llama_kv_cache_init(
 
     cache.buf.resize(2u*n_elements*ggml_type_size(wtype) + 2u*MB);
     cache.n = 0;
+    cache.v_trans = v_trans;
 
     struct ggml_init_params params;
     params.mem_size   = cache.buf.size;
@@ -1512,11 +1624,31 @@ struct llama_model_loader {
         }
     }
 
-    void load_all_data(struct ggml_context * ctx, llama_progress_callback progress_callback, void * progress_callback_user_data, llama_mlock * lmlock) {
+    // the matrices that only mul_mat reads can have their rows interleaved for the CPU kernels,
+    // see ggml_repack(); the embeddings are read by get_rows
+    static bool can_repack(const struct ggml_tensor * cur) {
+        return cur->backend == GGML_BACKEND_CPU && cur->n_dims == 2 &&
+            strcmp(ggml_get_name(cur), "token_embd.weight") != 0 &&
+            strcmp(ggml_get_name(cur), "position_embd.weight") != 0;
+    }
+
+    void load_all_data(struct ggml_context * ctx, llama_progress_callback progress_callback, void * progress_callback_user_data, llama_mlock * lmlock, bool repack, load_timings & load) {
+        const int64_t t_start_us = ggml_time_us();
+
         size_t size_data = 0;
         size_t size_lock = 0;
         size_t size_pref = 0; // prefetch
 
+        if (repack && use_mmap) {
+            LLAMA_LOG_WARN("%s: the weights are mapped from the file, not repacking them\n", __func__);
+            repack = false;
+        }
+
+        int     n_repacked    = 0;
+        size_t  size_repacked = 0;
+        int64_t t_repack_us   = 0;
+        int64_t t_mlock_us    = 0;
+
         for (int i = 0; i < gguf_get_n_tensors(ctx_gguf); i++) {
             struct ggml_tensor * cur = ggml_get_tensor(ctx, gguf_get_tensor_name(ctx_gguf, i));
             size_data += ggml_nbytes(cur);
@@ -1553,11 +1685,26 @@ struct llama_model_loader {
 
             load_data_for(cur);
 
+            if (repack && can_repack(cur)) {
+                const int64_t t_start_us = ggml_time_us();
+
+                if (ggml_repack(cur)) {
+                    n_repacked    += 1;
+                    size_repacked += ggml_nbytes(cur);
+                }
+
+                t_repack_us += ggml_time_us() - t_start_us;
+            }
+
             switch (cur->backend) {
                 case GGML_BACKEND_CPU:
                     if (use_mmap && lmlock) {
+                        const int64_t t_start_lock_us = ggml_time_us();
+
                         size_lock += ggml_nbytes(cur);
                         lmlock->grow_to(size_lock);
+
+                        t_mlock_us += ggml_time_us() - t_start_lock_us;
                     }
                     break;
 #if defined(GGML_USE_CUBLAS)
@@ -1586,6 +1733,15 @@ struct llama_model_loader {
 
             done_size += ggml_nbytes(cur);
         }
+
+        if (repack) {
+            LLAMA_LOG_INFO("%s: repacked %d tensors (%.2f MB) in %.2f ms\n", __func__,
+                    n_repacked, size_repacked/1024.0/1024.0, t_repack_us/1000.0);
+        }
+
+        load.t_us[LOAD_PHASE_DATA]   += ggml_time_us() - t_start_us - t_repack_us - t_mlock_us;
+        load.t_us[LOAD_PHASE_REPACK] += t_repack_us;
+        load.t_us[LOAD_PHASE_MLOCK]  += t_mlock_us;
     }
 };
 
@@ -1942,6 +2098,7 @@ static void llm_load_tensors(
         bool low_vram,
         ggml_type memory_type,
         bool use_mlock,
+        bool repack,
         llama_progress_callback progress_callback,
         void * progress_callback_user_data) {
     model.t_start_us = ggml_time_us();
@@ -1958,12 +2115,18 @@ static void llm_load_tensors(
 
     LLAMA_LOG_INFO("%s: ggml ctx size = %7.2f MB\n", __func__, ctx_size/1024.0/1024.0);
 
+    int64_t t_mlock_us = 0;
+
     // create the ggml context
     {
         model.buf.resize(ctx_size);
         if (use_mlock) {
+            const int64_t t_start_lock_us = ggml_time_us();
+
             model.mlock_buf.init   (model.buf.data);
             model.mlock_buf.grow_to(model.buf.size);
+
+            t_mlock_us = ggml_time_us() - t_start_lock_us;
         }
 
         struct ggml_init_params params = {
@@ -2375,7 +2538,15 @@ static void llm_load_tensors(
     }
 #endif
 
-    ml.load_all_data(ctx, progress_callback, progress_callback_user_data, use_mlock ? &model.mlock_mmap : NULL);
+#ifdef GGML_USE_METAL
+    // the Metal kernels read the weights in the layout of the file
+    repack = repack && n_gpu_layers == 0;
+#endif
+
+    model.load.t_us[LOAD_PHASE_TENSORS] += ggml_time_us() - model.t_start_us - t_mlock_us;
+    model.load.t_us[LOAD_PHASE_MLOCK]   += t_mlock_us;
+
+    ml.load_all_data(ctx, progress_callback, progress_callback_user_data, use_mlock ? &model.mlock_mmap : NULL, repack, model.load);
 
     if (progress_callback) {
         progress_callback(1.0f, progress_callback_user_data);
@@ -2404,17 +2575,29 @@ static bool llama_model_load(
         bool use_mmap,
         bool use_mlock,
         bool vocab_only,
+        bool repack,
         llama_progress_callback progress_callback,
         void *progress_callback_user_data) {
     try {
+        int64_t t_start_us = ggml_time_us();
+
         std::unique_ptr<llama_model_loader> ml(new llama_model_loader(fname, use_mmap));
 
         llm_load_arch   (*ml, model);
         llm_load_hparams(*ml, model, n_ctx, rope_freq_base, rope_freq_scale);
+
+        model.load.add(LOAD_PHASE_META, t_start_us, ggml_time_us());
+        t_start_us = ggml_time_us();
+
         llm_load_vocab  (*ml, model);
 
+        model.load.add(LOAD_PHASE_VOCAB, t_start_us, ggml_time_us());
+        t_start_us = ggml_time_us();
+
         llm_load_print_meta(*ml, model);
 
+        model.load.add(LOAD_PHASE_META, t_start_us, ggml_time_us());
+
         if (model.hparams.n_vocab != model.vocab.id_to_token.size()) {
             throw std::runtime_error("vocab size mismatch");
         }
@@ -2427,7 +2610,7 @@ static bool llama_model_load(
         llm_load_tensors(
                 *ml, model, n_batch, n_gpu_layers,
                 main_gpu, tensor_split, mul_mat_q, low_vram, memory_type,
-                use_mlock, progress_callback, progress_callback_user_data);
+                use_mlock, repack, progress_callback, progress_callback_user_data);
     } catch (const std::exception & err) {
         LLAMA_LOG_ERROR("error loading model: %s\n", err.what());
         return false;
@@ -2470,6 +2653,23 @@ static struct ggml_cgraph * llm_build_llama(
 
     const int n_gpu_layers = model.n_gpu_layers;
 
+    // the fused norm, feed forward and KV store ops have CPU kernels only
+#if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST) || defined(GGML_USE_METAL)
+    const bool fuse_ops = n_gpu_layers == 0;
+#else
+    const bool fuse_ops = true;
+#endif
+
+    // in a beam search step the tokens go one per slot instead of one after another
+    const auto & beams = lctx.beam_layout;
+
+    const int n_kv    = beams.n_slots ? n_past + (beams.n_blocks + 1)*beams.n_slots : n_past + N; // KV rows attended to
+    const int kv_head = beams.n_slots ? n_past +  beams.n_blocks     *beams.n_slots : n_past;     // first KV row written
+    const int n_pos   = beams.n_slots ? n_past +  beams.n_blocks                     : n_past;     // position of the first token
+
+    // tokens sharing a position are grouped along dim 2 so RoPE rotates them alike
+    const int n_pos_rows = beams.n_slots ? 1 : N;
+
     auto & buf_compute = lctx.buf_compute;
 
     struct ggml_init_params params = {
@@ -2510,6 +2710,25 @@ static struct ggml_cgraph * llm_build_llama(
         }
     }
 
+    // KQ_mask restricts each beam slot to the shared prefix and its own private rows
+    struct ggml_tensor * KQ_mask = NULL;
+    if (beams.n_slots) {
+        KQ_mask = ggml_new_tensor_3d(ctx0, GGML_TYPE_F32, n_kv, N, n_head);
+        ggml_allocr_alloc(lctx.alloc, KQ_mask);
+        if (!ggml_allocr_is_measure(lctx.alloc)) {
+            float * data = (float *) KQ_mask->data;
+            for (int i = 0; i < N; ++i) {
+                for (int j = 0; j < n_kv; ++j) {
+                    data[i*n_kv + j] = j < n_past || (j - n_past) % beams.n_slots == i ? 0.0f : -INFINITY;
+                }
+            }
+            for (int h = 1; h < n_head; ++h) {
+                memcpy(data + h*N*n_kv, data, N*n_kv*sizeof(float));
+            }
+        }
+        ggml_set_name(KQ_mask, "KQ_mask");
+    }
+
     const int i_gpu_start = n_layer - n_gpu_layers;
     (void) i_gpu_start;
 
@@ -2555,7 +2774,10 @@ static struct ggml_cgraph * llm_build_llama(
         struct ggml_tensor * inpSA = inpL;
 
         // norm
-        {
+        if (fuse_ops) {
+            cur = ggml_rms_norm_mul(ctx0, inpL, model.layers[il].attn_norm, norm_rms_eps);
+            ggml_set_name(cur, "attention_norm_0");
+        } else {
             cur = ggml_rms_norm(ctx0, inpL, norm_rms_eps);
             offload_func(cur);
             ggml_set_name(cur, "rms_norm_0");
@@ -2577,48 +2799,63 @@ static struct ggml_cgraph * llm_build_llama(
             offload_func_kq(tmpq);
             ggml_set_name(tmpq, "tmpq");
 
-            struct ggml_tensor * Kcur = ggml_rope_custom_inplace(ctx0, ggml_reshape_3d(ctx0, tmpk, n_embd_head, n_head_kv, N), n_past, n_embd_head, 0, 0, freq_base, freq_scale);
+            // with the fused ops K is rotated on its way into the cache, see below
+            struct ggml_tensor * Kcur = ggml_reshape_4d(ctx0, tmpk, n_embd_head, n_head_kv, n_pos_rows, N/n_pos_rows);
+            if (!fuse_ops) {
+                Kcur = ggml_rope_custom_inplace(ctx0, Kcur, n_pos, n_embd_head, 0, 0, freq_base, freq_scale);
+            }
             offload_func_kq(Kcur);
             ggml_set_name(Kcur, "Kcur");
 
-            struct ggml_tensor * Qcur = ggml_rope_custom_inplace(ctx0, ggml_reshape_3d(ctx0, tmpq, n_embd_head, n_head, N),    n_past, n_embd_head, 0, 0, freq_base, freq_scale);
+            struct ggml_tensor * Qcur = ggml_rope_custom_inplace(ctx0, ggml_reshape_4d(ctx0, tmpq, n_embd_head, n_head,    n_pos_rows, N/n_pos_rows), n_pos, n_embd_head, 0, 0, freq_base, freq_scale);
             offload_func_kq(Qcur);
             ggml_set_name(Qcur, "Qcur");
 
             // store key and value to memory
             {
-                // compute the transposed [N, n_embd] V matrix
+                // compute the [n_embd, N] V matrix, transposed for the transposed cache
 
                 struct ggml_tensor * tmpv = ggml_mul_mat(ctx0, model.layers[il].wv, cur);
                 offload_func_v(tmpv);
                 ggml_set_name(tmpv, "tmpv");
 
-                struct ggml_tensor * Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, tmpv, n_embd_gqa, N));
+                struct ggml_tensor * Vcur = ggml_reshape_2d(ctx0, tmpv, n_embd_gqa, N);
+                if (kv_self.v_trans) {
+                    Vcur = ggml_transpose(ctx0, Vcur);
+                }
                 offload_func_v(Vcur);
                 ggml_set_name(Vcur, "Vcur");
 
-                struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd_gqa, (ggml_element_size(kv_self.k)*n_embd_gqa)*(il*n_ctx + n_past));
+                struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd_gqa, (ggml_element_size(kv_self.k)*n_embd_gqa)*(il*n_ctx + kv_head));
                 offload_func_kq(k);
                 ggml_set_name(k, "k");
 
-                struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
+                struct ggml_tensor * v = kv_self.v_trans
+                    ? ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
                         (   n_ctx)*ggml_element_size(kv_self.v),
-                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v));
+                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + kv_head*ggml_element_size(kv_self.v))
+                    : ggml_view_2d(ctx0, kv_self.v, n_embd_gqa, N,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        (ggml_element_size(kv_self.v)*n_embd_gqa)*(il*n_ctx + kv_head));
                 offload_func_v(v);
                 ggml_set_name(v, "v");
 
                 // important: storing RoPE-ed version of K in the KV cache!
-                ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
-                ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
+                if (fuse_ops) {
+                    ggml_build_forward_expand(gf, ggml_rope_kv(ctx0, Kcur, Vcur, k, v, n_pos, n_embd_head, 0, freq_base, freq_scale));
+                } else {
+                    ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
+                    ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
+                }
             }
 
-            struct ggml_tensor * Q = ggml_permute(ctx0, Qcur, 0, 2, 1, 3);
+            struct ggml_tensor * Q = ggml_permute(ctx0, ggml_reshape_3d(ctx0, Qcur, n_embd_head, n_head, N), 0, 2, 1, 3);
             offload_func_kq(Q);
             ggml_set_name(Q, "Q");
 
             struct ggml_tensor * K =
                 ggml_view_3d(ctx0, kv_self.k,
-                        n_embd_head, n_past + N, n_head_kv,
+                        n_embd_head, n_kv, n_head_kv,
                         ggml_element_size(kv_self.k)*n_embd_gqa,
                         ggml_element_size(kv_self.k)*n_embd_head,
                         ggml_element_size(kv_self.k)*n_embd_gqa*n_ctx*il);
@@ -2631,13 +2868,13 @@ static struct ggml_cgraph * llm_build_llama(
             ggml_set_name(KQ, "KQ");
 
             // KQ_scaled = KQ / sqrt(n_embd_head)
-            // KQ_scaled shape [n_past + N, N, n_head, 1]
+            // KQ_scaled shape [n_kv, N, n_head, 1]
             struct ggml_tensor * KQ_scaled = ggml_scale_inplace(ctx0, KQ, KQ_scale);
             offload_func_kq(KQ_scaled);
             ggml_set_name(KQ_scaled, "KQ_scaled");
 
             // KQ_masked = mask_past(KQ_scaled)
-            struct ggml_tensor * KQ_masked = ggml_diag_mask_inf_inplace(ctx0, KQ_scaled, n_past);
+            struct ggml_tensor * KQ_masked = KQ_mask ? ggml_add_inplace(ctx0, KQ_scaled, KQ_mask) : ggml_diag_mask_inf_inplace(ctx0, KQ_scaled, n_past);
             offload_func_kq(KQ_masked);
             ggml_set_name(KQ_masked, "KQ_masked");
 
@@ -2647,26 +2884,27 @@ static struct ggml_cgraph * llm_build_llama(
             ggml_set_name(KQ_soft_max, "KQ_soft_max");
 
             // split cached V into n_head heads
-            struct ggml_tensor * V =
-                ggml_view_3d(ctx0, kv_self.v,
-                        n_past + N, n_embd_head, n_head_kv,
+            struct ggml_tensor * V = kv_self.v_trans
+                ? ggml_view_3d(ctx0, kv_self.v,
+                        n_kv, n_embd_head, n_head_kv,
                         ggml_element_size(kv_self.v)*n_ctx,
                         ggml_element_size(kv_self.v)*n_ctx*n_embd_head,
-                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il);
+                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il)
+                : ggml_view_3d(ctx0, kv_self.v,
+                        n_embd_head, n_kv, n_head_kv,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        ggml_element_size(kv_self.v)*n_embd_head,
+                        ggml_element_size(kv_self.v)*n_embd_gqa*n_ctx*il);
             offload_func_v(V);
             ggml_set_name(V, "V");
 
-#if 1
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V, KQ_soft_max);
+            // with the row-major cache the rows of V are read in order, each one scaled by
+            // its column of KQ_soft_max, instead of dotting the strided columns of V with it
+            struct ggml_tensor * KQV = kv_self.v_trans
+                ? ggml_mul_mat(ctx0, V, KQ_soft_max)
+                : ggml_out_prod(ctx0, V, ggml_transpose(ctx0, KQ_soft_max));
             offload_func_v(KQV);
             ggml_set_name(KQV, "KQV");
-#else
-            // make V contiguous in memory to speed up the matmul, however we waste time on the copy
-            // on M1 this is faster for the perplexity computation, but ~5% slower for the single-token generation
-            // is there a better way?
-            struct ggml_tensor * V_cont = ggml_cpy(ctx0, V, ggml_new_tensor_3d(ctx0, kv_self.v->type, n_past + N, n_embd_head, n_head));
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V_cont, KQ_soft_max);
-#endif
 
             // KQV_merged = KQV.permute(0, 2, 1, 3)
             struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
@@ -2695,7 +2933,10 @@ static struct ggml_cgraph * llm_build_llama(
         // feed-forward network
         {
             // norm
-            {
+            if (fuse_ops) {
+                cur = ggml_rms_norm_mul(ctx0, inpFF, model.layers[il].ffn_norm, norm_rms_eps);
+                ggml_set_name(cur, "ffn_norm");
+            } else {
                 cur = ggml_rms_norm(ctx0, inpFF, norm_rms_eps);
                 offload_func(cur);
                 ggml_set_name(cur, "rms_norm_1");
@@ -2719,12 +2960,16 @@ static struct ggml_cgraph * llm_build_llama(
             ggml_set_name(cur, "result_w1");
 
             // SILU activation
-            cur = ggml_silu(ctx0, cur);
-            offload_func(cur);
-            ggml_set_name(cur, "silu");
+            if (fuse_ops) {
+                cur = ggml_swiglu(ctx0, cur, tmp);
+            } else {
+                cur = ggml_silu(ctx0, cur);
+                offload_func(cur);
+                ggml_set_name(cur, "silu");
 
-            cur = ggml_mul(ctx0, cur, tmp);
-            offload_func(cur);
+                cur = ggml_mul(ctx0, cur, tmp);
+                offload_func(cur);
+            }
             ggml_set_name(cur, "silu_x_result_w3");
 
             cur = ggml_mul_mat(ctx0,
@@ -2745,7 +2990,10 @@ static struct ggml_cgraph * llm_build_llama(
     cur = inpL;
 
     // norm
-    {
+    if (fuse_ops) {
+        cur = ggml_rms_norm_mul(ctx0, cur, model.output_norm, norm_rms_eps);
+        ggml_set_name(cur, "result_norm");
+    } else {
         cur = ggml_rms_norm(ctx0, cur, norm_rms_eps);
         offload_func_nr(cur);
         ggml_set_name(cur, "rms_norm_2");
@@ -2802,6 +3050,13 @@ static struct ggml_cgraph * llm_build_baichaun(
 
     const int n_gpu_layers = model.n_gpu_layers;
 
+    // the fused norm, feed forward and KV store ops have CPU kernels only
+#if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST) || defined(GGML_USE_METAL)
+    const bool fuse_ops = n_gpu_layers == 0;
+#else
+    const bool fuse_ops = true;
+#endif
+
     auto & buf_compute = lctx.buf_compute;
 
     struct ggml_init_params params = {
@@ -2887,7 +3142,10 @@ static struct ggml_cgraph * llm_build_baichaun(
         struct ggml_tensor * inpSA = inpL;
 
         // norm
-        {
+        if (fuse_ops) {
+            cur = ggml_rms_norm_mul(ctx0, inpL, model.layers[il].attn_norm, norm_rms_eps);
+            ggml_set_name(cur, "attention_norm_0");
+        } else {
             cur = ggml_rms_norm(ctx0, inpL, norm_rms_eps);
             offload_func(cur);
             ggml_set_name(cur, "rms_norm_0");
@@ -2913,7 +3171,11 @@ static struct ggml_cgraph * llm_build_baichaun(
             struct ggml_tensor * Qcur;
             switch (model.type) {
                 case MODEL_7B:
-                    Kcur = ggml_rope_custom_inplace(ctx0, ggml_reshape_3d(ctx0, tmpk, n_embd_head, n_head_kv, N), n_past, n_embd_head, 0, 0, freq_base, freq_scale);
+                    // with the fused ops K is rotated on its way into the cache, see below
+                    Kcur = ggml_reshape_3d(ctx0, tmpk, n_embd_head, n_head_kv, N);
+                    if (!fuse_ops) {
+                        Kcur = ggml_rope_custom_inplace(ctx0, Kcur, n_past, n_embd_head, 0, 0, freq_base, freq_scale);
+                    }
                     Qcur = ggml_rope_custom_inplace(ctx0, ggml_reshape_3d(ctx0, tmpq, n_embd_head, n_head, N),    n_past, n_embd_head, 0, 0, freq_base, freq_scale);
                     break;
                 case MODEL_13B:
@@ -2932,13 +3194,16 @@ static struct ggml_cgraph * llm_build_baichaun(
 
             // store key and value to memory
             {
-                // compute the transposed [N, n_embd] V matrix
+                // compute the [n_embd, N] V matrix, transposed for the transposed cache
 
                 struct ggml_tensor * tmpv = ggml_mul_mat(ctx0, model.layers[il].wv, cur);
                 offload_func_v(tmpv);
                 ggml_set_name(tmpv, "tmpv");
 
-                struct ggml_tensor * Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, tmpv, n_embd_gqa, N));
+                struct ggml_tensor * Vcur = ggml_reshape_2d(ctx0, tmpv, n_embd_gqa, N);
+                if (kv_self.v_trans) {
+                    Vcur = ggml_transpose(ctx0, Vcur);
+                }
                 offload_func_v(Vcur);
                 ggml_set_name(Vcur, "Vcur");
 
@@ -2946,15 +3211,23 @@ static struct ggml_cgraph * llm_build_baichaun(
                 offload_func_kq(k);
                 ggml_set_name(k, "k");
 
-                struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
+                struct ggml_tensor * v = kv_self.v_trans
+                    ? ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
                         (   n_ctx)*ggml_element_size(kv_self.v),
-                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v));
+                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v))
+                    : ggml_view_2d(ctx0, kv_self.v, n_embd_gqa, N,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        (ggml_element_size(kv_self.v)*n_embd_gqa)*(il*n_ctx + n_past));
                 offload_func_v(v);
                 ggml_set_name(v, "v");
 
                 // important: storing RoPE-ed version of K in the KV cache!
-                ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
-                ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
+                if (fuse_ops && model.type == MODEL_7B) {
+                    ggml_build_forward_expand(gf, ggml_rope_kv(ctx0, Kcur, Vcur, k, v, n_past, n_embd_head, 0, freq_base, freq_scale));
+                } else {
+                    ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
+                    ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
+                }
             }
 
             struct ggml_tensor * Q = ggml_permute(ctx0, Qcur, 0, 2, 1, 3);
@@ -3008,26 +3281,27 @@ static struct ggml_cgraph * llm_build_baichaun(
             ggml_set_name(KQ_soft_max, "KQ_soft_max");
 
             // split cached V into n_head heads
-            struct ggml_tensor * V =
-                ggml_view_3d(ctx0, kv_self.v,
+            struct ggml_tensor * V = kv_self.v_trans
+                ? ggml_view_3d(ctx0, kv_self.v,
                         n_past + N, n_embd_head, n_head_kv,
                         ggml_element_size(kv_self.v)*n_ctx,
                         ggml_element_size(kv_self.v)*n_ctx*n_embd_head,
-                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il);
+                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il)
+                : ggml_view_3d(ctx0, kv_self.v,
+                        n_embd_head, n_past + N, n_head_kv,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        ggml_element_size(kv_self.v)*n_embd_head,
+                        ggml_element_size(kv_self.v)*n_embd_gqa*n_ctx*il);
             offload_func_v(V);
             ggml_set_name(V, "V");
 
-#if 1
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V, KQ_soft_max);
+            // with the row-major cache the rows of V are read in order, each one scaled by
+            // its column of KQ_soft_max, instead of dotting the strided columns of V with it
+            struct ggml_tensor * KQV = kv_self.v_trans
+                ? ggml_mul_mat(ctx0, V, KQ_soft_max)
+                : ggml_out_prod(ctx0, V, ggml_transpose(ctx0, KQ_soft_max));
             offload_func_v(KQV);
             ggml_set_name(KQV, "KQV");
-#else
-            // make V contiguous in memory to speed up the matmul, however we waste time on the copy
-            // on M1 this is faster for the perplexity computation, but ~5% slower for the single-token generation
-            // is there a better way?
-            struct ggml_tensor * V_cont = ggml_cpy(ctx0, V, ggml_new_tensor_3d(ctx0, kv_self.v->type, n_past + N, n_embd_head, n_head));
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V_cont, KQ_soft_max);
-#endif
 
             // KQV_merged = KQV.permute(0, 2, 1, 3)
             struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
@@ -3056,7 +3330,10 @@ static struct ggml_cgraph * llm_build_baichaun(
         // feed-forward network
         {
             // norm
-            {
+            if (fuse_ops) {
+                cur = ggml_rms_norm_mul(ctx0, inpFF, model.layers[il].ffn_norm, norm_rms_eps);
+                ggml_set_name(cur, "ffn_norm");
+            } else {
                 cur = ggml_rms_norm(ctx0, inpFF, norm_rms_eps);
                 offload_func(cur);
                 ggml_set_name(cur, "rms_norm_1");
@@ -3080,12 +3357,16 @@ static struct ggml_cgraph * llm_build_baichaun(
             ggml_set_name(cur, "result_w1");
 
             // SILU activation
-            cur = ggml_silu(ctx0, cur);
-            offload_func(cur);
-            ggml_set_name(cur, "silu");
+            if (fuse_ops) {
+                cur = ggml_swiglu(ctx0, cur, tmp);
+            } else {
+                cur = ggml_silu(ctx0, cur);
+                offload_func(cur);
+                ggml_set_name(cur, "silu");
 
-            cur = ggml_mul(ctx0, cur, tmp);
-            offload_func(cur);
+                cur = ggml_mul(ctx0, cur, tmp);
+                offload_func(cur);
+            }
             ggml_set_name(cur, "silu_x_result_w3");
 
             cur = ggml_mul_mat(ctx0,
@@ -3106,7 +3387,10 @@ static struct ggml_cgraph * llm_build_baichaun(
     cur = inpL;
 
     // norm
-    {
+    if (fuse_ops) {
+        cur = ggml_rms_norm_mul(ctx0, cur, model.output_norm, norm_rms_eps);
+        ggml_set_name(cur, "result_norm");
+    } else {
         cur = ggml_rms_norm(ctx0, cur, norm_rms_eps);
         offload_func_nr(cur);
         ggml_set_name(cur, "rms_norm_2");
@@ -3315,18 +3599,27 @@ static struct ggml_cgraph * llm_build_falcon(
             offload_func_kq(Kcur);
 
             {
-                struct ggml_tensor * Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, ggml_cont(ctx0, tmpv), n_embd_gqa, N));
+                struct ggml_tensor * Vcont = ggml_cont(ctx0, tmpv);
+                offload_func_v(Vcont);
+
+                struct ggml_tensor * Vcur = ggml_reshape_2d(ctx0, Vcont, n_embd_gqa, N);
+                if (kv_self.v_trans) {
+                    Vcur = ggml_transpose(ctx0, Vcur);
+                }
                 offload_func_v(Vcur);
-                offload_func_v(Vcur->src[0]->src[0]);
                 ggml_set_name(Vcur, "Vcur");
 
                 struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd_gqa, (ggml_element_size(kv_self.k)*n_embd_gqa)*(il*n_ctx + n_past));
                 offload_func_kq(k);
                 ggml_set_name(k, "k");
 
-                struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
+                struct ggml_tensor * v = kv_self.v_trans
+                    ? ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
                         (   n_ctx)*ggml_element_size(kv_self.v),
-                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v));
+                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v))
+                    : ggml_view_2d(ctx0, kv_self.v, n_embd_gqa, N,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        (ggml_element_size(kv_self.v)*n_embd_gqa)*(il*n_ctx + n_past));
                 offload_func_v(v);
 
                 ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
@@ -3362,16 +3655,25 @@ static struct ggml_cgraph * llm_build_falcon(
             offload_func_v(KQ_soft_max);
             ggml_set_name(KQ_soft_max, "KQ_soft_max");
 
-            struct ggml_tensor * V =
-                ggml_view_3d(ctx0, kv_self.v,
+            struct ggml_tensor * V = kv_self.v_trans
+                ? ggml_view_3d(ctx0, kv_self.v,
                         n_past + N, n_embd_head, n_head_kv,
                         ggml_element_size(kv_self.v)*n_ctx,
                         ggml_element_size(kv_self.v)*n_ctx*n_embd_head,
-                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il);
+                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il)
+                : ggml_view_3d(ctx0, kv_self.v,
+                        n_embd_head, n_past + N, n_head_kv,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        ggml_element_size(kv_self.v)*n_embd_head,
+                        ggml_element_size(kv_self.v)*n_embd_gqa*n_ctx*il);
             offload_func_v(V);
             ggml_set_name(V, "V");
 
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V, KQ_soft_max);
+            // with the row-major cache the rows of V are read in order, each one scaled by
+            // its column of KQ_soft_max, instead of dotting the strided columns of V with it
+            struct ggml_tensor * KQV = kv_self.v_trans
+                ? ggml_mul_mat(ctx0, V, KQ_soft_max)
+                : ggml_out_prod(ctx0, V, ggml_transpose(ctx0, KQ_soft_max));
             offload_func_v(KQV);
             ggml_set_name(KQV, "KQV");
 
@@ -3550,15 +3852,22 @@ static struct ggml_cgraph * llm_build_starcoder(
             struct ggml_tensor * Kcur = tmpk;
 
             {
-                struct ggml_tensor * Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, ggml_cont(ctx0, tmpv), n_embd_gqa, N));
+                struct ggml_tensor * Vcur = ggml_reshape_2d(ctx0, ggml_cont(ctx0, tmpv), n_embd_gqa, N);
+                if (kv_self.v_trans) {
+                    Vcur = ggml_transpose(ctx0, Vcur);
+                }
                 ggml_set_name(Vcur, "Vcur");
 
                 struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd_gqa, (ggml_element_size(kv_self.k)*n_embd_gqa)*(il*n_ctx + n_past));
                 ggml_set_name(k, "k");
 
-                struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
+                struct ggml_tensor * v = kv_self.v_trans
+                    ? ggml_view_2d(ctx0, kv_self.v, N, n_embd_gqa,
                         (   n_ctx)*ggml_element_size(kv_self.v),
-                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v));
+                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd_gqa + n_past*ggml_element_size(kv_self.v))
+                    : ggml_view_2d(ctx0, kv_self.v, n_embd_gqa, N,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        (ggml_element_size(kv_self.v)*n_embd_gqa)*(il*n_ctx + n_past));
 
                 ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
                 ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
@@ -3598,15 +3907,24 @@ static struct ggml_cgraph * llm_build_starcoder(
             ggml_set_name(KQ_soft_max, "KQ_soft_max");
 
             // split cached V into n_head heads
-            struct ggml_tensor * V =
-                ggml_view_3d(ctx0, kv_self.v,
+            struct ggml_tensor * V = kv_self.v_trans
+                ? ggml_view_3d(ctx0, kv_self.v,
                         n_past + N, n_embd_head, n_head_kv,
                         ggml_element_size(kv_self.v)*n_ctx,
                         ggml_element_size(kv_self.v)*n_ctx*n_embd_head,
-                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il);
+                        ggml_element_size(kv_self.v)*n_ctx*n_embd_gqa*il)
+                : ggml_view_3d(ctx0, kv_self.v,
+                        n_embd_head, n_past + N, n_head_kv,
+                        ggml_element_size(kv_self.v)*n_embd_gqa,
+                        ggml_element_size(kv_self.v)*n_embd_head,
+                        ggml_element_size(kv_self.v)*n_embd_gqa*n_ctx*il);
             ggml_set_name(V, "V");
 
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V, KQ_soft_max);
+            // with the row-major cache the rows of V are read in order, each one scaled by
+            // its column of KQ_soft_max, instead of dotting the strided columns of V with it
+            struct ggml_tensor * KQV = kv_self.v_trans
+                ? ggml_mul_mat(ctx0, V, KQ_soft_max)
+                : ggml_out_prod(ctx0, V, ggml_transpose(ctx0, KQ_soft_max));
             ggml_set_name(KQV, "KQV");
 
             // KQV_merged = KQV.permute(0, 2, 1, 3)
@@ -3773,7 +4091,7 @@ static bool llama_eval_internal(
     // TODO: this is mostly important for Apple Silicon where CBLAS is still performing very well
     //       we still need some threads to process all non-mul_mat ops, but not too much to avoid interfering
     //       with the BLAS calls. need a better solution
-    if (N >= 32 && ggml_cpu_has_blas() && !ggml_cpu_has_gpublas()) {
+    if (N >= 32 && ggml_cpu_has_blas() && !ggml_cpu_has_gpublas() && !lctx.autotune.enabled) {
         n_threads = std::min(4, n_threads);
     }
 
@@ -3793,18 +4111,20 @@ static bool llama_eval_internal(
         ggml_metal_set_n_cb     (lctx.ctx_metal, n_threads);
         ggml_metal_graph_compute(lctx.ctx_metal, gf);
     } else {
-        ggml_graph_compute_helper(lctx.work_buffer, gf, n_threads);
+        ggml_graph_compute_helper(lctx.work_buffer, gf, n_threads, lctx.profiling ? lctx.profile : NULL);
     }
 #else
-    ggml_graph_compute_helper(lctx.work_buffer, gf, n_threads);
+    ggml_graph_compute_helper(lctx.work_buffer, gf, n_threads, lctx.profiling ? lctx.profile : NULL);
 #endif
 
 #if GGML_USE_MPI
     ggml_mpi_graph_compute_post(lctx.ctx_mpi, gf, n_layer);
 #endif
 
+    const auto & beams = lctx.beam_layout;
+
     // update kv token count
-    lctx.kv_self.n = n_past + N;
+    lctx.kv_self.n = beams.n_slots ? n_past + (beams.n_blocks + 1)*beams.n_slots : n_past + N;
 
     if (cgraph_fname) {
         ggml_graph_export(gf, cgraph_fname);
@@ -3825,7 +4145,7 @@ static bool llama_eval_internal(
     {
         auto & logits_out = lctx.logits;
 
-        if (lctx.logits_all) {
+        if (lctx.logits_all || beams.n_slots) {
             logits_out.resize(n_vocab * N);
             memcpy(logits_out.data(), (float *) ggml_get_data(res), sizeof(float)*n_vocab*N);
         } else {
@@ -3843,16 +4163,21 @@ static bool llama_eval_internal(
         memcpy(embedding_out.data(), (float *) ggml_get_data(embeddings) + (n_embd*(N - 1)), sizeof(float)*n_embd);
     }
 
-    // measure the performance only for the single-token evals
-    if (N == 1) {
-        lctx.t_eval_us += ggml_time_us() - t_start_us;
+    // measure the performance only for the single-token evals (a beam step decodes one token per beam)
+    const int64_t t_eval_us = ggml_time_us() - t_start_us;
+    if (N == 1 || beams.n_slots) {
+        lctx.t_eval_us += t_eval_us;
         lctx.n_eval++;
     }
     else if (N > 1) {
-        lctx.t_p_eval_us += ggml_time_us() - t_start_us;
+        lctx.t_p_eval_us += t_eval_us;
         lctx.n_p_eval += N;
     }
 
+    const int n_step = beams.n_slots ? 1 : N;
+    lctx.latency.eval_begin(n_step, n_past, t_start_us);
+    lctx.latency.eval_end(n_step, t_eval_us);
+
     return true;
 }
 
@@ -4288,12 +4613,31 @@ struct llama_partial_utf8 {
     int      n_remain; // num bytes remaining; -1 indicates invalid sequence
 };
 
+// allowed-token bitmaps memoized per distinct grammar state (set of stacks + partial UTF-8)
+// a grammar revisits the same few states over and over (e.g. inside a JSON string), so after a
+// short warm-up sampling becomes a lookup instead of a walk over the whole vocab
+// shared by all copies of a grammar and only valid for the vocab of a single model, which the
+// generation of the vocab identifies: a model loaded at the address of a freed one is another
+#define LLAMA_GRAMMAR_MAX_TOKEN_MASKS 1024
+
+struct llama_grammar_token_masks {
+    uint64_t vocab_generation = 0;
+
+    std::vector<std::string> pieces; // decoded token pieces, indexed by token id
+
+    std::unordered_map<std::string, std::vector<uint32_t>> masks;
+
+    std::mutex mutex;
+};
+
 struct llama_grammar {
     const std::vector<std::vector<llama_grammar_element>>   rules;
     std::vector<std::vector<const llama_grammar_element *>> stacks;
 
     // buffer for partially generated UTF-8 sequence from accepted tokens
     llama_partial_utf8                                      partial_utf8;
+
+    std::shared_ptr<llama_grammar_token_masks>              token_masks;
 };
 
 struct llama_grammar_candidate {
@@ -4627,8 +4971,9 @@ struct llama_grammar * llama_grammar_init(
     }
 
     // loop over alternates of start rule to build initial stacks
+    // the stacks must point into our own copy of the rules, the caller's may be freed after this
     std::vector<std::vector<const llama_grammar_element *>> stacks;
-    pos = rules[start_rule_index];
+    pos = vec_rules[start_rule_index].data();
     do {
         std::vector<const llama_grammar_element *> stack;
         if (!llama_grammar_is_end_of_sequence(pos)) {
@@ -4648,7 +4993,7 @@ struct llama_grammar * llama_grammar_init(
         }
     } while (true);
 
-    return new llama_grammar{ std::move(vec_rules), std::move(stacks), {} };
+    return new llama_grammar{ std::move(vec_rules), std::move(stacks), {}, std::make_shared<llama_grammar_token_masks>() };
 }
 
 void llama_grammar_free(struct llama_grammar * grammar) {
@@ -4656,7 +5001,7 @@ void llama_grammar_free(struct llama_grammar * grammar) {
 }
 
 struct llama_grammar * llama_grammar_copy(const struct llama_grammar * grammar) {
-    llama_grammar * result = new llama_grammar{ grammar->rules, grammar->stacks, grammar->partial_utf8 };
+    llama_grammar * result = new llama_grammar{ grammar->rules, grammar->stacks, grammar->partial_utf8, grammar->token_masks };
 
     // redirect elements in stacks to point to new rules
     for (size_t is = 0; is < result->stacks.size(); is++) {
@@ -4674,6 +5019,192 @@ struct llama_grammar * llama_grammar_copy(const struct llama_grammar * grammar)
     return result;
 }
 
+//
+// token masks
+//
+
+// key identifying the state of a grammar independently of where its rules live in memory
+static std::string llama_grammar_state_key(const struct llama_grammar * grammar) {
+    std::vector<uint32_t> key;
+    for (const auto & stack : grammar->stacks) {
+        key.push_back(stack.size());
+        for (const auto * pos : stack) {
+            for (size_t ir = 0; ir < grammar->rules.size(); ir++) {
+                const auto & rule = grammar->rules[ir];
+                if (pos >= rule.data() && pos < rule.data() + rule.size()) {
+                    key.push_back(ir);
+                    key.push_back(pos - rule.data());
+                    break;
+                }
+            }
+        }
+    }
+    key.push_back(grammar->partial_utf8.value);
+    key.push_back(grammar->partial_utf8.n_remain);
+
+    return std::string((const char *) key.data(), key.size()*sizeof(uint32_t));
+}
+
+// builds the allowed-token bitmap of the current grammar state over the whole vocab
+static std::vector<uint32_t> llama_grammar_build_token_mask(
+        const struct llama_context     * ctx,
+        const struct llama_grammar     * grammar,
+        const std::vector<std::string> & pieces) {
+    const int n_vocab = pieces.size();
+
+    std::vector<uint32_t> mask((n_vocab + 31)/32, 0);
+
+    bool allow_eos = false;
+    for (const auto & stack : grammar->stacks) {
+        if (stack.empty()) {
+            allow_eos = true;
+            break;
+        }
+    }
+
+    const llama_token eos = llama_token_eos(ctx);
+
+    std::vector<std::pair<std::vector<uint32_t>, llama_partial_utf8>> candidates_decoded;
+    std::vector<llama_grammar_candidate>                              candidates_grammar;
+
+    candidates_decoded.reserve(n_vocab);
+    candidates_grammar.reserve(n_vocab);
+
+    for (llama_token id = 0; id < n_vocab; ++id) {
+        const std::string & piece = pieces[id];
+        if (id == eos) {
+            if (allow_eos) {
+                mask[id/32] |= 1u << (id%32);
+            }
+        } else if (!piece.empty() && piece[0] != 0) {
+            mask[id/32] |= 1u << (id%32);
+            candidates_decoded.push_back(decode_utf8(piece.c_str(), grammar->partial_utf8));
+            candidates_grammar.push_back({ (size_t) id, candidates_decoded.back().first.data(), candidates_decoded.back().second });
+        }
+    }
+
+    const auto rejects = llama_grammar_reject_candidates(grammar->rules, grammar->stacks, candidates_grammar);
+    for (const auto & reject : rejects) {
+        mask[reject.index/32] &= ~(1u << (reject.index%32));
+    }
+
+    return mask;
+}
+
+// calls fn with the allowed-token bitmap of the current grammar state, building it on first use
+template <typename F>
+static void llama_grammar_with_token_mask(struct llama_context * ctx, const struct llama_grammar * grammar, F && fn) {
+    auto & cache = *grammar->token_masks;
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    if (cache.vocab_generation != ctx->model.vocab.generation) {
+        const int n_vocab = llama_n_vocab(ctx);
+
+        cache.masks.clear();
+        cache.pieces.resize(n_vocab);
+        for (llama_token id = 0; id < n_vocab; ++id) {
+            cache.pieces[id] = llama_token_to_str(ctx, id);
+        }
+        cache.vocab_generation = ctx->model.vocab.generation;
+    }
+
+    const std::string key = llama_grammar_state_key(grammar);
+
+    auto it = cache.masks.find(key);
+    if (it == cache.masks.end()) {
+        if (cache.masks.size() >= LLAMA_GRAMMAR_MAX_TOKEN_MASKS) {
+            cache.masks.clear();
+        }
+        it = cache.masks.emplace(key, llama_grammar_build_token_mask(ctx, grammar, cache.pieces)).first;
+    }
+
+    fn(it->second);
+}
+
+static void llama_sample_mask(llama_token_data_array * candidates, const uint32_t * mask, llama_token n_vocab) {
+    for (size_t i = 0; i < candidates->size; ++i) {
+        const llama_token id = candidates->data[i].id;
+        if (id < 0 || id >= n_vocab || !((mask[id/32] >> (id%32)) & 1)) {
+            candidates->data[i].logit = -INFINITY;
+        }
+    }
+}
+
+int llama_n_token_mask_words(const struct llama_context * ctx) {
+    return ctx->token_mask.size();
+}
+
+const uint32_t * llama_get_token_mask(const struct llama_context * ctx) {
+    return ctx->token_mask.data();
+}
+
+void llama_token_mask_reset(struct llama_context * ctx) {
+    std::fill(ctx->token_mask.begin(), ctx->token_mask.end(), 0xFFFFFFFF);
+}
+
+void llama_token_mask_and(struct llama_context * ctx, const uint32_t * mask) {
+    const size_t n_words = ctx->token_mask.size();
+    uint32_t * dst = ctx->token_mask.data();
+    for (size_t i = 0; i < n_words; ++i) {
+        dst[i] &= mask[i];
+    }
+}
+
+void llama_token_mask_allow(struct llama_context * ctx, const llama_token * tokens, size_t n_tokens) {
+    const llama_token n_vocab = llama_n_vocab(ctx);
+
+    std::vector<uint32_t> mask(ctx->token_mask.size(), 0);
+    for (size_t i = 0; i < n_tokens; ++i) {
+        if (tokens[i] >= 0 && tokens[i] < n_vocab) {
+            mask[tokens[i]/32] |= 1u << (tokens[i]%32);
+        }
+    }
+    llama_token_mask_and(ctx, mask.data());
+}
+
+void llama_token_mask_forbid(struct llama_context * ctx, const llama_token * tokens, size_t n_tokens) {
+    const llama_token n_vocab = llama_n_vocab(ctx);
+
+    for (size_t i = 0; i < n_tokens; ++i) {
+        if (tokens[i] >= 0 && tokens[i] < n_vocab) {
+            ctx->token_mask[tokens[i]/32] &= ~(1u << (tokens[i]%32));
+        }
+    }
+}
+
+void llama_token_mask_grammar(struct llama_context * ctx, const struct llama_grammar * grammar) {
+    const int64_t t_start_sample_us = ggml_time_us();
+
+    llama_grammar_with_token_mask(ctx, grammar, [&](const std::vector<uint32_t> & mask) {
+        llama_token_mask_and(ctx, mask.data());
+    });
+
+    ctx->t_sample_us += ggml_time_us() - t_start_sample_us;
+}
+
+void llama_apply_token_mask(struct llama_context * ctx, float * logits) {
+    const int64_t t_start_sample_us = ggml_time_us();
+
+    const int n_vocab = llama_n_vocab(ctx);
+    const uint32_t * mask = ctx->token_mask.data();
+
+    for (int i0 = 0; i0 < n_vocab; i0 += 32) {
+        const uint32_t bits = mask[i0/32];
+        if (bits == 0xFFFFFFFF) {
+            continue;
+        }
+        const int n = std::min(32, n_vocab - i0);
+        float * x = logits + i0;
+        // branchless select so the compiler can vectorize it
+        for (int j = 0; j < n; ++j) {
+            x[j] = (bits >> j) & 1 ? x[j] : -INFINITY;
+        }
+    }
+
+    ctx->t_sample_us += ggml_time_us() - t_start_sample_us;
+}
+
 //
 // sampling
 //
@@ -5027,37 +5558,18 @@ void llama_sample_grammar(struct llama_context * ctx, llama_token_data_array * c
     GGML_ASSERT(ctx);
     const int64_t t_start_sample_us = ggml_time_us();
 
-    bool allow_eos = false;
-    for (const auto & stack : grammar->stacks) {
-        if (stack.empty()) {
-            allow_eos = true;
-            break;
-        }
-    }
-
-    const llama_token eos = llama_token_eos(ctx);
-    std::vector<std::pair<std::vector<uint32_t>, llama_partial_utf8>> candidates_decoded;
-    std::vector<llama_grammar_candidate>                              candidates_grammar;
+    llama_grammar_with_token_mask(ctx, grammar, [&](const std::vector<uint32_t> & mask) {
+        llama_sample_mask(candidates, mask.data(), llama_n_vocab(ctx));
+    });
 
-    for (size_t i = 0; i < candidates->size; ++i) {
-        const llama_token id    = candidates->data[i].id;
-        const std::string piece = llama_token_to_str(ctx, id);
-        if (id == eos) {
-            if (!allow_eos) {
-                candidates->data[i].logit = -INFINITY;
-            }
-        } else if (piece.empty() || piece[0] == 0) {
-            candidates->data[i].logit = -INFINITY;
-        } else {
-            candidates_decoded.push_back(decode_utf8(piece.c_str(), grammar->partial_utf8));
-            candidates_grammar.push_back({ i, candidates_decoded.back().first.data(), candidates_decoded.back().second });
-        }
-    }
+    ctx->t_sample_us += ggml_time_us() - t_start_sample_us;
+}
 
-    const auto rejects = llama_grammar_reject_candidates(grammar->rules, grammar->stacks, candidates_grammar);
-    for (const auto & reject : rejects) {
-        candidates->data[reject.index].logit = -INFINITY;
-    }
+void llama_sample_token_mask(struct llama_context * ctx, llama_token_data_array * candidates) {
+    GGML_ASSERT(ctx);
+    const int64_t t_start_sample_us = ggml_time_us();
+
+    llama_sample_mask(candidates, ctx->token_mask.data(), llama_n_vocab(ctx));
 
     ctx->t_sample_us += ggml_time_us() - t_start_sample_us;
 }
@@ -5214,6 +5726,7 @@ llama_token llama_sample_token_greedy(struct llama_context * ctx, llama_token_da
     if (ctx) {
         ctx->t_sample_us += ggml_time_us() - t_start_sample_us;
         ctx->n_sample++;
+        ctx->latency.token_sampled(ggml_time_us(), ctx->t_sample_us);
     }
     return result;
 }
@@ -5238,6 +5751,7 @@ llama_token llama_sample_token(struct llama_context * ctx, llama_token_data_arra
 
     ctx->t_sample_us += ggml_time_us() - t_start_sample_us;
     ctx->n_sample++;
+    ctx->latency.token_sampled(ggml_time_us(), ctx->t_sample_us);
     return result;
 }
 
@@ -5275,6 +5789,7 @@ struct llama_beam {
     std::vector<llama_token> tokens;
     float p;  // Cumulative beam probability (renormalized relative to all beams)
     bool eob; // Initialize end-of-beam to false. Callback sets this to true.
+    size_t slot = 0; // KV slot holding the private tokens of this beam (batched search only)
     // Sort beams by probability. In case of ties, prefer beams at eob.
     bool operator<(const llama_beam & rhs) const {
         return std::make_pair(p, eob) < std::make_pair(rhs.p, rhs.eob);
@@ -5300,8 +5815,11 @@ struct llama_logit_info {
         float operator()(float sum, float l) const { return sum + std::exp(l - max_l); }
     };
     llama_logit_info(llama_context * ctx)
-      : logits(llama_get_logits(ctx))
-      , n_vocab(llama_n_vocab(ctx))
+      : llama_logit_info(llama_get_logits(ctx), llama_n_vocab(ctx))
+      { }
+    llama_logit_info(const float * logits, int n_vocab)
+      : logits(logits)
+      , n_vocab(n_vocab)
       , max_l(*std::max_element(logits, logits + n_vocab))
       , normalizer(1.0f / std::accumulate(logits, logits + n_vocab, 0.0f, sum_exp{max_l}))
       { }
@@ -5349,6 +5867,13 @@ struct llama_beam_search_data {
     // Used to communicate to/from callback on beams state.
     std::vector<llama_beam_view> beam_views;
 
+    // Batched search: all beams are advanced by one llama_eval_internal call per step, each beam
+    // owning a slot of the KV cache for its private tokens (see llama_context::beam_layout).
+    bool batched;
+    int n_blocks = 0; // private tokens per slot already in the KV cache
+    int n_shifted = 0; // leading private blocks already shifted off the beams, yet to move into the prefix
+    std::vector<float> beam_logits; // [beams.size()][n_vocab] of the last step
+
     llama_beam_search_data(llama_context * ctx, size_t n_beams, int n_past, int n_predict, int n_threads)
       : ctx(ctx)
       , n_beams(n_beams)
@@ -5358,6 +5883,11 @@ struct llama_beam_search_data {
       , beam_views(n_beams) {
         beams.reserve(n_beams);
         next_beams.reserve(n_beams);
+        // the beam mask is only wired into the LLaMA graph, and the CPU graph at that
+        batched = ctx->model.arch == LLM_ARCH_LLAMA && n_beams > 1;
+#ifdef GGML_USE_METAL
+        batched = batched && !ctx->ctx_metal;
+#endif
     }
 
     // Collapse beams to a single beam given by index.
@@ -5373,7 +5903,7 @@ struct llama_beam_search_data {
     //  * Gather elements until the vector is full, then call std::make_heap() on it.
     //  * If the heap is full and a new element is found that should be included, pop the
     //    least element to the back(), replace it with the new, then push it into the heap.
-    void fill_next_beams_by_top_probabilities(llama_beam & beam) {
+    void fill_next_beams_by_top_probabilities(llama_beam & beam, const float * logits) {
         // Min-heaps use a greater-than comparator.
         const auto comp = [](const llama_beam & a, const llama_beam & b) { return a.p > b.p; };
         if (beam.eob) {
@@ -5390,10 +5920,13 @@ struct llama_beam_search_data {
             }
         } else {
             // beam is not at end-of-sentence, so branch with next top_k tokens.
-            if (!beam.tokens.empty()) {
-                llama_eval(ctx, beam.tokens.data(), beam.tokens.size(), n_past, n_threads);
+            if (!logits) {
+                if (!beam.tokens.empty()) {
+                    llama_eval(ctx, beam.tokens.data(), beam.tokens.size(), n_past, n_threads);
+                }
+                logits = llama_get_logits(ctx);
             }
-            llama_logit_info logit_info(ctx);
+            llama_logit_info logit_info(logits, llama_n_vocab(ctx));
             std::vector<llama_token_data> next_tokens = logit_info.top_k(n_beams);
             size_t i=0;
             if (next_beams.size() < n_beams) {
@@ -5464,24 +5997,167 @@ struct llama_beam_search_data {
                        !beams[top_beam_index()].eob ; ++i) {
             callback(callback_data, get_beams_state(false));  // Sets common_prefix_length
             update_beams_from_beam_views();   // Update values (p,eob) that callback may have changed.
-            if (common_prefix_length) {
+            if (batched) {
+                if (!eval_beams()) {
+                    break;
+                }
+            } else if (common_prefix_length) {
                 llama_eval(ctx, beams[0].tokens.data(), common_prefix_length, n_past, n_threads);
                 n_past += common_prefix_length;
             }
             // Zero-out next_beam probabilities to place them last in following min-heap.
             std::for_each(next_beams.begin(), next_beams.end(), [](llama_beam & beam) { beam.p = 0.0f; });
-            for (llama_beam & beam : beams) {
-                beam.shift_tokens(common_prefix_length);
-                fill_next_beams_by_top_probabilities(beam);
+            const int n_vocab = llama_n_vocab(ctx);
+            for (size_t j = 0 ; j < beams.size() ; ++j) {
+                llama_beam & beam = beams[j];
+                if (!batched) {
+                    beam.shift_tokens(common_prefix_length);
+                }
+                fill_next_beams_by_top_probabilities(beam, batched ? beam_logits.data() + j*n_vocab : nullptr);
             }
             // next_beams become the beams of next/final iteration. Swap them to re-use memory.
             beams.swap(next_beams);
             renormalize_beam_probabilities(beams);
+            if (batched) {
+                reorder_slots();
+            }
         }
         collapse_beams(top_beam_index());
+        if (batched) {
+            ctx->beam_layout.n_slots  = 0;
+            ctx->beam_layout.n_blocks = 0;
+            ctx->kv_self.n = n_past;
+        }
         callback(callback_data, get_beams_state(true));
     }
 
+    // Moves KV rows src_rows[i] to dst_rows[i] in every layer, going through a copy so that
+    // the two sets may overlap and a source row may feed several destinations.
+    void move_kv_rows(const std::vector<int> & dst_rows, const std::vector<int> & src_rows) {
+        const auto & hparams = ctx->model.hparams;
+        const auto & kv_self = ctx->kv_self;
+
+        const int64_t n_ctx      = hparams.n_ctx;
+        const int64_t n_embd_gqa = hparams.n_embd_gqa();
+        const size_t  n_rows     = dst_rows.size();
+
+        const size_t k_row_size = ggml_element_size(kv_self.k)*n_embd_gqa;
+        const size_t v_el_size  = ggml_element_size(kv_self.v);
+        const size_t v_row_size = v_el_size*n_embd_gqa;
+
+        std::vector<uint8_t> tmp(n_rows*std::max(k_row_size, v_row_size));
+
+        for (int il = 0; il < (int) hparams.n_layer; ++il) {
+            uint8_t * k = (uint8_t *) kv_self.k->data + il*n_ctx*k_row_size;
+            for (size_t i = 0; i < n_rows; ++i) {
+                memcpy(tmp.data() + i*k_row_size, k + src_rows[i]*k_row_size, k_row_size);
+            }
+            for (size_t i = 0; i < n_rows; ++i) {
+                memcpy(k + dst_rows[i]*k_row_size, tmp.data() + i*k_row_size, k_row_size);
+            }
+
+            if (!kv_self.v_trans) {
+                uint8_t * v = (uint8_t *) kv_self.v->data + il*n_ctx*v_row_size;
+                for (size_t i = 0; i < n_rows; ++i) {
+                    memcpy(tmp.data() + i*v_row_size, v + src_rows[i]*v_row_size, v_row_size);
+                }
+                for (size_t i = 0; i < n_rows; ++i) {
+                    memcpy(v + dst_rows[i]*v_row_size, tmp.data() + i*v_row_size, v_row_size);
+                }
+                continue;
+            }
+
+            // V is stored transposed: one row of n_ctx elements per embedding dimension
+            for (int64_t e = 0; e < n_embd_gqa; ++e) {
+                uint8_t * v = (uint8_t *) kv_self.v->data + (il*n_embd_gqa + e)*n_ctx*v_el_size;
+                for (size_t i = 0; i < n_rows; ++i) {
+                    memcpy(tmp.data() + i*v_el_size, v + src_rows[i]*v_el_size, v_el_size);
+                }
+                for (size_t i = 0; i < n_rows; ++i) {
+                    memcpy(v + dst_rows[i]*v_el_size, tmp.data() + i*v_el_size, v_el_size);
+                }
+            }
+        }
+    }
+
+    // Evaluates the last (not yet evaluated) token of every beam in a single batched pass.
+    // Returns false if the KV cache has no room left for another step.
+    bool eval_beams() {
+        const int n_slots = n_beams;
+        const int n_vocab = llama_n_vocab(ctx);
+
+        // on the first step the only beam is empty and the logits of the prompt are used
+        if (beams[0].tokens.empty() && n_blocks == 0 && n_shifted == 0) {
+            beam_logits.assign(llama_get_logits(ctx), llama_get_logits(ctx) + n_vocab);
+            return true;
+        }
+
+        std::vector<llama_token> last_tokens(beams.size());
+        for (size_t i = 0; i < beams.size(); ++i) {
+            GGML_ASSERT(beams[i].slot == i);
+            // a beam at end-of-beam may have nothing left to evaluate, its row is never read
+            last_tokens[i] = beams[i].tokens.empty() ? llama_token_eos(ctx) : beams[i].tokens.back();
+            beams[i].shift_tokens(common_prefix_length);
+        }
+        n_shifted += common_prefix_length;
+
+        // tokens shared by all beams have identical KV rows in every slot: keep those of slot 0
+        // as part of the prefix and move the remaining private blocks down
+        const int n_commit = std::min(n_shifted, n_blocks);
+        if (n_commit > 0) {
+            std::vector<int> dst_rows;
+            std::vector<int> src_rows;
+            for (int j = 0; j < n_commit; ++j) {
+                dst_rows.push_back(n_past + j);
+                src_rows.push_back(n_past + j*n_slots);
+            }
+            for (int j = n_commit; j < n_blocks; ++j) {
+                for (int s = 0; s < n_slots; ++s) {
+                    dst_rows.push_back(n_past + n_commit + (j - n_commit)*n_slots + s);
+                    src_rows.push_back(n_past + j*n_slots + s);
+                }
+            }
+            move_kv_rows(dst_rows, src_rows);
+            n_past    += n_commit;
+            n_blocks  -= n_commit;
+            n_shifted -= n_commit;
+        }
+
+        if (n_past + (n_blocks + 1)*n_slots > (int) ctx->model.hparams.n_ctx) {
+            LLAMA_LOG_WARN("%s: KV cache is full, stopping beam search\n", __func__);
+            return false;
+        }
+
+        ctx->beam_layout.n_slots  = n_slots;
+        ctx->beam_layout.n_blocks = n_blocks;
+        llama_eval_internal(*ctx, last_tokens.data(), nullptr, last_tokens.size(), n_past, n_threads, nullptr);
+        n_blocks++;
+
+        beam_logits.assign(llama_get_logits(ctx), llama_get_logits(ctx) + beams.size()*n_vocab);
+        return true;
+    }
+
+    // After next_beams replaced beams, copy the private KV rows of each beam's parent into the
+    // slot matching its new index, so that beams[i] is always held in slot i.
+    void reorder_slots() {
+        const int n_slots = n_beams;
+
+        std::vector<int> dst_rows;
+        std::vector<int> src_rows;
+        for (size_t i = 0; i < beams.size(); ++i) {
+            if (beams[i].slot != i) {
+                for (int j = 0; j < n_blocks; ++j) {
+                    dst_rows.push_back(n_past + j*n_slots + i);
+                    src_rows.push_back(n_past + j*n_slots + beams[i].slot);
+                }
+            }
+            beams[i].slot = i;
+        }
+        if (!dst_rows.empty()) {
+            move_kv_rows(dst_rows, src_rows);
+        }
+    }
+
     // As beams grow, the cumulative probabilities decrease.
     // Renormalize them to avoid floating point underflow.
     static void renormalize_beam_probabilities(std::vector<llama_beam> & beams) {
@@ -6128,6 +6804,11 @@ static int llama_apply_lora_from_file_internal(
 
             ggml_tensor * dest_t = model_tensors[base_name];
 
+            if (ggml_internal_get_type_traits(dest_t->type).vec_dot_rows) {
+                LLAMA_LOG_ERROR("%s: error: tensor '%s' was repacked when the model was loaded, load it without repack to apply a LoRA\n", __func__, base_name.c_str());
+                return 1;
+            }
+
             offload_func_t offload_func = llama_nop;
             offload_func_t offload_func_force_inplace = llama_nop;
 
@@ -6264,6 +6945,8 @@ struct llama_context_params llama_context_default_params() {
         /*.use_mmap                    =*/ true,
         /*.use_mlock                   =*/ false,
         /*.embedding                   =*/ false,
+        /*.repack                      =*/ false,
+        /*.v_rows                      =*/ false,
     };
 
 #ifdef GGML_USE_METAL
@@ -6353,7 +7036,7 @@ struct llama_model * llama_load_model_from_file(
 
     if (!llama_model_load(path_model, *model, params.n_ctx, params.n_batch, params.n_gpu_layers,
                 params.main_gpu, params.tensor_split, params.mul_mat_q, params.rope_freq_base, params.rope_freq_scale,
-                params.low_vram, memory_type, params.use_mmap, params.use_mlock, params.vocab_only,
+                params.low_vram, memory_type, params.use_mmap, params.use_mlock, params.vocab_only, params.repack,
                 params.progress_callback, params.progress_callback_user_data)) {
         LLAMA_LOG_ERROR("%s: failed to load model\n", __func__);
         delete model;
@@ -6375,6 +7058,8 @@ struct llama_context * llama_new_context_with_model(
         return nullptr;
     }
 
+    const int64_t t_start_us = ggml_time_us();
+
     llama_context * ctx = new llama_context(*model);
 
     if (params.seed == LLAMA_DEFAULT_SEED) {
@@ -6386,9 +7071,17 @@ struct llama_context * llama_new_context_with_model(
 
     ggml_type memory_type = params.f16_kv ? GGML_TYPE_F16 : GGML_TYPE_F32;
 
+    bool v_trans = !params.v_rows;
+#if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST) || defined(GGML_USE_METAL)
+    if (!v_trans && params.n_gpu_layers > 0) {
+        LLAMA_LOG_WARN("%s: the row-major V cache has a CPU kernel only, storing V transposed\n", __func__);
+        v_trans = true;
+    }
+#endif
+
     // reserve memory for context buffers
     if (!params.vocab_only) {
-        if (!llama_kv_cache_init(ctx->model.hparams, ctx->kv_self, memory_type, ctx->model.hparams.n_ctx, params.n_gpu_layers)) {
+        if (!llama_kv_cache_init(ctx->model.hparams, ctx->kv_self, memory_type, ctx->model.hparams.n_ctx, params.n_gpu_layers, v_trans)) {
             LLAMA_LOG_ERROR("%s: llama_kv_cache_init() failed for self-attention cache\n", __func__);
             llama_free(ctx);
             return nullptr;
@@ -6412,6 +7105,8 @@ struct llama_context * llama_new_context_with_model(
             ctx->embedding.resize(hparams.n_embd);
         }
 
+        ctx->token_mask.resize((hparams.n_vocab + 31)/32, 0xFFFFFFFF);
+
         {
             static const size_t tensor_alignment = 32;
             // the compute buffer is used to store the tensor and graph structs, while the allocator buffer is used for the tensor data
@@ -6422,6 +7117,7 @@ struct llama_context * llama_new_context_with_model(
 
             // build worst-case graph
             int n_tokens = std::min((int)hparams.n_ctx, params.n_batch);
+            ctx->n_batch = n_tokens;
             int n_past = hparams.n_ctx - n_tokens;
             llama_token token = llama_token_bos(ctx); // not actually used by llama_build_graph, but required to choose between token and embedding inputs graph
             ggml_cgraph * gf = llama_build_graph(*ctx, &token, NULL, n_tokens, n_past);
@@ -6500,6 +7196,8 @@ struct llama_context * llama_new_context_with_model(
 #endif
     }
 
+    ctx->load.add(LOAD_PHASE_CONTEXT, t_start_us, ggml_time_us());
+
 #ifdef GGML_USE_MPI
     ctx->ctx_mpi = ggml_mpi_init();
 
@@ -6799,9 +7497,14 @@ static void llama_copy_state_data_internal(struct llama_context * ctx, llama_dat
                 n_embd, kv_ntok, n_layer,
                 elt_size*n_embd, elt_size*n_embd*n_ctx, 0);
 
-            ggml_tensor * v3d = ggml_view_3d(cpy_ctx, kv_self.v,
-                kv_ntok, n_embd, n_layer,
-                elt_size*n_ctx, elt_size*n_ctx*n_embd, 0);
+            // the state holds V transposed whatever the layout of the cache
+            ggml_tensor * v3d = kv_self.v_trans
+                ? ggml_view_3d(cpy_ctx, kv_self.v,
+                    kv_ntok, n_embd, n_layer,
+                    elt_size*n_ctx, elt_size*n_ctx*n_embd, 0)
+                : ggml_transpose(cpy_ctx, ggml_view_3d(cpy_ctx, kv_self.v,
+                    n_embd, kv_ntok, n_layer,
+                    elt_size*n_embd, elt_size*n_embd*n_ctx, 0));
 
             ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, k3d, kout3d));
             ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, v3d, vout3d));
@@ -6909,9 +7612,14 @@ size_t llama_set_state_data(struct llama_context * ctx, uint8_t * src) {
                 n_embd, kv_ntok, n_layer,
                 elt_size*n_embd, elt_size*n_embd*n_ctx, 0);
 
-            ggml_tensor * v3d = ggml_view_3d(cpy_ctx, kv_self.v,
-                kv_ntok, n_embd, n_layer,
-                elt_size*n_ctx, elt_size*n_ctx*n_embd, 0);
+            // the state holds V transposed whatever the layout of the cache
+            ggml_tensor * v3d = kv_self.v_trans
+                ? ggml_view_3d(cpy_ctx, kv_self.v,
+                    kv_ntok, n_embd, n_layer,
+                    elt_size*n_ctx, elt_size*n_ctx*n_embd, 0)
+                : ggml_transpose(cpy_ctx, ggml_view_3d(cpy_ctx, kv_self.v,
+                    n_embd, kv_ntok, n_layer,
+                    elt_size*n_embd, elt_size*n_embd*n_ctx, 0));
 
             ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, kin3d, k3d));
             ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, vin3d, v3d));
@@ -6931,56 +7639,554 @@ size_t llama_set_state_data(struct llama_context * ctx, uint8_t * src) {
     return nread;
 }
 
-static bool llama_load_session_file_internal(struct llama_context * ctx, const char * path_session, llama_token * tokens_out, size_t n_token_capacity, size_t * n_token_count_out) {
-    llama_file file(path_session, "rb");
+// whether the llama_copy_state_data dump of size bytes at src fits the context, so that
+// llama_set_state_data restores it without failing halfway
+bool llama_check_state_data(const struct llama_context * ctx, const uint8_t * src, size_t size) {
+    const uint8_t * inp = src;
+    const uint8_t * end = src + size;
 
-    // sanity checks
+    const auto take = [&](void * dst, size_t n) {
+        if (n > (size_t) (end - inp)) {
+            return false;
+        }
+        memcpy(dst, inp, n);
+        inp += n;
+        return true;
+    };
+
+    // rng
     {
-        const uint32_t magic   = file.read_u32();
-        const uint32_t version = file.read_u32();
+        size_t rng_size;
+        char   rng_buf[LLAMA_MAX_RNG_STATE];
+        if (!take(&rng_size, sizeof(rng_size)) || rng_size > LLAMA_MAX_RNG_STATE || !take(rng_buf, LLAMA_MAX_RNG_STATE)) {
+            return false;
+        }
 
-        if (magic != LLAMA_SESSION_MAGIC || version != LLAMA_SESSION_VERSION) {
-            LLAMA_LOG_ERROR("%s : unknown (magic, version) for session file: %08x, %08x\n", __func__, magic, version);
+        std::stringstream rng_ss(std::string(&rng_buf[0], rng_size));
+        std::mt19937 rng_check;
+        rng_ss >> rng_check;
+        if (rng_ss.fail()) {
             return false;
         }
+    }
 
-        llama_hparams session_hparams;
-        file.read_raw(&session_hparams, sizeof(llama_hparams));
+    // logits, written up to their capacity
+    {
+        size_t logits_cap;
+        size_t logits_size;
+        if (!take(&logits_cap, sizeof(logits_cap)) || !take(&logits_size, sizeof(logits_size)) ||
+            logits_cap != ctx->logits.capacity() || logits_size > logits_cap || logits_cap*sizeof(float) > (size_t) (end - inp)) {
+            return false;
+        }
+        inp += logits_cap*sizeof(float);
+    }
 
-        if (session_hparams != ctx->model.hparams) {
-            LLAMA_LOG_INFO("%s : model hparams didn't match from session file!\n", __func__);
+    // embedding
+    {
+        size_t embedding_size;
+        if (!take(&embedding_size, sizeof(embedding_size)) || embedding_size != ctx->embedding.capacity() ||
+            embedding_size*sizeof(float) > (size_t) (end - inp)) {
             return false;
         }
+        inp += embedding_size*sizeof(float);
     }
 
-    // load the prompt
+    // kv cache, the used rows of K and V
     {
-        const uint32_t n_token_count = file.read_u32();
+        const auto & kv_self = ctx->kv_self;
+        const auto & hparams = ctx->model.hparams;
 
-        if (n_token_count > n_token_capacity) {
-            LLAMA_LOG_ERROR("%s : token count in session file exceeded capacity! %u > %zu\n", __func__, n_token_count, n_token_capacity);
+        size_t kv_size;
+        int    kv_ntok;
+        if (!take(&kv_size, sizeof(kv_size)) || !take(&kv_ntok, sizeof(kv_ntok)) ||
+            kv_ntok < 0 || kv_ntok > (int) hparams.n_ctx) {
             return false;
         }
+        if (kv_size) {
+            const size_t n_elts = (size_t) hparams.n_embd_gqa()*kv_ntok*hparams.n_layer;
+            const size_t n_kv   = n_elts*(ggml_element_size(kv_self.k) + ggml_element_size(kv_self.v));
+            if (kv_size != kv_self.buf.size || n_kv > (size_t) (end - inp)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
 
-        file.read_raw(tokens_out, sizeof(llama_token) * n_token_count);
-        *n_token_count_out = n_token_count;
+//
+// session files
+//
+// Version 2 session files are the header followed by a sequence of records. Each record holds the
+// tokens and KV rows added since the previous one, followed by the rng, logits and embedding at the
+// time it was written; the last record wins. Only the used KV rows are stored and they are streamed
+// straight from/to the cache tensors, so growing a snapshot costs a delta append, not a rewrite.
+//
+
+struct llama_session_record {
+    uint32_t n_tokens; // tokens appended by this record
+    uint32_t kv_head;  // first KV row stored in this record
+    uint32_t kv_n;     // KV rows in use after this record
+    uint32_t type_k;
+    uint32_t type_v;
+};
+
+// read side of llama_data_context, used to restore session records either from a mapping of the
+// file, so only the touched pages are faulted in, or from plain reads where mmap is unavailable
+struct llama_data_read_context {
+    virtual void read(void * dst, size_t size) = 0;
+    virtual void seek(size_t offs) = 0;
+    virtual size_t tell() const = 0;
+    virtual size_t size() const = 0;
+    virtual ~llama_data_read_context() = default;
+
+    uint32_t read_u32() {
+        uint32_t ret;
+        read(&ret, sizeof(ret));
+        return ret;
     }
 
-    // restore the context state
+    void skip(size_t n) {
+        seek(tell() + n);
+    }
+};
+
+struct llama_data_mmap_read_context : llama_data_read_context {
+    const uint8_t * addr;
+    size_t offs;
+    size_t total;
+
+    llama_data_mmap_read_context(const llama_mmap * mapping, size_t offs) : addr((const uint8_t *) mapping->addr), offs(offs), total(mapping->size) {}
+
+    void read(void * dst, size_t size) override {
+        if (size > total - offs) {
+            throw std::runtime_error(std::string("unexpectedly reached end of file"));
+        }
+        memcpy(dst, addr + offs, size);
+        offs += size;
+    }
+
+    void seek(size_t offs) override {
+        if (offs > total) {
+            throw std::runtime_error(std::string("unexpectedly reached end of file"));
+        }
+        this->offs = offs;
+    }
+
+    size_t tell() const override { return offs; }
+    size_t size() const override { return total; }
+};
+
+struct llama_data_file_read_context : llama_data_read_context {
+    llama_file * file;
+
+    llama_data_file_read_context(llama_file * f) : file(f) {}
+
+    void read(void * dst, size_t size) override {
+        file->read_raw(dst, size);
+    }
+
+    void seek(size_t offs) override {
+        if (offs > file->size) {
+            throw std::runtime_error(std::string("unexpectedly reached end of file"));
+        }
+        file->seek(offs, SEEK_SET);
+    }
+
+    size_t tell() const override { return file->tell(); }
+    size_t size() const override { return file->size; }
+};
+
+// dst = transpose(src), src has n1 rows of n0 elements of elt_size bytes
+static void llama_transpose_copy(uint8_t * dst, const uint8_t * src, size_t n0, size_t n1, size_t elt_size) {
+    for (size_t i1 = 0; i1 < n1; ++i1) {
+        for (size_t i0 = 0; i0 < n0; ++i0) {
+            memcpy(dst + elt_size*(i0*n1 + i1), src + elt_size*(i1*n0 + i0), elt_size);
+        }
+    }
+}
+
+static size_t llama_session_record_kv_size(const struct llama_context * ctx, const llama_session_record & rec) {
+    const auto & kv_self = ctx->kv_self;
+    const auto & hparams = ctx->model.hparams;
+
+    const size_t n_rows = rec.kv_n - rec.kv_head;
+    const size_t n_elts = (size_t) hparams.n_layer*hparams.n_embd_gqa()*n_rows;
+
+    return n_elts*(ggml_element_size(kv_self.k) + ggml_element_size(kv_self.v));
+}
+
+static void llama_write_session_record(struct llama_context * ctx, llama_data_context * data_ctx, const llama_token * tokens, uint32_t n_tokens, uint32_t kv_head) {
+    const auto & kv_self = ctx->kv_self;
+    const auto & hparams = ctx->model.hparams;
+    const int    n_layer = hparams.n_layer;
+    const int    n_embd  = hparams.n_embd_gqa();
+    const int    n_ctx   = hparams.n_ctx;
+
+    llama_session_record rec;
+    rec.n_tokens = n_tokens;
+    rec.kv_head  = kv_head;
+    rec.kv_n     = (uint32_t) llama_get_kv_cache_token_count(ctx);
+    rec.type_k   = (uint32_t) kv_self.k->type;
+    rec.type_v   = (uint32_t) kv_self.v->type;
+
+    GGML_ASSERT(rec.kv_head <= rec.kv_n);
+
+    data_ctx->write(&rec, sizeof(rec));
+    data_ctx->write(tokens, sizeof(llama_token)*n_tokens);
+
+    const size_t n_rows = rec.kv_n - rec.kv_head;
+    if (n_rows > 0) {
+        const size_t k_elt = ggml_element_size(kv_self.k);
+        const size_t v_elt = ggml_element_size(kv_self.v);
+
+        const uint8_t * k = (const uint8_t *) kv_self.k->data;
+        const uint8_t * v = (const uint8_t *) kv_self.v->data;
+
+        // k is [n_embd, n_ctx, n_layer]: the new rows of a layer are contiguous
+        for (int il = 0; il < n_layer; ++il) {
+            data_ctx->write(k + k_elt*n_embd*((size_t) il*n_ctx + kv_head), k_elt*n_embd*n_rows);
+        }
+
+        // v is transposed [n_ctx, n_embd, n_layer]: one run per embedding channel
+        if (kv_self.v_trans) {
+            for (int il = 0; il < n_layer; ++il) {
+                for (int e = 0; e < n_embd; ++e) {
+                    data_ctx->write(v + v_elt*(((size_t) il*n_embd + e)*n_ctx + kv_head), v_elt*n_rows);
+                }
+            }
+        } else {
+            // the record keeps the transposed layout, the rows of the cache are transposed on the way
+            std::vector<uint8_t> buf(v_elt*n_embd*n_rows);
+            for (int il = 0; il < n_layer; ++il) {
+                llama_transpose_copy(buf.data(), v + v_elt*n_embd*((size_t) il*n_ctx + kv_head), n_embd, n_rows, v_elt);
+                data_ctx->write(buf.data(), buf.size());
+            }
+        }
+    }
+
+    // rng
     {
-        const size_t n_state_size_cur = file.size - file.tell();
-        const size_t n_state_size_max = llama_get_state_size(ctx);
+        std::stringstream rng_ss;
+        rng_ss << ctx->rng;
 
-        if (n_state_size_cur > n_state_size_max) {
-            LLAMA_LOG_ERROR("%s : the state size in session file is too big! max %zu, got %zu\n", __func__, n_state_size_max, n_state_size_cur);
-            return false;
+        const std::string rng = rng_ss.str();
+        const uint32_t rng_size = rng.size();
+
+        data_ctx->write(&rng_size, sizeof(rng_size));
+        data_ctx->write(rng.data(), rng_size);
+    }
+
+    // logits, without the capacity padding
+    {
+        const uint32_t logits_size = ctx->logits.size();
+
+        data_ctx->write(&logits_size, sizeof(logits_size));
+        data_ctx->write(ctx->logits.data(), sizeof(float)*logits_size);
+    }
+
+    // embedding
+    {
+        const uint32_t embedding_size = ctx->embedding.size();
+
+        data_ctx->write(&embedding_size, sizeof(embedding_size));
+        data_ctx->write(ctx->embedding.data(), sizeof(float)*embedding_size);
+    }
+}
+
+static void llama_write_session_header(struct llama_context * ctx, llama_file & file) {
+    file.write_u32(LLAMA_SESSION_MAGIC);
+    file.write_u32(LLAMA_SESSION_VERSION);
+
+    file.write_raw(&ctx->model.hparams, sizeof(llama_hparams));
+}
+
+// returns false if the file is not a session file for this model in the current format
+static bool llama_read_session_header(struct llama_context * ctx, llama_file & file, uint32_t * version_out) {
+    const uint32_t magic   = file.read_u32();
+    const uint32_t version = file.read_u32();
+
+    if (magic != LLAMA_SESSION_MAGIC || (version != 1 && version != LLAMA_SESSION_VERSION)) {
+        LLAMA_LOG_ERROR("%s : unknown (magic, version) for session file: %08x, %08x\n", __func__, magic, version);
+        return false;
+    }
+
+    llama_hparams session_hparams;
+    file.read_raw(&session_hparams, sizeof(llama_hparams));
+
+    if (session_hparams != ctx->model.hparams) {
+        LLAMA_LOG_INFO("%s : model hparams didn't match from session file!\n", __func__);
+        return false;
+    }
+
+    *version_out = version;
+
+    return true;
+}
+
+static void llama_check_session_record(const struct llama_context * ctx, const llama_session_record & rec, uint32_t kv_n_prev) {
+    const auto & kv_self = ctx->kv_self;
+
+    if (rec.type_k != (uint32_t) kv_self.k->type || rec.type_v != (uint32_t) kv_self.v->type) {
+        throw std::runtime_error(format("session KV cache type mismatch: %u/%u, expected %d/%d",
+            rec.type_k, rec.type_v, kv_self.k->type, kv_self.v->type));
+    }
+    if (rec.kv_head != kv_n_prev || rec.kv_n < rec.kv_head || rec.kv_n > (uint32_t) ctx->model.hparams.n_ctx) {
+        throw std::runtime_error(format("invalid session record KV rows [%u, %u) after %u rows", rec.kv_head, rec.kv_n, kv_n_prev));
+    }
+}
+
+static void llama_read_session_record_tail(struct llama_context * ctx, llama_data_read_context & inp) {
+    // set rng
+    {
+        const uint32_t rng_size = inp.read_u32();
+        if (rng_size > LLAMA_MAX_RNG_STATE) {
+            throw std::runtime_error(format("invalid rng state size %u", rng_size));
+        }
+
+        std::string rng(rng_size, '\0');
+        inp.read(&rng[0], rng_size);
+
+        std::stringstream rng_ss(rng);
+        rng_ss >> ctx->rng;
+
+        GGML_ASSERT(!rng_ss.fail());
+    }
+
+    // set logits
+    {
+        const uint32_t logits_size = inp.read_u32();
+        if (logits_size > ctx->logits.capacity()) {
+            throw std::runtime_error(format("session logits size %u exceeds the context capacity %zu", logits_size, ctx->logits.capacity()));
         }
 
-        std::vector<uint8_t> state_data(n_state_size_max);
-        file.read_raw(state_data.data(), n_state_size_cur);
+        ctx->logits.resize(logits_size);
+        inp.read(ctx->logits.data(), sizeof(float)*logits_size);
+    }
+
+    // set embedding
+    {
+        const uint32_t embedding_size = inp.read_u32();
+        if (embedding_size != ctx->embedding.size()) {
+            throw std::runtime_error(format("session embedding size %u, expected %zu", embedding_size, ctx->embedding.size()));
+        }
 
-        llama_set_state_data(ctx, state_data.data());
+        inp.read(ctx->embedding.data(), sizeof(float)*embedding_size);
     }
+}
+
+// the complete records of a version 2 session file, walked without touching the context
+struct llama_session_scan {
+    struct entry {
+        llama_session_record rec;
+        size_t kv_offs; // the KV rows of the record
+    };
+
+    std::vector<entry>       records;
+    std::vector<llama_token> tokens;        // of all records
+    uint32_t                 kv_n      = 0; // KV rows in use after the last record
+    size_t                   tail_offs = 0; // rng, logits and embedding of the last record
+    size_t                   end_offs  = 0; // end of the last record, where the next one goes
+};
+
+// Walks the records from the position of inp. A record that does not fit the context throws; a
+// record cut short by the end of the file, as an interrupted llama_append_session_file() leaves
+// it, ends the walk, and the records before it are the snapshot.
+static void llama_scan_session_records(const struct llama_context * ctx, llama_data_read_context & inp, llama_session_scan & scan) {
+    scan.end_offs = inp.tell();
+
+    const auto fits = [&](size_t n) { return n <= inp.size() - inp.tell(); };
+
+    while (inp.tell() < inp.size()) {
+        llama_session_record rec;
+        if (!fits(sizeof(rec))) {
+            break;
+        }
+        inp.read(&rec, sizeof(rec));
+
+        llama_check_session_record(ctx, rec, scan.kv_n);
+
+        const size_t kv_size = llama_session_record_kv_size(ctx, rec);
+        if (!fits(sizeof(llama_token)*rec.n_tokens + kv_size)) {
+            break;
+        }
+
+        const size_t n_prev = scan.tokens.size();
+        scan.tokens.resize(n_prev + rec.n_tokens);
+        inp.read(scan.tokens.data() + n_prev, sizeof(llama_token)*rec.n_tokens);
+
+        const size_t kv_offs = inp.tell();
+        inp.skip(kv_size);
+
+        // the rng, the logits and the embedding: a size each, checked as in
+        // llama_read_session_record_tail(), and the data
+        const auto skip_array = [&](size_t elt_size, size_t max_size, bool exact) {
+            if (!fits(sizeof(uint32_t))) {
+                return false;
+            }
+            const uint32_t n = inp.read_u32();
+            if (n > max_size || (exact && n != max_size)) {
+                throw std::runtime_error(format("invalid session record: array of %u elements, at most %zu", n, max_size));
+            }
+            if (!fits(elt_size*n)) {
+                return false;
+            }
+            inp.skip(elt_size*n);
+            return true;
+        };
+
+        const size_t tail_offs = inp.tell();
+        if (!skip_array(sizeof(char),  LLAMA_MAX_RNG_STATE,    false) ||
+            !skip_array(sizeof(float), ctx->logits.capacity(), false) ||
+            !skip_array(sizeof(float), ctx->embedding.size(),  true)) {
+            scan.tokens.resize(n_prev);
+            break;
+        }
+
+        scan.records.push_back({ rec, kv_offs });
+        scan.kv_n      = rec.kv_n;
+        scan.tail_offs = tail_offs;
+        scan.end_offs  = inp.tell();
+    }
+}
+
+// Restores the snapshot of the records from the position of inp. The records are walked and
+// checked first and the context is only written once they are known to be good, so a file that
+// does not fit leaves the context as it was.
+static void llama_read_session_records(struct llama_context * ctx, llama_data_read_context & inp, llama_token * tokens_out, size_t n_token_capacity, size_t * n_token_count_out) {
+    llama_session_scan scan;
+    llama_scan_session_records(ctx, inp, scan);
+
+    if (scan.records.empty()) {
+        throw std::runtime_error("session file has no complete records");
+    }
+    if (scan.end_offs < inp.size()) {
+        LLAMA_LOG_WARN("%s: ignoring %zu bytes of an incomplete record at the end of the session file\n", __func__, inp.size() - scan.end_offs);
+    }
+    if (scan.tokens.size() > n_token_capacity) {
+        throw std::runtime_error(format("token count in session file exceeded capacity! %zu > %zu", scan.tokens.size(), n_token_capacity));
+    }
+
+    // the rng is the one part of the tail whose size does not tell whether it is good
+    {
+        inp.seek(scan.tail_offs);
+        const uint32_t rng_size = inp.read_u32();
+        std::string rng(rng_size, '\0');
+        inp.read(&rng[0], rng_size);
+
+        std::stringstream rng_ss(rng);
+        std::mt19937 rng_check;
+        rng_ss >> rng_check;
+        if (rng_ss.fail()) {
+            throw std::runtime_error("invalid rng state in session file");
+        }
+    }
+
+    const auto & kv_self = ctx->kv_self;
+    const auto & hparams = ctx->model.hparams;
+    const int    n_layer = hparams.n_layer;
+    const int    n_embd  = hparams.n_embd_gqa();
+    const int    n_ctx   = hparams.n_ctx;
+
+    const size_t k_elt = ggml_element_size(kv_self.k);
+    const size_t v_elt = ggml_element_size(kv_self.v);
+
+    uint8_t * k = (uint8_t *) kv_self.k->data;
+    uint8_t * v = (uint8_t *) kv_self.v->data;
+
+    for (const auto & entry : scan.records) {
+        const auto & rec = entry.rec;
+
+        const size_t n_rows = rec.kv_n - rec.kv_head;
+        if (n_rows == 0) {
+            continue;
+        }
+
+        inp.seek(entry.kv_offs);
+        for (int il = 0; il < n_layer; ++il) {
+            inp.read(k + k_elt*n_embd*((size_t) il*n_ctx + rec.kv_head), k_elt*n_embd*n_rows);
+        }
+
+        if (kv_self.v_trans) {
+            for (int il = 0; il < n_layer; ++il) {
+                for (int e = 0; e < n_embd; ++e) {
+                    inp.read(v + v_elt*(((size_t) il*n_embd + e)*n_ctx + rec.kv_head), v_elt*n_rows);
+                }
+            }
+        } else {
+            std::vector<uint8_t> buf(v_elt*n_embd*n_rows);
+            for (int il = 0; il < n_layer; ++il) {
+                inp.read(buf.data(), buf.size());
+                llama_transpose_copy(v + v_elt*n_embd*((size_t) il*n_ctx + rec.kv_head), buf.data(), n_rows, n_embd, v_elt);
+            }
+        }
+    }
+
+    // only the last record's rng, logits and embedding matter
+    inp.seek(scan.tail_offs);
+    llama_read_session_record_tail(ctx, inp);
+
+    ctx->kv_self.n = scan.kv_n;
+
+    std::copy(scan.tokens.begin(), scan.tokens.end(), tokens_out);
+    *n_token_count_out = scan.tokens.size();
+}
+
+static bool llama_load_session_file_internal(struct llama_context * ctx, const char * path_session, llama_token * tokens_out, size_t n_token_capacity, size_t * n_token_count_out) {
+    llama_file file(path_session, "rb");
+
+    uint32_t version;
+    if (!llama_read_session_header(ctx, file, &version)) {
+        return false;
+    }
+
+    if (version == LLAMA_SESSION_VERSION) {
+        // copy the used KV rows straight out of a mapping of the file; pages holding the
+        // superseded logits of earlier records are never touched
+        if (llama_mmap::SUPPORTED) {
+            llama_mmap mapping(&file, /* prefetch */ 0);
+            llama_data_mmap_read_context inp(&mapping, file.tell());
+            llama_read_session_records(ctx, inp, tokens_out, n_token_capacity, n_token_count_out);
+        } else {
+            llama_data_file_read_context inp(&file);
+            llama_read_session_records(ctx, inp, tokens_out, n_token_capacity, n_token_count_out);
+        }
+        return true;
+    }
+
+    // version 1: the prompt followed by a full llama_copy_state_data dump, both read and checked
+    // before the context and tokens_out are written
+
+    const uint32_t n_token_count = file.read_u32();
+
+    if (n_token_count > n_token_capacity) {
+        LLAMA_LOG_ERROR("%s : token count in session file exceeded capacity! %u > %zu\n", __func__, n_token_count, n_token_capacity);
+        return false;
+    }
+
+    std::vector<llama_token> tokens(n_token_count);
+    file.read_raw(tokens.data(), sizeof(llama_token) * n_token_count);
+
+    const size_t n_state_size_cur = file.size - file.tell();
+    const size_t n_state_size_max = llama_get_state_size(ctx);
+
+    if (n_state_size_cur > n_state_size_max) {
+        LLAMA_LOG_ERROR("%s : the state size in session file is too big! max %zu, got %zu\n", __func__, n_state_size_max, n_state_size_cur);
+        return false;
+    }
+
+    std::vector<uint8_t> state_data(n_state_size_max);
+    file.read_raw(state_data.data(), n_state_size_cur);
+
+    if (!llama_check_state_data(ctx, state_data.data(), n_state_size_cur)) {
+        LLAMA_LOG_ERROR("%s : the state in session file does not fit the context\n", __func__);
+        return false;
+    }
+
+    llama_set_state_data(ctx, state_data.data());
+
+    std::copy(tokens.begin(), tokens.end(), tokens_out);
+    *n_token_count_out = n_token_count;
 
     return true;
 }
@@ -6997,19 +8203,158 @@ bool llama_load_session_file(struct llama_context * ctx, const char * path_sessi
 bool llama_save_session_file(struct llama_context * ctx, const char * path_session, const llama_token * tokens, size_t n_token_count) {
     llama_file file(path_session, "wb");
 
-    file.write_u32(LLAMA_SESSION_MAGIC);
-    file.write_u32(LLAMA_SESSION_VERSION);
+    llama_write_session_header(ctx, file);
 
-    file.write_raw(&ctx->model.hparams, sizeof(llama_hparams));
+    // save the prompt and the used part of the context state as a single record
+    llama_data_file_context data_ctx(&file);
+    llama_write_session_record(ctx, &data_ctx, tokens, (uint32_t) n_token_count, 0);
+
+    return true;
+}
+
+// returns false if the snapshot in the file cannot be extended to the current state
+static bool llama_append_session_file_internal(struct llama_context * ctx, const char * path_session, const llama_token * tokens, size_t n_token_count) {
+    llama_file file(path_session, "r+b");
+
+    uint32_t version;
+    if (!llama_read_session_header(ctx, file, &version) || version != LLAMA_SESSION_VERSION) {
+        return false;
+    }
 
-    // save the prompt
-    file.write_u32((uint32_t) n_token_count);
-    file.write_raw(tokens, sizeof(llama_token) * n_token_count);
+    // the saved tokens must be a prefix of the current ones
+    llama_data_file_read_context inp(&file);
+
+    llama_session_scan scan;
+    llama_scan_session_records(ctx, inp, scan);
+
+    const size_t   n_saved  = scan.tokens.size();
+    const uint32_t kv_saved = scan.kv_n;
+
+    if (n_saved > n_token_count || !std::equal(scan.tokens.begin(), scan.tokens.end(), tokens)) {
+        return false;
+    }
+
+    if ((uint32_t) llama_get_kv_cache_token_count(ctx) < kv_saved) {
+        return false;
+    }
+
+    // an interrupted append left an incomplete record, the new one replaces it
+    if (scan.end_offs < file.size) {
+        file.truncate(scan.end_offs);
+    }
+
+    file.seek(0, SEEK_END);
 
-    // save the context state using stream saving
     llama_data_file_context data_ctx(&file);
-    llama_copy_state_data_internal(ctx, &data_ctx);
+    llama_write_session_record(ctx, &data_ctx, tokens + n_saved, (uint32_t) (n_token_count - n_saved), kv_saved);
+
+    return true;
+}
+
+bool llama_append_session_file(struct llama_context * ctx, const char * path_session, const llama_token * tokens, size_t n_token_count) {
+    try {
+        if (llama_append_session_file_internal(ctx, path_session, tokens, n_token_count)) {
+            return true;
+        }
+    } catch (const std::exception & err) {
+        LLAMA_LOG_WARN("%s: cannot append to session file: %s\n", __func__, err.what());
+    }
+
+    // missing, stale or truncated snapshot: rewrite it
+    try {
+        return llama_save_session_file(ctx, path_session, tokens, n_token_count);
+    } catch (const std::exception & err) {
+        LLAMA_LOG_ERROR("error saving session file: %s\n", err.what());
+        return false;
+    }
+}
+
+static void llama_autotune_save(const llama_context & lctx);
+
+// polls the sensors, sleeps the pause before an eval of n_tokens and returns its thread count
+static int llama_throttle_eval(llama_context & lctx, int n_tokens, int n_threads) {
+    auto & th = lctx.throttle;
+
+    if (th.poll(ggml_time_us())) {
+        if (lctx.throttle_policy) {
+            const llama_thermal_sample sample = { th.sample.temp_c, th.sample.freq_mhz, th.sample.freq_max_mhz };
+            const llama_throttle_decision d = lctx.throttle_policy(&sample, n_threads, lctx.throttle_policy_user_data);
+            th.n_threads_cap = std::max(0, d.n_threads);
+            th.pause_ms      = std::max(0.0, d.pause_ms);
+        } else {
+            th.step(n_threads);
+        }
+    }
+
+    const int64_t t_pause_us = th.pause_us(n_tokens, ggml_time_us());
+    if (t_pause_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(t_pause_us));
+        lctx.t_pause_us += t_pause_us;
+        lctx.n_pause++;
+    }
+    if (n_tokens == 1) {
+        th.t_last_decode_us = ggml_time_us();
+    }
+
+    const int n_threads_eval = th.n_threads(n_threads);
+    if (n_threads_eval < n_threads) {
+        lctx.n_throttled++;
+    }
+    return n_threads_eval;
+}
+
+// llama_eval_internal with the thread count and the batch size of the autotuner: single tokens
+// and prompt batches with the thread count of their phase, prompt batches split in pieces of the
+// batch size. The evals of the candidates are timed and reported.
+static bool llama_eval_autotune(
+         llama_context & lctx,
+     const llama_token * tokens,
+                   int   n_tokens,
+                   int   n_past,
+                   int   n_threads) {
+    auto & at = lctx.autotune;
+    if (!at.started) {
+        // every piece would replace the logits of the one before
+        at.start(n_threads, lctx.n_batch, !lctx.logits_all);
+        if (at.done(AUTOTUNE_DECODE) || at.done(AUTOTUNE_PREFILL)) {
+            llama_autotune_save(lctx);
+        }
+    }
 
+    if (n_tokens == 1) {
+        const int64_t t_start_us = ggml_time_us();
+        if (!llama_eval_internal(lctx, tokens, nullptr, 1, n_past, std::min(at.n_threads(AUTOTUNE_DECODE), n_threads), nullptr)) {
+            return false;
+        }
+        if (!at.done(AUTOTUNE_DECODE) && at.add(AUTOTUNE_DECODE, 1, ggml_time_us() - t_start_us)) {
+            llama_autotune_save(lctx);
+        }
+        return true;
+    }
+
+    bool counted = false;
+    bool settled = false;
+    for (int i = 0; i < n_tokens; ) {
+        const int n_batch = at.n_batch();
+        const int n       = n_batch > 0 ? std::min(n_batch, n_tokens - i) : n_tokens - i;
+
+        const int64_t t_start_us = ggml_time_us();
+        if (!llama_eval_internal(lctx, tokens + i, nullptr, n, n_past + i, std::min(at.n_threads(AUTOTUNE_PREFILL), n_threads), nullptr)) {
+            return false;
+        }
+        // the rest of a prompt batch after the last full piece is not a sample of the batch size
+        if (!at.done(AUTOTUNE_PREFILL) && (n_batch > 0 ? n == n_batch : n > 1)) {
+            settled = at.add(AUTOTUNE_PREFILL, n, ggml_time_us() - t_start_us) || settled;
+            counted = true;
+        }
+        i += n;
+    }
+    if (!counted && !at.done(AUTOTUNE_PREFILL)) {
+        settled = at.miss() || settled;
+    }
+    if (settled) {
+        llama_autotune_save(lctx);
+    }
     return true;
 }
 
@@ -7019,7 +8364,16 @@ int llama_eval(
                          int   n_tokens,
                          int   n_past,
                          int   n_threads) {
-    if (!llama_eval_internal(*ctx, tokens, nullptr, n_tokens, n_past, n_threads, nullptr)) {
+    if (ctx->throttle.enabled) {
+        n_threads = llama_throttle_eval(*ctx, n_tokens, n_threads);
+    }
+
+    const int64_t t_start_us = ggml_time_us();
+
+    const bool ok = ctx->autotune.enabled
+        ? llama_eval_autotune(*ctx, tokens, n_tokens, n_past, n_threads)
+        : llama_eval_internal(*ctx, tokens, nullptr, n_tokens, n_past, n_threads, nullptr);
+    if (!ok) {
         LLAMA_LOG_ERROR("%s: failed to eval\n", __func__);
         return 1;
     }
@@ -7029,6 +8383,7 @@ int llama_eval(
     if (!ctx->has_evaluated_once) {
         ctx->t_load_us = ggml_time_us() - ctx->t_start_us;
         ctx->has_evaluated_once = true;
+        ctx->load.add(LOAD_PHASE_FIRST_EVAL, t_start_us, ggml_time_us());
     }
 
     return 0;
@@ -7040,6 +8395,8 @@ int llama_eval_embd(
                              int   n_tokens,
                              int   n_past,
                              int   n_threads) {
+    const int64_t t_start_us = ggml_time_us();
+
     if (!llama_eval_internal(*ctx, nullptr, embd, n_tokens, n_past, n_threads, nullptr)) {
         LLAMA_LOG_ERROR("%s: failed to eval\n", __func__);
         return 1;
@@ -7050,6 +8407,7 @@ int llama_eval_embd(
     if (!ctx->has_evaluated_once) {
         ctx->t_load_us = ggml_time_us() - ctx->t_start_us;
         ctx->has_evaluated_once = true;
+        ctx->load.add(LOAD_PHASE_FIRST_EVAL, t_start_us, ggml_time_us());
     }
 
     return 0;
@@ -7179,9 +8537,14 @@ struct llama_timings llama_get_timings(struct llama_context * ctx) {
         /*.t_p_eval_ms =*/ 1e-3 * ctx->t_p_eval_us,
         /*.t_eval_ms   =*/ 1e-3 * ctx->t_eval_us,
 
-        /*.n_sample =*/ std::max(1, ctx->n_sample),
-        /*.n_p_eval =*/ std::max(1, ctx->n_p_eval),
-        /*.n_eval   =*/ std::max(1, ctx->n_eval),
+        /*.t_first_token_ms =*/ 1e-3 * ctx->latency.t_first_token_us,
+        /*.t_pause_ms       =*/ 1e-3 * ctx->t_pause_us,
+
+        /*.n_sample    =*/ std::max(1, ctx->n_sample),
+        /*.n_p_eval    =*/ std::max(1, ctx->n_p_eval),
+        /*.n_eval      =*/ std::max(1, ctx->n_eval),
+        /*.n_pause     =*/ ctx->n_pause,
+        /*.n_throttled =*/ ctx->n_throttled,
     };
 
     return result;
@@ -7199,6 +8562,39 @@ void llama_print_timings(struct llama_context * ctx) {
     LLAMA_LOG_INFO("%s:        eval time = %8.2f ms / %5d runs   (%8.2f ms per token, %8.2f tokens per second)\n",
             __func__, timings.t_eval_ms, timings.n_eval, timings.t_eval_ms / timings.n_eval, 1e3 / timings.t_eval_ms * timings.n_eval);
     LLAMA_LOG_INFO("%s:       total time = %8.2f ms\n", __func__, (timings.t_end_ms - timings.t_start_ms));
+
+    const llama_latency_stats ttft = llama_get_latency_stats(ctx, LLAMA_LATENCY_FIRST_TOKEN);
+    const llama_latency_stats itl  = llama_get_latency_stats(ctx, LLAMA_LATENCY_TOKEN);
+    if (ttft.n > 0) {
+        LLAMA_LOG_INFO("%s:   time to 1st tok = %8.2f ms / %5d turns  (p50 %8.2f, p90 %8.2f, p99 %8.2f ms)\n",
+                __func__, timings.t_first_token_ms, ttft.n, ttft.p50_ms, ttft.p90_ms, ttft.p99_ms);
+    }
+    if (itl.n > 0) {
+        LLAMA_LOG_INFO("%s:  inter-token time = %8.2f ms / %5d tokens (p50 %8.2f, p90 %8.2f, p99 %8.2f ms)\n",
+                __func__, itl.mean_ms, itl.n, itl.p50_ms, itl.p90_ms, itl.p99_ms);
+    }
+    if (timings.n_pause > 0 || timings.n_throttled > 0) {
+        LLAMA_LOG_INFO("%s:    throttle pause = %8.2f ms / %5d evals  (%d evals with fewer threads)\n",
+                __func__, timings.t_pause_ms, timings.n_pause, timings.n_throttled);
+    }
+}
+
+struct llama_load_timings llama_get_load_timings(const struct llama_context * ctx) {
+    const auto & load = ctx->load;
+
+    struct llama_load_timings result = {
+        /*.t_meta_ms       =*/ 1e-3 * load.t_us[LOAD_PHASE_META],
+        /*.t_vocab_ms      =*/ 1e-3 * load.t_us[LOAD_PHASE_VOCAB],
+        /*.t_tensors_ms    =*/ 1e-3 * load.t_us[LOAD_PHASE_TENSORS],
+        /*.t_data_ms       =*/ 1e-3 * load.t_us[LOAD_PHASE_DATA],
+        /*.t_repack_ms     =*/ 1e-3 * load.t_us[LOAD_PHASE_REPACK],
+        /*.t_mlock_ms      =*/ 1e-3 * load.t_us[LOAD_PHASE_MLOCK],
+        /*.t_context_ms    =*/ 1e-3 * load.t_us[LOAD_PHASE_CONTEXT],
+        /*.t_first_eval_ms =*/ 1e-3 * load.t_us[LOAD_PHASE_FIRST_EVAL],
+        /*.t_total_ms      =*/ 1e-3 * load.total_us(),
+    };
+
+    return result;
 }
 
 void llama_reset_timings(struct llama_context * ctx) {
@@ -7206,6 +8602,297 @@ void llama_reset_timings(struct llama_context * ctx) {
     ctx->t_sample_us = ctx->n_sample = 0;
     ctx->t_eval_us   = ctx->n_eval   = 0;
     ctx->t_p_eval_us = ctx->n_p_eval = 0;
+    ctx->t_pause_us  = ctx->n_pause  = 0;
+    ctx->n_throttled = 0;
+    ctx->latency.reset();
+}
+
+static_assert((int) LLAMA_LATENCY_TOKEN       == (int) LATENCY_TOKEN,       "llama_latency mismatch");
+static_assert((int) LLAMA_LATENCY_EVAL        == (int) LATENCY_EVAL,        "llama_latency mismatch");
+static_assert((int) LLAMA_LATENCY_P_EVAL      == (int) LATENCY_P_EVAL,      "llama_latency mismatch");
+static_assert((int) LLAMA_LATENCY_SAMPLE      == (int) LATENCY_SAMPLE,      "llama_latency mismatch");
+static_assert((int) LLAMA_LATENCY_FIRST_TOKEN == (int) LATENCY_FIRST_TOKEN, "llama_latency mismatch");
+
+struct llama_latency_stats llama_get_latency_stats(struct llama_context * ctx, enum llama_latency latency) {
+    GGML_ASSERT((int) latency >= 0 && (int) latency < LATENCY_COUNT);
+
+    const latency_histogram & hist = ctx->latency.hist[latency];
+
+    struct llama_latency_stats result = {
+        /*.n       =*/ (int32_t) hist.n,
+        /*.min_ms  =*/ 1e-3 * hist.min_us,
+        /*.mean_ms =*/ 1e-3 * hist.mean_us(),
+        /*.p50_ms  =*/ 1e-3 * hist.percentile_us(50.0),
+        /*.p90_ms  =*/ 1e-3 * hist.percentile_us(90.0),
+        /*.p99_ms  =*/ 1e-3 * hist.percentile_us(99.0),
+        /*.max_ms  =*/ 1e-3 * hist.max_us,
+    };
+
+    return result;
+}
+
+double llama_get_latency_percentile(struct llama_context * ctx, enum llama_latency latency, double p) {
+    GGML_ASSERT((int) latency >= 0 && (int) latency < LATENCY_COUNT);
+
+    return 1e-3 * ctx->latency.hist[latency].percentile_us(p);
+}
+
+struct llama_memory_info llama_get_memory_info(struct llama_context * ctx) {
+    const auto & model = ctx->model;
+    const auto & kv    = ctx->kv_self;
+
+    struct llama_memory_info info = {};
+
+    info.model_size = llama_model_size(&model);
+    if (model.mapping) {
+        info.model_mapped   = model.mapping->size;
+        info.model_resident = llama_resident_size(model.mapping->addr, model.mapping->size);
+    } else {
+        info.model_resident = llama_resident_size(model.buf.data, model.buf.size);
+    }
+    info.model_resident = std::min(info.model_resident, info.model_size);
+    info.model_locked   = model.mlock_buf.size + model.mlock_mmap.size;
+
+    if (kv.k && kv.v) {
+        const size_t kv_bytes = ggml_nbytes(kv.k) + ggml_nbytes(kv.v);
+        info.kv_n_ctx  = model.hparams.n_ctx;
+        info.kv_n_used = std::min((int32_t) kv.n, info.kv_n_ctx);
+        info.kv_size   = kv.buf.size;
+        info.kv_used   = kv_bytes / info.kv_n_ctx * info.kv_n_used;
+    }
+
+    info.compute_meta = ctx->buf_compute.size;
+    info.compute_size = ctx->buf_alloc.size;
+    info.compute_peak = ctx->alloc ? ggml_allocr_max_size(ctx->alloc) : 0;
+    info.work_size    = ctx->work_buffer.capacity();
+
+    info.output_size  = ctx->logits.capacity()*sizeof(float) + ctx->embedding.capacity()*sizeof(float);
+
+    info.context_total = info.kv_size + info.compute_meta + info.compute_size + info.work_size + info.output_size;
+
+    return info;
+}
+
+void llama_print_memory_info(struct llama_context * ctx) {
+    const llama_memory_info info = llama_get_memory_info(ctx);
+
+    const double MiB = 1024.0*1024.0;
+
+    LLAMA_LOG_INFO("\n");
+    LLAMA_LOG_INFO("%s:   model = %8.2f MB (mapped %8.2f MB, resident %8.2f MB, locked %8.2f MB)\n", __func__,
+            info.model_size/MiB, info.model_mapped/MiB, info.model_resident/MiB, info.model_locked/MiB);
+    LLAMA_LOG_INFO("%s:      kv = %8.2f MB (used %8.2f MB, %d / %d tokens)\n", __func__,
+            info.kv_size/MiB, info.kv_used/MiB, info.kv_n_used, info.kv_n_ctx);
+    LLAMA_LOG_INFO("%s: compute = %8.2f MB (peak %8.2f MB, + %8.2f MB graph, + %8.2f MB work)\n", __func__,
+            info.compute_size/MiB, info.compute_peak/MiB, info.compute_meta/MiB, info.work_size/MiB);
+    LLAMA_LOG_INFO("%s:  output = %8.2f MB\n", __func__, info.output_size/MiB);
+    LLAMA_LOG_INFO("%s: context = %8.2f MB\n", __func__, info.context_total/MiB);
+}
+
+void llama_set_profiling(struct llama_context * ctx, bool enable) {
+    if (enable && ctx->profile == NULL) {
+        ctx->profile = ggml_profile_new();
+    }
+    ctx->profiling = enable;
+}
+
+void llama_print_profile(struct llama_context * ctx) {
+    if (ctx->profile) {
+        ggml_profile_print(ctx->profile);
+    }
+}
+
+bool llama_export_profile_trace(struct llama_context * ctx, const char * fname) {
+    if (ctx->profile == NULL) {
+        LLAMA_LOG_ERROR("%s: profiling was never enabled\n", __func__);
+        return false;
+    }
+    if (!ggml_profile_export_trace(ctx->profile, fname)) {
+        LLAMA_LOG_ERROR("%s: failed to write %s\n", __func__, fname);
+        return false;
+    }
+    return true;
+}
+
+void llama_reset_profile(struct llama_context * ctx) {
+    if (ctx->profile) {
+        ggml_profile_reset(ctx->profile);
+    }
+}
+
+static std::string llama_cpu_name() {
+    std::string name;
+#if defined(__APPLE__)
+    char buf[256];
+    size_t size = sizeof(buf);
+    if (sysctlbyname("machdep.cpu.brand_string", buf, &size, NULL, 0) == 0) {
+        name = std::string(buf, strnlen(buf, size));
+    }
+#elif defined(__linux__)
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("model name", 0) == 0) {
+            const size_t pos = line.find_first_not_of(" \t:", line.find(':'));
+            if (pos != std::string::npos) {
+                name = line.substr(pos);
+            }
+            break;
+        }
+    }
+#endif
+    return name.empty() ? "unknown" : name;
+}
+
+// the model and the host the choices of the autotuner hold for
+static std::string llama_autotune_key(const llama_context & lctx) {
+    char desc[128];
+    llama_model_desc(&lctx.model, desc, sizeof(desc));
+
+    std::string key = std::string(desc) + " | " + std::to_string(llama_model_size(&lctx.model))
+        + " | " + std::to_string(llama_model_n_params(&lctx.model))
+        + " | " + llama_cpu_name() + " | " + std::to_string(std::thread::hardware_concurrency())
+        + " | " + std::to_string(ggml_cpu_features());
+
+    // one entry per line, the fields are separated by tabs
+    std::replace_if(key.begin(), key.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    return key;
+}
+
+// the lines of the cache file, without the entry of key
+static std::vector<std::string> llama_autotune_read(const std::string & path, const std::string & key, std::string * entry) {
+    std::vector<std::string> lines;
+    std::ifstream fin(path);
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.size() > key.size() && line.compare(0, key.size(), key) == 0 && line[key.size()] == '\t') {
+            if (entry) {
+                *entry = line.substr(key.size() + 1);
+            }
+            continue;
+        }
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+static void llama_autotune_save(const llama_context & lctx) {
+    if (lctx.autotune_path.empty()) {
+        return;
+    }
+    std::vector<std::string> lines = llama_autotune_read(lctx.autotune_path, lctx.autotune_key, nullptr);
+    lines.push_back(lctx.autotune.entry_line(lctx.autotune_key));
+
+    // written aside and renamed, another process may read the file meanwhile
+    const std::string path_tmp = lctx.autotune_path + ".tmp";
+    std::ofstream fout(path_tmp, std::ios::trunc);
+    for (const auto & line : lines) {
+        fout << line << '\n';
+    }
+    fout.close();
+    if (!fout || std::rename(path_tmp.c_str(), lctx.autotune_path.c_str()) != 0) {
+        LLAMA_LOG_WARN("%s: failed to write %s\n", __func__, lctx.autotune_path.c_str());
+        std::remove(path_tmp.c_str());
+    }
+}
+
+void llama_set_autotune(struct llama_context * ctx, bool enable, const char * cache_path) {
+    auto & at = ctx->autotune;
+#ifdef GGML_USE_METAL
+    if (enable && ctx->ctx_metal) {
+        LLAMA_LOG_WARN("%s: the evals run on Metal, not tuning\n", __func__);
+        enable = false;
+    }
+#endif
+    at.enabled = enable;
+    at.reset();
+    ctx->autotune_path = cache_path ? cache_path : "";
+    if (!enable) {
+        return;
+    }
+
+    ctx->autotune_key = llama_autotune_key(*ctx);
+    if (ctx->autotune_path.empty()) {
+        return;
+    }
+    std::string entry;
+    llama_autotune_read(ctx->autotune_path, ctx->autotune_key, &entry);
+    int n_threads_decode  = 0;
+    int n_threads_prefill = 0;
+    int n_batch_prefill   = 0;
+    if (!entry.empty() && sscanf(entry.c_str(), "%d\t%d\t%d", &n_threads_decode, &n_threads_prefill, &n_batch_prefill) == 3) {
+        at.set_choice(n_threads_decode, n_threads_prefill, n_batch_prefill);
+        LLAMA_LOG_INFO("%s: from %s: decode n_threads = %d, prefill n_threads = %d, n_batch = %d (0 = not tuned yet)\n", __func__,
+                ctx->autotune_path.c_str(), n_threads_decode, n_threads_prefill, n_batch_prefill);
+    }
+}
+
+struct llama_throttle_params llama_throttle_default_params(void) {
+    struct llama_throttle_params result = {
+        /*.target_tok_s     =*/ 0.0,
+        /*.max_temp_c       =*/ 0.0,
+        /*.min_freq_ratio   =*/ 0.0,
+        /*.min_threads      =*/ 1,
+        /*.poll_ms          =*/ 1000,
+        /*.sensor_path      =*/ NULL,
+        /*.policy           =*/ NULL,
+        /*.policy_user_data =*/ NULL,
+    };
+
+    return result;
+}
+
+void llama_set_throttle(struct llama_context * ctx, const struct llama_throttle_params * params) {
+    auto & th = ctx->throttle;
+    th.reset();
+    th.enabled = params != NULL;
+    if (!params) {
+        ctx->throttle_policy           = NULL;
+        ctx->throttle_policy_user_data = NULL;
+        return;
+    }
+
+    th.target_tok_s   = params->target_tok_s;
+    th.max_temp_c     = params->max_temp_c;
+    th.min_freq_ratio = params->min_freq_ratio;
+    th.min_threads    = std::max(1, params->min_threads);
+    th.poll_us        = 1000*(int64_t) std::max(0, params->poll_ms);
+    th.sensor_path    = params->sensor_path ? params->sensor_path : "";
+
+    ctx->throttle_policy           = params->policy;
+    ctx->throttle_policy_user_data = params->policy_user_data;
+}
+
+struct llama_throttle_state llama_get_throttle_state(const struct llama_context * ctx) {
+    const auto & th = ctx->throttle;
+
+    struct llama_throttle_state state = {
+        /*.sample   =*/ { th.sample.temp_c, th.sample.freq_mhz, th.sample.freq_max_mhz },
+        /*.decision =*/ { th.n_threads_cap, th.pause_ms },
+    };
+
+    return state;
+}
+
+struct llama_autotune_info llama_get_autotune_info(const struct llama_context * ctx) {
+    const auto & at  = ctx->autotune;
+    const auto & dec = at.phases[AUTOTUNE_DECODE];
+    const auto & pre = at.phases[AUTOTUNE_PREFILL];
+
+    struct llama_autotune_info info = {};
+
+    info.decode_done       = dec.done;
+    info.prefill_done      = pre.done;
+    info.from_cache        = at.from_cache;
+    info.n_threads_decode  = at.started ? at.n_threads(AUTOTUNE_DECODE)  : dec.n_threads;
+    info.n_threads_prefill = at.started ? at.n_threads(AUTOTUNE_PREFILL) : pre.n_threads;
+    info.n_batch_prefill   = at.started ? at.n_batch()                   : pre.n_batch;
+    info.decode_tok_s      = dec.tok_s;
+    info.prefill_tok_s     = pre.tok_s;
+
+    return info;
 }
 
 const char * llama_print_system_info(void) {
@@ -7217,6 +8904,7 @@ const char * llama_print_system_info(void) {
     s += "AVX512 = "      + std::to_string(ggml_cpu_has_avx512())      + " | ";
     s += "AVX512_VBMI = " + std::to_string(ggml_cpu_has_avx512_vbmi()) + " | ";
     s += "AVX512_VNNI = " + std::to_string(ggml_cpu_has_avx512_vnni()) + " | ";
+    s += "AVX_VNNI = "    + std::to_string(ggml_cpu_has_avx_vnni())    + " | ";
     s += "FMA = "         + std::to_string(ggml_cpu_has_fma())         + " | ";
     s += "NEON = "        + std::to_string(ggml_cpu_has_neon())        + " | ";
     s += "ARM_FMA = "     + std::to_string(ggml_cpu_has_arm_fma())     + " | ";
@@ -7251,12 +8939,17 @@ void llama_dump_timing_info_yaml(FILE * stream, const llama_context * ctx) {
     fprintf(stream, "t_load_us: %" PRId64 "  # total microseconds spent loading the model\n", ctx->t_load_us);
     fprintf(stream, "t_p_eval_us: %" PRId64 "  # total microseconds spent prompt processing\n", ctx->t_p_eval_us);
     fprintf(stream, "t_sample_us: %" PRId64 "  # total microseconds spent sampling\n", ctx->t_sample_us);
+    fprintf(stream, "t_pause_us: %" PRId64 "  # total microseconds paused by the throttle\n", ctx->t_pause_us);
+    fprintf(stream, "n_pause: %d  # number of evals paused by the throttle\n", ctx->n_pause);
+    fprintf(stream, "n_throttled: %d  # number of evals with fewer threads by the throttle\n", ctx->n_throttled);
     fprintf(stream, "ts_eval: %.2f  # tokens / second during generation\n",
             1.0e6 * ctx->n_eval / ctx->t_eval_us);
     fprintf(stream, "ts_p_eval: %.2f  # tokens / second during prompt processing\n",
             1.0e6 * ctx->n_p_eval / ctx->t_p_eval_us);
     fprintf(stream, "ts_sample: %.2f  # tokens / second during sampling\n",
             1.0e6 * ctx->n_sample / ctx->t_sample_us);
+    ctx->load.dump_yaml(stream);
+    ctx->latency.dump_yaml(stream);
 }
 
 // For internal test use
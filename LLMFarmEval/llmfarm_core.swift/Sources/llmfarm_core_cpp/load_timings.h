@@ -0,0 +1,62 @@
+// Phases of loading a model and creating its context (llama_context and gpt_base_context).
+//
+// t_load_us is one number for a cold start. load_timings keeps the time of each phase, so that a
+// regression can be traced to the metadata, the vocabulary, the weights or the first eval, see
+// llama_get_load_timings() and gpt_base_get_load_timings(). The phases do not overlap, their sum
+// is the time from opening the file to the end of the first eval.
+
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+
+enum load_phase {
+    LOAD_PHASE_META,       // opening the file, the header and the hyperparameters
+    LOAD_PHASE_VOCAB,      // the vocabulary: token_to_id, the scores, the merges
+    LOAD_PHASE_TENSORS,    // the weights context and its tensors
+    LOAD_PHASE_DATA,       // reading or mapping the tensor data
+    LOAD_PHASE_REPACK,     // interleaving the rows of the weights, see ggml_repack()
+    LOAD_PHASE_MLOCK,      // locking the weights in memory
+    LOAD_PHASE_CONTEXT,    // the KV cache, the output and the compute buffers of the context
+    LOAD_PHASE_FIRST_EVAL, // the first eval, with the page faults of the mapped weights
+    LOAD_PHASE_COUNT,
+};
+
+struct load_timings {
+    int64_t t_us[LOAD_PHASE_COUNT] = {};
+
+    // the phase ran from t_start_us to t_end_us, phases that run more than once add up
+    void add(load_phase phase, int64_t t_start_us, int64_t t_end_us) {
+        t_us[phase] += t_end_us - t_start_us;
+    }
+
+    int64_t total_us() const {
+        int64_t total = 0;
+        for (int i = 0; i < LOAD_PHASE_COUNT; i++) {
+            total += t_us[i];
+        }
+        return total;
+    }
+
+    void dump_yaml(FILE * stream) const {
+        static const char * names[LOAD_PHASE_COUNT] = {
+            "meta", "vocab", "tensors", "data", "repack", "mlock", "context", "first_eval",
+        };
+        static const char * descs[LOAD_PHASE_COUNT] = {
+            "file header and hyperparameters",
+            "vocabulary",
+            "weights context and tensors",
+            "reading or mapping the weights",
+            "repacking the weights",
+            "locking the weights",
+            "KV cache and buffers of the context",
+            "first eval, with the page faults of mapped weights",
+        };
+
+        fprintf(stream, "load_phases_us:  # total %" PRId64 "\n", total_us());
+        for (int i = 0; i < LOAD_PHASE_COUNT; i++) {
+            fprintf(stream, "  %s: %" PRId64 "  # %s\n", names[i], t_us[i], descs[i]);
+        }
+    }
+};
@@ -183,7 +183,9 @@ void replit_free(struct replit_context * ctx) {
     delete ctx;
 }
 // load the model's weights from a file
-bool replit_model_load(const std::string & fname, replit_model & model, replit_tokenizer & vocab) {
+bool replit_model_load(const std::string & fname, replit_model & model, replit_tokenizer & vocab, load_timings & load) {
+    int64_t t_start_us = ggml_dadbed9_time_us();
+
     printf("%s: loading model from '%s' - please wait ...\n", __func__, fname.c_str());
 
     auto fin = std::ifstream(fname, std::ios::binary);
@@ -226,9 +228,15 @@ bool replit_model_load(const std::string & fname, replit_model & model, replit_t
         hparams.ftype %= GGML_dadbed9_QNT_VERSION_FACTOR;
     }
 
+    load.add(LOAD_PHASE_META, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load vocab
     replit_tokenizer_load(vocab, fin, model.hparams.n_vocab);
 
+    load.add(LOAD_PHASE_VOCAB, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // for the big tensors, we have the option to store the data in 16-bit
     // floats or quantized in order to save memory and also to speed up the
     // computation
@@ -261,8 +269,8 @@ bool replit_model_load(const std::string & fname, replit_model & model, replit_t
         ctx_size += n_layer * (4 * n_embd * n_embd * ggml_dadbed9_type_sizef(wtype)); // mlp_mlp_up_weight
         ctx_size += n_layer * (n_embd * n_embd * 4 * ggml_dadbed9_type_sizef(wtype)); // mlp_mlp_down_weight
 
-        ctx_size += n_ctx * n_layer * n_embd * ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F16); // memory_k
-        ctx_size += n_ctx * n_layer * n_embd * ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F16); // memory_v
+        ctx_size += gpt_kv_n_rows(n_ctx) * n_layer * n_embd * ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F16); // memory_k
+        ctx_size += gpt_kv_n_rows(n_ctx) * n_layer * n_embd * ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F16); // memory_v
 
         ctx_size += (1 + 6 * n_layer) * 512; // object overhead
 
@@ -330,7 +338,8 @@ bool replit_model_load(const std::string & fname, replit_model & model, replit_t
         const int n_layer = hparams.n_layers;
         const int n_ctx = hparams.max_seq_len;
 
-        const int64_t n_mem = n_layer * n_ctx;
+        // the context window slides over the spare rows, see gpt_kv_window
+        const int64_t n_mem = n_layer * gpt_kv_n_rows(n_ctx);
         const int64_t n_elements = n_embd * n_mem;
 
         model.memory_k = ggml_dadbed9_new_tensor_1d(ctx, GGML_dadbed9_TYPE_F16, n_elements);
@@ -341,6 +350,9 @@ bool replit_model_load(const std::string & fname, replit_model & model, replit_t
         printf("%s: memory_size = %8.2f MB, n_mem = %lld\n", __func__, memory_size / 1024.0 / 1024.0, n_mem);
     }
 
+    load.add(LOAD_PHASE_TENSORS, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load weights
     {
         int n_tensors = 0;
@@ -422,6 +434,8 @@ bool replit_model_load(const std::string & fname, replit_model & model, replit_t
 
     fin.close();
 
+    load.add(LOAD_PHASE_DATA, t_start_us, ggml_dadbed9_time_us());
+
     return true;
 }
 
@@ -430,10 +444,11 @@ bool replit_model_load(const std::string & fname, replit_model & model, replit_t
 //   - model:     the model
 //   - n_threads: number of threads to use
 //   - n_past:    the context size so far
+//   - kv:        where the context window is in the KV cache
 //   - embd_inp:  the embeddings of the tokens in the context
 //   - embd_w:    the predicted logits for the next token
 //
-bool replit_eval(const replit_model & model, const int n_threads, const int n_past,
+bool replit_eval(const replit_model & model, const int n_threads, const int n_past, const gpt_kv_window & kv,
                  const std::vector<gpt_vocab::id> & embd_inp, std::vector<float> & embd_w, bool logits_all,
                  size_t & mem_per_token) {
     const int N = embd_inp.size();
@@ -444,7 +459,10 @@ bool replit_eval(const replit_model & model, const int n_threads, const int n_pa
     const int n_layer = hparams.n_layers;
     const int n_head = hparams.n_heads;
     const int n_vocab = hparams.n_vocab;
-    const int n_ctx = hparams.max_seq_len;
+
+    // cache rows per layer and the first row of the window
+    const int n_rows = kv.n_rows;
+    const int kv_head = kv.head;
 
     static size_t buf_size = 256u * 1024 * 1024;
     static void * buf = malloc(buf_size);
@@ -504,10 +522,10 @@ bool replit_eval(const replit_model & model, const int n_threads, const int n_pa
             {
                 struct ggml_dadbed9_tensor * k =
                     ggml_dadbed9_view_1d(ctx0, model.memory_k, N * n_embd,
-                                 (ggml_dadbed9_element_size(model.memory_k) * n_embd) * (il * n_ctx + n_past));
+                                 (ggml_dadbed9_element_size(model.memory_k) * n_embd) * (il * n_rows + kv_head + n_past));
                 struct ggml_dadbed9_tensor * v =
                     ggml_dadbed9_view_1d(ctx0, model.memory_v, N * n_embd,
-                                 (ggml_dadbed9_element_size(model.memory_v) * n_embd) * (il * n_ctx + n_past));
+                                 (ggml_dadbed9_element_size(model.memory_v) * n_embd) * (il * n_rows + kv_head + n_past));
 
                 ggml_dadbed9_build_forward_expand(&gf, ggml_dadbed9_cpy(ctx0, Kcur, k));
                 ggml_dadbed9_build_forward_expand(&gf, ggml_dadbed9_cpy(ctx0, Vcur, v));
@@ -525,7 +543,7 @@ bool replit_eval(const replit_model & model, const int n_threads, const int n_pa
                 ggml_dadbed9_permute(ctx0,
                              ggml_dadbed9_reshape_3d(ctx0,
                                              ggml_dadbed9_view_1d(ctx0, model.memory_k, (n_past + N) * n_embd,
-                                                          il * n_ctx * ggml_dadbed9_element_size(model.memory_k) * n_embd),
+                                                          (il * n_rows + kv_head) * ggml_dadbed9_element_size(model.memory_k) * n_embd),
                                              n_embd / n_head, n_head, n_past + N),
                              0, 2, 1, 3);
             // K * Q
@@ -550,7 +568,7 @@ bool replit_eval(const replit_model & model, const int n_threads, const int n_pa
                 ggml_dadbed9_permute(ctx0,
                              ggml_dadbed9_reshape_3d(ctx0,
                                              ggml_dadbed9_view_1d(ctx0, model.memory_v, (n_past + N) * n_embd,
-                                                          il * n_ctx * ggml_dadbed9_element_size(model.memory_v) * n_embd),
+                                                          (il * n_rows + kv_head) * ggml_dadbed9_element_size(model.memory_v) * n_embd),
                                              n_embd / n_head, n_head, n_past + N),
                              1, 2, 0, 3),
                 ggml_dadbed9_new_tensor_3d(ctx0, model.memory_v->type, n_past + N, n_embd / n_head, n_head));
@@ -645,6 +663,7 @@ struct replit_context * replit_init_from_file(const char * path_model, struct gp
     ggml_dadbed9_time_init();
 
     replit_context * ctx = new replit_context;
+    ctx->t_start_us = ggml_dadbed9_time_us();
 
     if (params.seed <= 0) {
         params.seed = time(NULL);
@@ -657,12 +676,25 @@ struct replit_context * replit_init_from_file(const char * path_model, struct gp
     
     
 //    replit_model_load(const std::string & fname, replit_model & model, replit_tokenizer & vocab)
-    if (!replit_model_load(path_model, ctx->model, ctx->vocab)) {
+    if (!replit_model_load(path_model, ctx->model, ctx->vocab, ctx->load)) {
         fprintf(stderr, "%s: failed to load model\n", __func__);
         delete ctx;
         return nullptr;
     }
 
+    const int64_t t_start_context_us = ggml_dadbed9_time_us();
+
+    // the context window in the KV cache
+    {
+        auto & kv = ctx->kv_window;
+        kv.k        = (uint8_t *) ctx->model.memory_k->data;
+        kv.v        = (uint8_t *) ctx->model.memory_v->data;
+        kv.elt_size = ggml_dadbed9_element_size(ctx->model.memory_k);
+        kv.n_embd   = ctx->model.hparams.d_model;
+        kv.n_layer  = ctx->model.hparams.n_layers;
+        kv.n_rows   = gpt_kv_n_rows(ctx->model.hparams.max_seq_len);
+        kv.v_trans  = false;
+    }
 
     // reserve memory for context buffers
     if (!params.vocab_only) {
@@ -696,6 +728,8 @@ struct replit_context * replit_init_from_file(const char * path_model, struct gp
 //        ctx->buf_scratch[1].resize(MEM_REQ_SCRATCH1().at(ctx->model.type));
     }
 
+    ctx->load.add(LOAD_PHASE_CONTEXT, t_start_context_us, ggml_dadbed9_time_us());
+
     return ctx;
 }
 
@@ -726,7 +760,8 @@ int replit_init_logits(struct replit_context * ctx,int   n_threads){
 //    replit_eval(const replit_model & model, const int n_threads, const int n_past,
 //                     const std::vector<gpt_vocab::id> & embd_inp, std::vector<float> & embd_w, bool logits_all,
 //                     size_t & mem_per_token)
-    if (!replit_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, false, mem_per_token)) {
+    gpt_kv_window_prepare(&ctx->kv_window, 0, 4);
+    if (!replit_eval(ctx->model, n_threads, 0, ctx->kv_window, { 0, 1, 2, 3 }, ctx->logits, false, mem_per_token)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -748,7 +783,9 @@ int replit_eval(
     size_t mem_per_token = 0;
 //    replit_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, mem_per_token);
     //    if (!gptneox_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads)) {
-    if (!replit_eval(ctx->model, n_threads, n_past, embd, ctx->logits, false, mem_per_token)) {
+    const int64_t t_start_us = ggml_dadbed9_time_us();
+    gpt_kv_window_prepare(&ctx->kv_window, n_past, n_tokens);
+    if (!replit_eval(ctx->model, n_threads, n_past, ctx->kv_window, embd, ctx->logits, ctx->logits_all, mem_per_token)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -756,7 +793,9 @@ int replit_eval(
     if (!ctx->has_evaluated_once) {
         ctx->t_load_us = ggml_dadbed9_time_us() - ctx->t_start_us;
         ctx->has_evaluated_once = true;
+        ctx->load.add(LOAD_PHASE_FIRST_EVAL, t_start_us, ggml_dadbed9_time_us());
     }
+    gpt_base_eval_done(ctx, n_tokens, n_past, t_start_us);
     return 0;
 }
 
@@ -766,9 +805,7 @@ int32_t replit_sample(struct replit_context * ctx, int top_k, float top_p, float
 //                                temp, rng);
     int n_logits = ctx->vocab.raw_vocab.id_to_token.size();
     gpt_vocab::id smpl = gpt_sample_top_k_top_p(n_logits, ctx->logits.data() + (ctx->logits.size() - ctx->vocab.raw_vocab.id_to_token.size()), top_k, top_p, temp, ctx->rng);
-    if (ctx) {
-        ctx->t_sample_us += ggml_dadbed9_time_us() - t_start_sample_us;
-    }
+    gpt_base_sample_done(ctx, t_start_sample_us);
     return  smpl;
 }
 
@@ -789,9 +826,7 @@ int32_t replit_sample_repeat(struct replit_context * ctx,
                                                        top_k, top_p, temp,
                                                        repeat_last_n,repeat_penalty,
                                                        ctx->rng);
-    if (ctx) {
-        ctx->t_sample_us += ggml_dadbed9_time_us() - t_start_sample_us;
-    }
+    gpt_base_sample_done(ctx, t_start_sample_us);
     return  smpl;
 }
 
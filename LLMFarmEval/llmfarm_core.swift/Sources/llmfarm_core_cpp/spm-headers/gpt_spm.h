@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "../ggml/ggml_dadbed9.h"
 
@@ -89,6 +90,55 @@ struct gpt_context_params {
 
 struct gpt_context_params gpt_context_default_params();
 
+// performance timing information, the counterpart of llama_timings
+struct gpt_base_timings {
+    double t_start_ms;
+    double t_end_ms;
+    double t_load_ms;
+    double t_sample_ms;
+    double t_p_eval_ms;
+    double t_eval_ms;
+    double t_first_token_ms; // time to first token of the last turn, see enum gpt_latency
+
+    int32_t n_sample;
+    int32_t n_p_eval;
+    int32_t n_eval;
+};
+
+// the phases of loading the model and creating the context, the counterpart of llama_load_timings;
+// the ggml files are read with the tensor data, without mmap, mlock or repacking
+struct gpt_load_timings {
+    double t_meta_ms;       // file magic and hyperparameters
+    double t_vocab_ms;      // token_to_id and id_to_token, the merges of replit
+    double t_tensors_ms;    // the weights context with its tensors and the KV cache
+    double t_data_ms;       // reading the weights
+    double t_repack_ms;
+    double t_mlock_ms;
+    double t_context_ms;    // the compute and output buffers
+    double t_first_eval_ms; // the first eval
+    double t_total_ms;      // all of the above
+};
+
+// distributions of step latencies, the counterpart of llama_latency, with the same turns
+enum gpt_latency {
+    GPT_LATENCY_TOKEN       = 0, // between two sampled tokens of a turn, includes the eval
+    GPT_LATENCY_EVAL        = 1, // eval of a single token
+    GPT_LATENCY_P_EVAL      = 2, // eval of a prompt batch
+    GPT_LATENCY_SAMPLE      = 3, // sampling of one token
+    GPT_LATENCY_FIRST_TOKEN = 4, // from the start of a turn to its first sampled token
+};
+
+struct gpt_latency_stats {
+    int32_t n;
+
+    double min_ms;
+    double mean_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+};
+
 
 
 gpt_token gpt_base_token_bos();
@@ -103,8 +153,13 @@ int gpt_base_n_ctx(struct gpt_base_context * ctx);
 
 int gpt_base_n_embd(struct gpt_base_context * ctx);
 
+// the logits of the last token of the last eval
 float * gpt_base_get_logits(struct gpt_base_context * ctx);
 
+// the logits of every token of the last eval with logits_all set, one row of n_vocab per token;
+// without logits_all the last one only
+float * gpt_base_get_logits_all(struct gpt_base_context * ctx);
+
 float * gpt_base_get_embeddings(struct gpt_base_context * ctx);
 
 gpt_token gpt_base_str_to_token(struct gpt_base_context * ctx, const char * str);
@@ -121,6 +176,13 @@ int gpt_base_tokenize(
 
 void gpt_base_shift_kv_cache(struct gpt_base_context * ctx, int n);
 
+struct gpt_base_timings gpt_base_get_timings(struct gpt_base_context * ctx);
+void gpt_base_reset_timings(struct gpt_base_context * ctx);
+struct gpt_load_timings gpt_base_get_load_timings(const struct gpt_base_context * ctx);
+struct gpt_latency_stats gpt_base_get_latency_stats(struct gpt_base_context * ctx, enum gpt_latency latency);
+double gpt_base_get_latency_percentile(struct gpt_base_context * ctx, enum gpt_latency latency, double p);
+void gpt_base_dump_timing_info_yaml(FILE * stream, const struct gpt_base_context * ctx);
+
 
 int32_t gpt_base_sample(struct gpt_base_context * ctx, int top_k, float top_p, float temp);
 int32_t gpt_base_sample_repeat(struct gpt_base_context * ctx,
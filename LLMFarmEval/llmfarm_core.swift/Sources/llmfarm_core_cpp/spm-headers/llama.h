@@ -40,7 +40,7 @@
 #define LLAMA_FILE_MAGIC_GGSN 0x6767736eu // 'ggsn'
 
 #define LLAMA_SESSION_MAGIC   LLAMA_FILE_MAGIC_GGSN
-#define LLAMA_SESSION_VERSION 1
+#define LLAMA_SESSION_VERSION 2
 
 #if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST) || defined(GGML_USE_METAL)
 // Defined when llama.cpp is compiled with support for offloading model layers to GPU.
@@ -149,6 +149,8 @@ extern "C" {
         bool use_mmap;   // use mmap if possible
         bool use_mlock;  // force system to keep model in RAM
         bool embedding;  // embedding mode only
+        bool repack;     // interleave the rows of Q4_0/Q4_K weights for the CPU kernels, needs use_mmap = false
+        bool v_rows;     // store the V cache one row per token, like K, instead of transposed (CPU only)
     };
 
     // Signature for logging events
@@ -209,10 +211,127 @@ extern "C" {
         double t_sample_ms;
         double t_p_eval_ms;
         double t_eval_ms;
+        double t_first_token_ms; // time to first token of the last turn, see enum llama_latency
+        double t_pause_ms;       // pauses before the evals, see llama_set_throttle()
 
         int32_t n_sample;
         int32_t n_p_eval;
         int32_t n_eval;
+        int32_t n_pause;         // evals with a pause before them
+        int32_t n_throttled;     // evals with fewer threads than requested
+    };
+
+    // the phases of loading the model and creating the context, they do not overlap
+    struct llama_load_timings {
+        double t_meta_ms;       // GGUF header and metadata, architecture and hyperparameters
+        double t_vocab_ms;      // llm_load_vocab: token_to_id, scores, bpe_ranks
+        double t_tensors_ms;    // the weights context and its tensors
+        double t_data_ms;       // reading or mapping the weights
+        double t_repack_ms;     // interleaving the rows of the weights, see llama_context_params.repack
+        double t_mlock_ms;      // locking the weights, see llama_context_params.use_mlock
+        double t_context_ms;    // llama_new_context_with_model: KV cache and compute buffers
+        double t_first_eval_ms; // the first eval, with the page faults of the mapped weights
+        double t_total_ms;      // all of the above
+    };
+
+    // distributions of step latencies, kept alongside llama_timings
+    // a turn starts with the first eval after creation or llama_reset_timings(), with every eval at
+    // n_past 0, and with every eval of more than one token after a token was sampled
+    enum llama_latency {
+        LLAMA_LATENCY_TOKEN       = 0, // between two sampled tokens of a turn, includes the eval
+        LLAMA_LATENCY_EVAL        = 1, // llama_eval() of a single token
+        LLAMA_LATENCY_P_EVAL      = 2, // llama_eval() of a prompt batch
+        LLAMA_LATENCY_SAMPLE      = 3, // all sampling calls for one sampled token
+        LLAMA_LATENCY_FIRST_TOKEN = 4, // from the start of a turn to its first sampled token
+    };
+
+    // memory used by a context and its model, in bytes, see llama_get_memory_info()
+    struct llama_memory_info {
+        // model weights, shared by the contexts of the model
+        size_t model_size;      // tensor data
+        size_t model_mapped;    // the mapped model file, 0 when loaded without mmap
+        size_t model_resident;  // the pages of the weights in physical memory
+        size_t model_locked;    // locked with mlock
+
+        // KV cache
+        size_t  kv_size;        // allocated for n_ctx tokens
+        size_t  kv_used;        // holding the kv_n_used tokens attended to by the last eval
+        int32_t kv_n_ctx;
+        int32_t kv_n_used;
+
+        // compute buffers
+        size_t compute_meta;    // tensor and graph structs of the eval graph
+        size_t compute_size;    // tensor data, as measured with the worst-case graph at creation
+        size_t compute_peak;    // of compute_size used by the evals so far
+        size_t work_size;       // work buffer of ggml_graph_compute, grows to the largest graph
+
+        size_t output_size;     // logits and embeddings
+
+        size_t context_total;   // all of the above that the context owns, i.e. without the model
+    };
+
+    // the sensors as read before an eval, a value < 0 is unknown
+    struct llama_thermal_sample {
+        double temp_c;          // the hottest thermal zone
+        double freq_mhz;        // the mean current frequency of the CPUs
+        double freq_max_mhz;
+    };
+
+    // what the evals run with until the next poll of the sensors
+    struct llama_throttle_decision {
+        int32_t n_threads;      // at most this many threads, 0 for the n_threads of llama_eval()
+        double  pause_ms;       // the pause before every eval
+    };
+
+    // called after every poll with the sensors and the n_threads of the eval, replaces the steps
+    // of the built-in policy; the pacing of target_tok_s still applies
+    typedef struct llama_throttle_decision (*llama_throttle_policy_fn)(
+            const struct llama_thermal_sample * sample, int32_t n_threads, void * user_data);
+
+    struct llama_throttle_params {
+        double  target_tok_s;   // single token evals at most this often, 0 for no pacing
+        double  max_temp_c;     // above it, fewer threads and then pauses, 0 for no limit
+        double  min_freq_ratio; // below this ratio of the frequencies, the same, 0 for no limit
+        int32_t min_threads;    // the built-in policy does not go below it
+        int32_t poll_ms;        // the sensors are read at most this often
+
+        // a text file "temp_c freq_mhz freq_max_mhz" read in place of the sensors, e.g. for tests;
+        // NULL for /sys/class/thermal and cpufreq on Linux, nothing elsewhere
+        const char * sensor_path;
+
+        llama_throttle_policy_fn policy; // NULL for the built-in policy
+        void * policy_user_data;
+    };
+
+    struct llama_throttle_state {
+        struct llama_thermal_sample     sample;
+        struct llama_throttle_decision  decision;
+    };
+
+    struct llama_autotune_info {
+        bool decode_done;           // the thread count of single token evals is settled
+        bool prefill_done;          // the thread count and the batch size of prompt batches are settled
+        bool from_cache;            // a phase was settled by the cache file
+
+        // the choice of a settled phase, or the best so far
+        int32_t n_threads_decode;
+        int32_t n_threads_prefill;
+        int32_t n_batch_prefill;    // 0 when prompt batches are evaluated whole
+
+        // as measured, 0 for a choice from the cache
+        double decode_tok_s;
+        double prefill_tok_s;
+    };
+
+    struct llama_latency_stats {
+        int32_t n;
+
+        double min_ms;
+        double mean_ms;
+        double p50_ms;
+        double p90_ms;
+        double p99_ms;
+        double max_ms;
     };
 
     LLAMA_API struct llama_context_params llama_context_default_params(void);
@@ -308,10 +427,19 @@ extern "C" {
     // Returns the number of bytes read
     LLAMA_API size_t llama_set_state_data(struct llama_context * ctx, uint8_t * src);
 
+    // Checks that the state of size bytes at src was copied from a context of the same model
+    // and size, so that llama_set_state_data can restore it
+    LLAMA_API bool llama_check_state_data(const struct llama_context * ctx, const uint8_t * src, size_t size);
+
     // Save/load session file
     LLAMA_API bool llama_load_session_file(struct llama_context * ctx, const char * path_session, llama_token * tokens_out, size_t n_token_capacity, size_t * n_token_count_out);
     LLAMA_API bool llama_save_session_file(struct llama_context * ctx, const char * path_session, const llama_token * tokens, size_t n_token_count);
 
+    // Appends the tokens and KV cache rows added since the snapshot in path_session was written,
+    // instead of rewriting the whole session. tokens must start with the tokens already saved in
+    // the file; if they don't (or the file is missing) the session is saved from scratch.
+    LLAMA_API bool llama_append_session_file(struct llama_context * ctx, const char * path_session, const llama_token * tokens, size_t n_token_count);
+
     // Run the llama inference to obtain the logits and probabilities for the next token.
     // tokens + n_tokens is the provided batch of new tokens to process
     // n_past is the number of tokens to use from previous eval calls
@@ -416,6 +544,38 @@ extern "C" {
 
     LLAMA_API struct llama_grammar * llama_grammar_copy(const struct llama_grammar * grammar);
 
+    //
+    // Token masks
+    //
+    // Each context owns an active token mask with one bit per vocab id (set = allowed), stored in
+    // llama_n_token_mask_words(ctx) words. Constraints from grammars, stop-word filters and
+    // allow-lists are combined into it by bitwise AND and applied to the logits in one pass.
+    //
+
+    LLAMA_API int llama_n_token_mask_words(const struct llama_context * ctx);
+
+    /// @details Returns the active token mask of the context.
+    LLAMA_API const uint32_t * llama_get_token_mask(const struct llama_context * ctx);
+
+    /// @details Resets the active token mask to allow every token.
+    LLAMA_API void llama_token_mask_reset(struct llama_context * ctx);
+
+    /// @details ANDs a mask of llama_n_token_mask_words(ctx) words into the active token mask.
+    LLAMA_API void llama_token_mask_and(struct llama_context * ctx, const uint32_t * mask);
+
+    /// @details Restricts the active token mask to the given tokens (allow-list).
+    LLAMA_API void llama_token_mask_allow(struct llama_context * ctx, const llama_token * tokens, size_t n_tokens);
+
+    /// @details Removes the given tokens from the active token mask (stop words, banned tokens).
+    LLAMA_API void llama_token_mask_forbid(struct llama_context * ctx, const llama_token * tokens, size_t n_tokens);
+
+    /// @details ANDs the tokens the grammar accepts in its current state into the active token mask.
+    LLAMA_API void llama_token_mask_grammar(struct llama_context * ctx, const struct llama_grammar * grammar);
+
+    /// @details Sets every logit whose token is not allowed by the active token mask to -INFINITY.
+    /// @param logits n_vocab logits, e.g. the last row of llama_get_logits(ctx).
+    LLAMA_API void llama_apply_token_mask(struct llama_context * ctx, float * logits);
+
     //
     // Sampling functions
     //
@@ -452,6 +612,9 @@ extern "C" {
     LLAMA_API void llama_sample_typical(struct llama_context * ctx, llama_token_data_array * candidates, float p, size_t min_keep);
     LLAMA_API void llama_sample_temperature(struct llama_context * ctx, llama_token_data_array * candidates, float temp);
 
+    /// @details Removes the candidates not allowed by the active token mask (sets their logits to -INFINITY).
+    LLAMA_API void llama_sample_token_mask(struct llama_context * ctx, llama_token_data_array * candidates);
+
     /// @details Apply constraints from grammar
 ///
 LLAMA_API void llama_sample_grammar(struct llama_context * ctx, llama_token_data_array * candidates, const struct llama_grammar * grammar);
@@ -523,6 +686,44 @@ LLAMA_API void llama_sample_grammar(struct llama_context * ctx, llama_token_data
     LLAMA_API void llama_print_timings(struct llama_context * ctx);
     LLAMA_API void llama_reset_timings(struct llama_context * ctx);
 
+    // Not reset by llama_reset_timings(), the first eval phase is 0 until the first eval
+    LLAMA_API struct llama_load_timings llama_get_load_timings(const struct llama_context * ctx);
+
+    // The percentiles are read from histograms with buckets of 6% relative width
+    LLAMA_API struct llama_latency_stats llama_get_latency_stats(struct llama_context * ctx, enum llama_latency latency);
+    LLAMA_API double llama_get_latency_percentile(struct llama_context * ctx, enum llama_latency latency, double p);
+
+    // Memory accounting, queryable at any time
+    LLAMA_API struct llama_memory_info llama_get_memory_info(struct llama_context * ctx);
+    LLAMA_API void llama_print_memory_info(struct llama_context * ctx);
+
+    // Per-op profiling of the evaluations on the CPU, off by default
+    // While enabled, the start and end of every graph node on every thread are recorded; disabling
+    // keeps the records until llama_reset_profile(). The trace is in the Chrome trace event format,
+    // it opens in chrome://tracing and ui.perfetto.dev.
+    LLAMA_API void llama_set_profiling(struct llama_context * ctx, bool enable);
+    LLAMA_API void llama_print_profile(struct llama_context * ctx);
+    LLAMA_API bool llama_export_profile_trace(struct llama_context * ctx, const char * fname);
+    LLAMA_API void llama_reset_profile(struct llama_context * ctx);
+
+    // Online tuning of the thread count and the prompt batch size of llama_eval(), off by default
+    // While enabled, llama_eval() tries fewer threads than n_threads on the evals that are made
+    // anyway, separately for single tokens and prompt batches, and splits prompt batches in pieces
+    // of the sizes up to n_batch; the fastest of each are kept. The choices are stored per model
+    // and CPU in the text file cache_path (NULL to not store them), so later sessions start tuned.
+    // No effect with Metal.
+    LLAMA_API void llama_set_autotune(struct llama_context * ctx, bool enable, const char * cache_path);
+    LLAMA_API struct llama_autotune_info llama_get_autotune_info(const struct llama_context * ctx);
+
+    // Throttling of llama_eval() under heat, off by default
+    // Before an eval the sensors are polled; while the temperature or the frequency is past its
+    // limit, every poll takes one thread off the evals down to min_threads, then adds a pause
+    // before them, and undoes the steps once it is 5 degrees below. The pauses and the throttled
+    // evals are counted in llama_timings. NULL disables it.
+    LLAMA_API struct llama_throttle_params llama_throttle_default_params(void);
+    LLAMA_API void llama_set_throttle(struct llama_context * ctx, const struct llama_throttle_params * params);
+    LLAMA_API struct llama_throttle_state llama_get_throttle_state(const struct llama_context * ctx);
+
     // Print system information
     LLAMA_API const char * llama_print_system_info(void);
 
@@ -69,7 +69,9 @@ void starcoder_free(struct starcoder_context * ctx) {
 }
 
 // load the model's weights from a file
-bool starcoder_model_load(const std::string & fname, starcoder_model & model, gpt_vocab & vocab) {
+bool starcoder_model_load(const std::string & fname, starcoder_model & model, gpt_vocab & vocab, load_timings & load) {
+    int64_t t_start_us = ggml_dadbed9_time_us();
+
     printf("%s: loading model from '%s'\n", __func__, fname.c_str());
 
     auto fin = std::ifstream(fname, std::ios::binary);
@@ -112,6 +114,9 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
         hparams.ftype %= GGML_dadbed9_QNT_VERSION_FACTOR;
     }
 
+    load.add(LOAD_PHASE_META, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load vocab
     {
         int32_t n_vocab = 0;
@@ -158,6 +163,9 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
         }
     }
 
+    load.add(LOAD_PHASE_VOCAB, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // for the big tensors, we have the option to store the data in 16-bit floats or quantized
     // in order to save memory and also to speed up the computation
     ggml_dadbed9_type wtype = ggml_dadbed9_ftype_to_ggml_dadbed9_type((ggml_dadbed9_ftype) (model.hparams.ftype));
@@ -208,8 +216,8 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
         ctx_size += n_layer*(4*n_embd*n_embd*ggml_dadbed9_type_sizef(wtype));         // c_mlp_proj_w
         ctx_size += n_layer*(         n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32)); // c_mlp_proj_b
 
-        ctx_size += n_ctx*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_k
-        ctx_size += n_ctx*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_v
+        ctx_size += gpt_kv_n_rows(n_ctx)*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_k
+        ctx_size += gpt_kv_n_rows(n_ctx)*n_layer*n_embd*ggml_dadbed9_type_sizef(GGML_dadbed9_TYPE_F32); // memory_v
 
         ctx_size += (6 + 12*n_layer)*512; // object overhead
 
@@ -311,7 +319,8 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
         const int n_layer = hparams.n_layer;
         const int n_ctx   = hparams.n_ctx;
 
-        const int n_mem      = n_layer*n_ctx;
+        // the context window slides over the spare rows, see gpt_kv_window
+        const int n_mem      = n_layer*gpt_kv_n_rows(n_ctx);
         const int n_elements = n_embd*n_mem;
 
         model.memory_k = ggml_dadbed9_new_tensor_1d(ctx, GGML_dadbed9_TYPE_F32, n_elements);
@@ -322,6 +331,9 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
         printf("%s: memory size = %8.2f MB, n_mem = %d\n", __func__, memory_size/1024.0/1024.0, n_mem);
     }
 
+    load.add(LOAD_PHASE_TENSORS, t_start_us, ggml_dadbed9_time_us());
+    t_start_us = ggml_dadbed9_time_us();
+
     // load weights
     {
         size_t total_size = 0;
@@ -400,6 +412,8 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
 
     fin.close();
 
+    load.add(LOAD_PHASE_DATA, t_start_us, ggml_dadbed9_time_us());
+
     return true;
 }
 
@@ -408,6 +422,7 @@ bool starcoder_model_load(const std::string & fname, starcoder_model & model, gp
 //   - model:     the model
 //   - n_threads: number of threads to use
 //   - n_past:    the context size so far
+//   - kv:        where the context window is in the KV cache
 //   - embd_inp:  the embeddings of the tokens in the context
 //   - embd_w:    the predicted logits for the next token
 //
@@ -415,8 +430,10 @@ bool starcoder_eval(
         const starcoder_model & model,
         const int n_threads,
         const int n_past,
+        const gpt_kv_window & kv,
         const std::vector<gpt_vocab::id> & embd_inp,
               std::vector<float>         & embd_w,
+              bool                         logits_all,
               size_t                     & mem_per_token) {
     const int N = embd_inp.size();
 
@@ -424,10 +441,13 @@ bool starcoder_eval(
 
     const int n_embd  = hparams.n_embd;
     const int n_layer = hparams.n_layer;
-    const int n_ctx   = hparams.n_ctx;
     const int n_head  = hparams.n_head;
     const int n_vocab = hparams.n_vocab;
 
+    // cache rows per layer and the first row of the window
+    const int n_rows  = kv.n_rows;
+    const int kv_head = kv.head;
+
     static size_t buf_size = 256u*1024*1024;
     static void * buf = malloc(buf_size);
 
@@ -520,8 +540,8 @@ bool starcoder_eval(
 
             // store key and value to memory
             if (N >= 1) {
-                struct ggml_dadbed9_tensor * k = ggml_dadbed9_view_1d(ctx0, model.memory_k, N*n_embd, (ggml_dadbed9_element_size(model.memory_k)*n_embd)*(il*n_ctx + n_past));
-                struct ggml_dadbed9_tensor * v = ggml_dadbed9_view_1d(ctx0, model.memory_v, N*n_embd, (ggml_dadbed9_element_size(model.memory_v)*n_embd)*(il*n_ctx + n_past));
+                struct ggml_dadbed9_tensor * k = ggml_dadbed9_view_1d(ctx0, model.memory_k, N*n_embd, (ggml_dadbed9_element_size(model.memory_k)*n_embd)*(il*n_rows + kv_head + n_past));
+                struct ggml_dadbed9_tensor * v = ggml_dadbed9_view_1d(ctx0, model.memory_v, N*n_embd, (ggml_dadbed9_element_size(model.memory_v)*n_embd)*(il*n_rows + kv_head + n_past));
 
                 ggml_dadbed9_build_forward_expand(&gf, ggml_dadbed9_cpy(ctx0, Kcur, k));
                 ggml_dadbed9_build_forward_expand(&gf, ggml_dadbed9_cpy(ctx0, Vcur, v));
@@ -541,7 +561,7 @@ bool starcoder_eval(
             struct ggml_dadbed9_tensor * K =
                 ggml_dadbed9_permute(ctx0,
                         ggml_dadbed9_reshape_3d(ctx0,
-                            ggml_dadbed9_view_1d(ctx0, model.memory_k, (n_past + N)*n_embd, il*n_ctx*ggml_dadbed9_element_size(model.memory_k)*n_embd),
+                            ggml_dadbed9_view_1d(ctx0, model.memory_k, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_dadbed9_element_size(model.memory_k)*n_embd),
                             n_embd/n_head, n_head, n_past + N),
                         0, 2, 1, 3); //TODO: need to be tiled
 
@@ -550,7 +570,7 @@ bool starcoder_eval(
             //    ggml_dadbed9_cpy(ctx0,
             //            ggml_dadbed9_permute(ctx0,
             //                ggml_dadbed9_reshape_3d(ctx0,
-            //                    ggml_dadbed9_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, il*n_ctx*ggml_dadbed9_element_size(model.memory_v)*n_embd),
+            //                    ggml_dadbed9_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_dadbed9_element_size(model.memory_v)*n_embd),
             //                    n_embd/n_head, n_head, n_past + N),
             //                1, 2, 0, 3),
             //            ggml_dadbed9_new_tensor_3d(ctx0, GGML_dadbed9_TYPE_F32, n_past + N, n_embd/n_head, n_head));
@@ -583,7 +603,7 @@ bool starcoder_eval(
                 ggml_dadbed9_cpy(ctx0,
                         ggml_dadbed9_permute(ctx0,
                             ggml_dadbed9_reshape_3d(ctx0,
-                                ggml_dadbed9_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, il*n_ctx*ggml_dadbed9_element_size(model.memory_v)*n_embd),
+                                ggml_dadbed9_view_1d(ctx0, model.memory_v, (n_past + N)*n_embd, (il*n_rows + kv_head)*ggml_dadbed9_element_size(model.memory_v)*n_embd),
                                 n_embd/n_head, n_head, n_past + N),
                             1, 2, 0, 3),
                         ggml_dadbed9_new_tensor_3d(ctx0, model.memory_v->type, n_past + N, n_embd/n_head, n_head));
@@ -719,12 +739,15 @@ bool starcoder_eval(
     //    ggml_dadbed9_graph_dump_dot(&gf, NULL, "gpt-2.dot");
     //}
 
-    //embd_w.resize(n_vocab*N);
-    //memcpy(embd_w.data(), ggml_dadbed9_get_data(inpL), sizeof(float)*n_vocab*N);
-
-    // return result just for the last token
-    embd_w.resize(n_vocab);
-    memcpy(embd_w.data(), (float *) ggml_dadbed9_get_data(inpL) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+    if (logits_all) {
+        // return result for all tokens
+        embd_w.resize(n_vocab*N);
+        memcpy(embd_w.data(), (float *) ggml_dadbed9_get_data(inpL), sizeof(float)*n_vocab*N);
+    } else {
+        // return result just for the last token
+        embd_w.resize(n_vocab);
+        memcpy(embd_w.data(), (float *) ggml_dadbed9_get_data(inpL) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+    }
 
     if (mem_per_token == 0) {
         mem_per_token = ggml_dadbed9_used_mem(ctx0)/N;
@@ -741,6 +764,7 @@ struct starcoder_context * starcoder_init_from_file(const char * path_model, str
     ggml_dadbed9_time_init();
 
     starcoder_context * ctx = new starcoder_context;
+    ctx->t_start_us = ggml_dadbed9_time_us();
 
     if (params.seed <= 0) {
         params.seed = time(NULL);
@@ -751,12 +775,26 @@ struct starcoder_context * starcoder_init_from_file(const char * path_model, str
 
     ggml_dadbed9_type memory_type = params.f16_kv ? GGML_dadbed9_TYPE_F16 : GGML_dadbed9_TYPE_F32;
     
-    if (!starcoder_model_load(path_model, ctx->model, ctx->vocab)) {
+    if (!starcoder_model_load(path_model, ctx->model, ctx->vocab, ctx->load)) {
         fprintf(stderr, "%s: failed to load model\n", __func__);
         delete ctx;
         return nullptr;
     }
 
+    const int64_t t_start_context_us = ggml_dadbed9_time_us();
+
+    // the context window in the KV cache
+    {
+        auto & kv = ctx->kv_window;
+        kv.k        = (uint8_t *) ctx->model.memory_k->data;
+        kv.v        = (uint8_t *) ctx->model.memory_v->data;
+        kv.elt_size = ggml_dadbed9_element_size(ctx->model.memory_k);
+        kv.n_embd   = ctx->model.hparams.n_embd;
+        kv.n_layer  = ctx->model.hparams.n_layer;
+        kv.n_rows   = gpt_kv_n_rows(ctx->model.hparams.n_ctx);
+        kv.v_trans  = false;
+    }
+
 
     // reserve memory for context buffers
     if (!params.vocab_only) {
@@ -790,13 +828,16 @@ struct starcoder_context * starcoder_init_from_file(const char * path_model, str
 //        ctx->buf_scratch[1].resize(MEM_REQ_SCRATCH1().at(ctx->model.type));
     }
 
+    ctx->load.add(LOAD_PHASE_CONTEXT, t_start_context_us, ggml_dadbed9_time_us());
+
     return ctx;
 }
 
 
 int starcoder_init_logits(struct starcoder_context * ctx,int   n_threads){
     size_t mem_per_token = 0;
-    if (!starcoder_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, mem_per_token)) {
+    gpt_kv_window_prepare(&ctx->kv_window, 0, 4);
+    if (!starcoder_eval(ctx->model, n_threads, 0, ctx->kv_window, { 0, 1, 2, 3 }, ctx->logits, false, mem_per_token)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -818,7 +859,9 @@ int starcoder_eval(
     size_t mem_per_token = 0;
 //    starcoder_eval(ctx->model, n_threads, 0, { 0, 1, 2, 3 }, ctx->logits, mem_per_token);
     //    if (!gptneox_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads)) {
-    if (!starcoder_eval(ctx->model, n_threads, n_past, embd, ctx->logits, mem_per_token)) {
+    const int64_t t_start_us = ggml_dadbed9_time_us();
+    gpt_kv_window_prepare(&ctx->kv_window, n_past, n_tokens);
+    if (!starcoder_eval(ctx->model, n_threads, n_past, ctx->kv_window, embd, ctx->logits, ctx->logits_all, mem_per_token)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -826,7 +869,9 @@ int starcoder_eval(
     if (!ctx->has_evaluated_once) {
         ctx->t_load_us = ggml_dadbed9_time_us() - ctx->t_start_us;
         ctx->has_evaluated_once = true;
+        ctx->load.add(LOAD_PHASE_FIRST_EVAL, t_start_us, ggml_dadbed9_time_us());
     }
+    gpt_base_eval_done(ctx, n_tokens, n_past, t_start_us);
     return 0;
 }
 
@@ -0,0 +1,176 @@
+// Thermal- and frequency-aware throttling of the evaluations, see llama_set_throttle().
+//
+// Sustained generation heats the SoC until the firmware lowers the clocks, and from then on the
+// latency of every token goes up. eval_throttle reads the temperature and the CPU frequency
+// between evals and, while they are past the limits, runs the evals with fewer threads and then
+// pauses before them; it steps back once the temperature is below the limit by HYSTERESIS_C.
+// Independently, single token evals can be paced to a target rate, which spreads the heat of a
+// reply instead of running flat out. An application policy can replace the built-in steps.
+// The caller polls, sleeps the pause and accounts it (see pause_us()).
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+struct thermal_sample {
+    double temp_c       = -1.0; // the hottest sensor, < 0 when unknown
+    double freq_mhz     = -1.0; // the mean current frequency of the CPUs, < 0 when unknown
+    double freq_max_mhz = -1.0;
+};
+
+struct eval_throttle {
+    // a step of the built-in policy per poll while hot, undone one by one while cool
+    static constexpr double HYSTERESIS_C  = 5.0;
+    static constexpr double FREQ_MARGIN   = 0.05;  // above min_freq_ratio to count as cool
+    static constexpr double PAUSE_STEP_MS = 10.0;
+    static constexpr double PAUSE_MAX_MS  = 250.0;
+
+    // Linux sysfs, read up to the first missing entry
+    static const int MAX_ZONES = 64;
+    static const int MAX_CPUS  = 256;
+
+    bool enabled = false;
+
+    double      target_tok_s   = 0.0; // single token evals at most this often, 0 for no pacing
+    double      max_temp_c     = 0.0; // 0 for no limit
+    double      min_freq_ratio = 0.0; // of freq_max_mhz, 0 for no limit
+    int         min_threads    = 1;
+    int64_t     poll_us        = 1000000;
+    std::string sensor_path;          // empty for the sensors of the system
+
+    thermal_sample sample;
+
+    // the state of the policy, from the last poll
+    int    n_threads_cap = 0;   // 0 while not capped
+    double pause_ms      = 0.0; // before every eval
+
+    int64_t t_poll_us        = -1;
+    int64_t t_last_decode_us = -1; // the start of the last single token eval
+
+    void reset() {
+        sample           = thermal_sample();
+        n_threads_cap    = 0;
+        pause_ms         = 0.0;
+        t_poll_us        = -1;
+        t_last_decode_us = -1;
+    }
+
+    // reads the sensors when poll_us has passed since the last time, returns true if it did
+    bool poll(int64_t t_now_us) {
+        if (t_poll_us >= 0 && t_now_us - t_poll_us < poll_us) {
+            return false;
+        }
+        t_poll_us = t_now_us;
+        sample    = sensor_path.empty() ? read_system() : read_file(sensor_path);
+        return true;
+    }
+
+    // the built-in policy, after a poll, for evals with n_threads
+    void step(int n_threads) {
+        const int n_min = std::max(1, std::min(min_threads, n_threads));
+        int cap = n_threads_cap > 0 ? std::min(n_threads_cap, n_threads) : n_threads;
+
+        if (is_hot()) {
+            if (cap > n_min) {
+                cap--;
+            } else {
+                pause_ms = std::min(PAUSE_MAX_MS, pause_ms + PAUSE_STEP_MS);
+            }
+        } else if (is_cool()) {
+            if (pause_ms > 0.0) {
+                pause_ms = std::max(0.0, pause_ms - PAUSE_STEP_MS);
+            } else if (cap < n_threads) {
+                cap++;
+            }
+        }
+        n_threads_cap = cap < n_threads ? cap : 0;
+    }
+
+    int n_threads(int n_threads) const {
+        return n_threads_cap > 0 ? std::min(n_threads_cap, n_threads) : n_threads;
+    }
+
+    // the pause before an eval of n_tokens that starts at t_now_us
+    int64_t pause_us(int n_tokens, int64_t t_now_us) const {
+        int64_t t_us = (int64_t) (1e3*pause_ms);
+        if (n_tokens == 1 && target_tok_s > 0.0 && t_last_decode_us >= 0) {
+            const int64_t t_next_us = t_last_decode_us + (int64_t) (1e6/target_tok_s);
+            t_us = std::max(t_us, t_next_us - t_now_us);
+        }
+        return std::max<int64_t>(0, t_us);
+    }
+
+    bool is_hot() const {
+        return (max_temp_c > 0.0 && sample.temp_c >= max_temp_c) ||
+               (min_freq_ratio > 0.0 && freq_ratio() >= 0.0 && freq_ratio() < min_freq_ratio);
+    }
+
+    bool is_cool() const {
+        return (max_temp_c <= 0.0 || sample.temp_c < max_temp_c - HYSTERESIS_C) &&
+               (min_freq_ratio <= 0.0 || freq_ratio() < 0.0 || freq_ratio() >= min_freq_ratio + FREQ_MARGIN);
+    }
+
+    double freq_ratio() const {
+        return sample.freq_mhz > 0.0 && sample.freq_max_mhz > 0.0 ? sample.freq_mhz/sample.freq_max_mhz : -1.0;
+    }
+
+    // a stand-in for the sensors: "temp_c freq_mhz freq_max_mhz", the missing values are unknown
+    static thermal_sample read_file(const std::string & path) {
+        thermal_sample s;
+        std::ifstream fin(path);
+        double v[3] = { -1.0, -1.0, -1.0 };
+        for (double & x : v) {
+            if (!(fin >> x)) {
+                x = -1.0; // a failed read stores 0
+                break;
+            }
+        }
+        s.temp_c       = v[0];
+        s.freq_mhz     = v[1];
+        s.freq_max_mhz = v[2];
+        return s;
+    }
+
+    // the thermal zones and cpufreq of Linux, in millidegrees and kHz; nothing elsewhere
+    static thermal_sample read_system() {
+        thermal_sample s;
+#if defined(__linux__)
+        for (int i = 0; i < MAX_ZONES; i++) {
+            std::ifstream fin("/sys/class/thermal/thermal_zone" + std::to_string(i) + "/temp");
+            if (!fin) {
+                break;
+            }
+            double t = 0.0;
+            if (fin >> t) {
+                s.temp_c = std::max(s.temp_c, 1e-3*t);
+            }
+        }
+
+        double sum_cur = 0.0;
+        double sum_max = 0.0;
+        int    n_cpus  = 0;
+        for (int i = 0; i < MAX_CPUS; i++) {
+            const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(i) + "/cpufreq/";
+            std::ifstream fcur(dir + "scaling_cur_freq");
+            std::ifstream fmax(dir + "cpuinfo_max_freq");
+            double cur = 0.0;
+            double max = 0.0;
+            if (!(fcur >> cur) || !(fmax >> max)) {
+                break;
+            }
+            sum_cur += cur;
+            sum_max += max;
+            n_cpus++;
+        }
+        if (n_cpus > 0) {
+            s.freq_mhz     = 1e-3*sum_cur/n_cpus;
+            s.freq_max_mhz = 1e-3*sum_max/n_cpus;
+        }
+#endif
+        return s;
+    }
+};